@@ -256,7 +256,7 @@ for more information])
 	fi
 ])
 
-dnl EQ_PACKAGE_ENABLED(flags-prefix, package-name [,check-libs [,check-headers]])
+dnl EQ_PACKAGE_ENABLED(flags-prefix, package-name [,check-libs [,check-headers [,default]]])
 dnl Check for specific library and header files for required package. Checks if
 dnl user enabled this package or if it could be enabled by default. Names of 
 dnl the package libraries and specific functions in that libraries are provided
@@ -267,6 +267,8 @@ dnl for example:
 dnl    EQ_PACKAGE_ENABLED( ZLIB, zlib)
 dnl will result in ZLIB_LIBS and ZLIB_CFLAGS variables set to libs and cflags
 dnl for the package zlib and ZLIB_ENABLED set to true if package is installed.
+dnl The optional `default' argument may be set to `no' to make the package
+dnl opt-in, that is the package is only checked for if --with-package is given.
 AC_DEFUN([EQ_PACKAGE_ENABLED],[
 	ac_new_cflags=
 	ac_new_libs=
@@ -275,7 +277,7 @@ AC_DEFUN([EQ_PACKAGE_ENABLED],[
 	ac_cflags_found=false
 	ac_libs_found=false
 
-	AC_ARG_WITH([$2], [AS_HELP_STRING([--with-$2], [enable package `$2' support, @<:@default=check@:>@])], [ac_with_package=$withval], [ac_with_package=check])
+	AC_ARG_WITH([$2], [AS_HELP_STRING([--with-$2], [enable package `$2' support, @<:@default=]m4_default([$5], [check])[@:>@])], [ac_with_package=$withval], [ac_with_package=m4_default([$5], [check])])
 	
 	if test "X$4" != "X"; then
 		AC_ARG_WITH([$2-inc], [AS_HELP_STRING([--with-$2-inc], [location of package `$2' header files @<:@directories provided in CFLAGS@:>@])], [ac_new_cflags=-I$withval; ac_cflags_given=true; ac_with_package=yes])
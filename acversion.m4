@@ -1,4 +1,4 @@
-AC_DEFUN([ac_VERSION], [1.1.0])
+AC_DEFUN([ac_VERSION], [2.0.0])
 AC_DEFUN([ac_PACKAGE_NAME], [expat-dom])
 AC_DEFUN([ac_EMAIL],   [kolotsey@gmail.com])
 AC_DEFUN([ac_URL],     [https://github.com/kolotsey/expat-dom])
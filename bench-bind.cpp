@@ -0,0 +1,194 @@
+/*
+ * Copyright (c) 2011 Sergey Kolotsey.
+ * This file if part of expat-dom library.
+ * See the file COPYING for copying permission.
+ *
+ * Benchmark of extraction of records: dom_parse_buffer() with dom_find_*()
+ * against parsing directly into structures with expat-dom-bind.hpp.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <string>
+#include <vector>
+#include "expat-dom-bind.hpp"
+
+
+
+#define BENCH_RECORDS 200000
+#define BENCH_LOOPS 5
+
+struct item{
+	int64_t id;
+	std::string currency;
+	std::string name;
+	double price;
+	bool available;
+};
+
+namespace bind=expat_dom::bind;
+
+static constexpr auto item_schema=bind::record<item>("item",
+	bind::attr("id", &item::id),
+	bind::attr("currency", &item::currency),
+	bind::child("name", &item::name),
+	bind::child("price", &item::price),
+	bind::child("available", &item::available));
+
+
+
+static double bench_now(void){
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec+ts.tv_nsec/1e9;
+}
+
+/*
+ * Generates the same product feed as bench.c does.
+ */
+static std::string bench_generate(int records){
+	std::string ret="<?xml version=\"1.0\"?>\n<feed>\n";
+	char buffer[512];
+	int i;
+
+	for(i=0; i<records; i++){
+		snprintf(buffer, sizeof(buffer), "\t<item id=\"%d\" currency=\"EUR\">\n"
+				"\t\t<name>Product &amp; accessory number %d</name>\n"
+				"\t\t<price>%d.%02d</price>\n"
+				"\t\t<available>%s</available>\n"
+				"\t\t<description><![CDATA[Item <%d> in stock]]></description>\n"
+				"\t</item>\n", i, i, i%1000, i%100, (i%3)? "true" : "false", i);
+		ret+=buffer;
+	}
+	ret+="</feed>\n";
+	return ret;
+}
+
+static std::string bench_text(dom_t *node){
+	if(node->user_data){
+		return std::string(node->user_data, node->user_data_len);
+	}
+	return std::string(node->data? node->data : "", node->data_len);
+}
+
+/*
+ * Extracts the records from a DOM tree the way an application would.
+ */
+static int bench_dom(const std::string &xml, std::vector<item> &items){
+	dom_t *dom;
+	dom_t *feed;
+	dom_t *node;
+	dom_t *child;
+	const char *val;
+	int value;
+	item i;
+
+	if(NULL==(dom=dom_parse_buffer(xml.data(), xml.size()))){
+		return errno;
+	}
+	feed=dom_find_node(dom, "feed");
+	for(node=feed? feed->child : NULL; node; node=node->next){
+		if(strcasecmp(node->name, "item")){
+			continue;
+		}
+		i=item();
+		dom_attr_int64(node->attr, "id", &i.id);
+		if((val=dom_find_attr(node->attr, "currency"))){
+			i.currency=val;
+		}
+		if((child=dom_find_node(node, "name"))){
+			i.name=bench_text(child);
+		}
+		if((child=dom_find_node(node, "price"))){
+			dom_text_double(child, &i.price);
+		}
+		if((child=dom_find_node(node, "available")) && 0==dom_text_bool(child, &value)){
+			i.available=value;
+		}
+		items.push_back(std::move(i));
+	}
+	dom_free(dom);
+	return 0;
+}
+
+static void bench_bind(const std::string &xml, std::vector<item> &items){
+	bind::parse(xml, item_schema, [&items](item &i){
+		items.push_back(std::move(i));
+	});
+}
+
+static double bench_checksum(const std::vector<item> &items){
+	double sum=0;
+
+	for(const item &i : items){
+		sum+=i.id+i.price+i.available+i.name.size()+i.currency.size();
+	}
+	return sum;
+}
+
+static void bench_report(const char *phase, double seconds, double mb, size_t records, double checksum){
+	printf("%-6s %10.2f ms %10.2f MB/s %10.2f ns/record  checksum %.0f\n", phase, seconds*1e3,
+			mb/seconds, seconds*1e9/records, checksum);
+}
+
+int main(int argc, char *argv[]){
+	int records=BENCH_RECORDS;
+	std::vector<item> items;
+	double best_dom=0;
+	double best_bind=0;
+	double checksum_dom=0;
+	double checksum_bind=0;
+	double start;
+	double mb;
+	int opt;
+	int i;
+
+	while(-1 !=(opt=getopt(argc, argv, "n:h"))){
+		switch(opt){
+		case 'n':
+			records=atoi(optarg);
+			break;
+		default:
+			fprintf(stderr, "Usage: %s [-n records]\n", argv[0]);
+			return 1;
+		}
+	}
+	std::string xml=bench_generate(records);
+	mb=xml.size()/(1024.0*1024.0);
+	printf("input  %10.2f MB %10d records\n", mb, records);
+	items.reserve(records);
+
+	//the best of several loops is reported, the first loop warms up the allocator
+	for(i=0; i<BENCH_LOOPS; i++){
+		items.clear();
+		start=bench_now();
+		if(bench_dom(xml, items)){
+			fprintf(stderr, "Parse error: %s\n", strerror(errno));
+			return 1;
+		}
+		start=bench_now()-start;
+		best_dom=(i && best_dom<start)? best_dom : start;
+		checksum_dom=bench_checksum(items);
+
+		items.clear();
+		start=bench_now();
+		try{
+			bench_bind(xml, items);
+		}catch(const expat_dom::error &e){
+			fprintf(stderr, "Parse error: %s\n", e.what());
+			return 1;
+		}
+		start=bench_now()-start;
+		best_bind=(i && best_bind<start)? best_bind : start;
+		checksum_bind=bench_checksum(items);
+	}
+	bench_report("dom", best_dom, mb, records, checksum_dom);
+	bench_report("bind", best_bind, mb, records, checksum_bind);
+	printf("speedup %.2fx\n", best_dom/best_bind);
+	return checksum_dom==checksum_bind? 0 : 1;
+}
@@ -0,0 +1,480 @@
+/*
+ * Copyright (c) 2011 Sergey Kolotsey.
+ * This file if part of expat-dom library.
+ * See the file COPYING for copying permission.
+ *
+ * Benchmark of parse, find, print and free paths of the library, of the
+ * pull reader against expat with empty handlers, and of dom_xml_to_json()
+ * against conversion through the tree. With option -p hardware counters are
+ * read around every phase.
+ */
+
+#include "expat-config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef HAVE_LINUX_PERF_EVENT_H
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+#include <expat.h>
+#include "expat-dom.h"
+
+
+
+#define BENCH_RECORDS 200000
+#define BENCH_FIND_LOOPS 10
+
+typedef struct{
+	const char *name;
+	unsigned int type;
+	unsigned long long config;
+	int fd;
+	unsigned long long value;
+}bench_counter_t;
+
+#ifdef HAVE_LINUX_PERF_EVENT_H
+#define BENCH_CACHE(cache, op, result) \
+	((PERF_COUNT_HW_CACHE_ ## cache) | ((PERF_COUNT_HW_CACHE_OP_ ## op) << 8) \
+	| ((PERF_COUNT_HW_CACHE_RESULT_ ## result) << 16))
+
+static bench_counter_t counters[]={
+	{ "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES, -1, 0},
+	{ "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS, -1, 0},
+	{ "L1d misses", PERF_TYPE_HW_CACHE, BENCH_CACHE(L1D, READ, MISS), -1, 0},
+	{ "LLC misses", PERF_TYPE_HW_CACHE, BENCH_CACHE(LL, READ, MISS), -1, 0},
+	{ "branch misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES, -1, 0},
+};
+#else
+static bench_counter_t counters[]={
+	{ NULL, 0, 0, -1, 0},
+};
+#endif
+#define BENCH_COUNTERS ((int)(sizeof(counters)/sizeof(counters[0])))
+
+static int use_counters;
+static struct timespec phase_start;
+
+
+
+/*
+ * Opens the counters. Counters that are not supported by the CPU, the kernel
+ * or the permissions are skipped. Returns the number of open counters.
+ */
+static int bench_counters_open(void){
+	int opened=0;
+#ifdef HAVE_LINUX_PERF_EVENT_H
+	struct perf_event_attr attr;
+	int i;
+
+	for(i=0; i<BENCH_COUNTERS; i++){
+		memset(&attr, 0, sizeof(attr));
+		attr.size=sizeof(attr);
+		attr.type=counters[i].type;
+		attr.config=counters[i].config;
+		attr.disabled=1;
+		attr.exclude_kernel=1;
+		attr.exclude_hv=1;
+		counters[i].fd=syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
+		if(counters[i].fd !=-1){
+			opened++;
+		}
+	}
+#endif
+	return opened;
+}
+
+static void bench_start(void){
+#ifdef HAVE_LINUX_PERF_EVENT_H
+	int i;
+
+	for(i=0; use_counters && i<BENCH_COUNTERS; i++){
+		if(counters[i].fd !=-1){
+			ioctl(counters[i].fd, PERF_EVENT_IOC_RESET, 0);
+			ioctl(counters[i].fd, PERF_EVENT_IOC_ENABLE, 0);
+		}
+	}
+#endif
+	clock_gettime(CLOCK_MONOTONIC, &phase_start);
+}
+
+/*
+ * Stops the phase and prints its results scaled per MB of input and per node.
+ */
+static void bench_stop(const char *phase, double mb, int nodes){
+	struct timespec end;
+	double ns;
+	int i;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	for(i=0; use_counters && i<BENCH_COUNTERS; i++){
+		counters[i].value=0;
+#ifdef HAVE_LINUX_PERF_EVENT_H
+		if(counters[i].fd !=-1){
+			ioctl(counters[i].fd, PERF_EVENT_IOC_DISABLE, 0);
+			if(sizeof(counters[i].value) !=read(counters[i].fd, &counters[i].value, sizeof(counters[i].value))){
+				counters[i].value=0;
+			}
+		}
+#endif
+	}
+	ns=(end.tv_sec-phase_start.tv_sec)*1e9+(end.tv_nsec-phase_start.tv_nsec);
+	printf("%-6s %10.2f ms %10.2f MB/s %10.2f ns/node\n", phase, ns/1e6, mb/(ns/1e9), ns/nodes);
+	for(i=0; use_counters && i<BENCH_COUNTERS; i++){
+		if(counters[i].fd !=-1){
+			printf("       %-14s %14llu %14.1f /MB %10.2f /node\n", counters[i].name, counters[i].value,
+					counters[i].value/mb, (double)counters[i].value/nodes);
+		}
+	}
+}
+
+static int bench_count(dom_t *dom){
+	int count=0;
+
+	while(dom){
+		count+=1+bench_count(dom->child);
+		dom=dom->next;
+	}
+	return count;
+}
+
+/*
+ * Generates a document with records similar to a product feed.
+ */
+static char *bench_generate(int records, size_t *len){
+	char *buffer;
+	size_t size;
+	int i;
+	FILE *f;
+
+	if(NULL==(f=open_memstream(&buffer, &size))){
+		return NULL;
+	}
+	fprintf(f, "<?xml version=\"1.0\"?>\n<feed>\n");
+	for(i=0; i<records; i++){
+		fprintf(f, "\t<item id=\"%d\" currency=\"EUR\">\n"
+				"\t\t<name>Product &amp; accessory number %d</name>\n"
+				"\t\t<price>%d.%02d</price>\n"
+				"\t\t<available>%s</available>\n"
+				"\t\t<description><![CDATA[Item <%d> in stock]]></description>\n"
+				"\t</item>\n", i, i, i%1000, i%100, (i%3)? "true" : "false", i);
+	}
+	fprintf(f, "</feed>\n");
+	fclose(f);
+	*len=size;
+	return buffer;
+}
+
+static char *bench_read(const char *name, size_t *len){
+	struct stat st;
+	char *buffer;
+	size_t done;
+	ssize_t ret;
+	int fd;
+
+	if(-1==(fd=open(name, O_RDONLY))){
+		return NULL;
+	}
+	//an empty file still gets a buffer, the parser reports the error
+	if(-1==fstat(fd, &st) || NULL==(buffer=malloc(st.st_size? st.st_size : 1))){
+		close(fd);
+		return NULL;
+	}
+	//read() returns at most 2 GB at once
+	for(done=0; done<(size_t)st.st_size; done+=ret){
+		if(-1==(ret=read(fd, buffer+done, st.st_size-done)) && errno==EINTR){
+			ret=0;
+		}else if(ret<=0){
+			if( !ret){
+				//the file was truncated meanwhile
+				errno=EIO;
+			}
+			free(buffer);
+			close(fd);
+			return NULL;
+		}
+	}
+	close(fd);
+	*len=st.st_size;
+	return buffer;
+}
+
+static void XMLCALL bench_start_element(void *user_data, const char *name, const char **atts){
+	(*(int *)user_data)++;
+}
+
+static void XMLCALL bench_end_element(void *user_data, const char *name){
+}
+
+static void XMLCALL bench_data(void *user_data, const char *s, int len){
+}
+
+/*
+ * Parses the buffer with expat alone, the lower bound for the reader.
+ * Returns number of elements.
+ */
+static int bench_expat(const char *buffer, size_t buffer_len){
+	XML_Parser parser;
+	int count=0;
+
+	if((parser=XML_ParserCreate(NULL))){
+		XML_SetUserData(parser, &count);
+		XML_SetElementHandler(parser, bench_start_element, bench_end_element);
+		XML_SetCharacterDataHandler(parser, bench_data);
+		XML_Parse(parser, buffer, (int)buffer_len, 1);
+		XML_ParserFree(parser);
+	}
+	return count;
+}
+
+/*
+ * Reads all events of the buffer. Returns number of elements.
+ */
+static int bench_reader(const char *buffer, size_t buffer_len){
+	dom_reader_event_t event;
+	dom_reader_t *reader;
+	int count=0;
+	int type;
+
+	if((reader=dom_reader_new_buffer(buffer, buffer_len, NULL))){
+		while((type=dom_reader_next(reader, &event))>0){
+			count+=(type==DOM_READER_START);
+		}
+		dom_reader_free(reader);
+	}
+	return count;
+}
+
+static int bench_json_write(void *ctx, const char *buffer, size_t buffer_len){
+	*(size_t *)ctx+=buffer_len;
+	return 0;
+}
+
+/*
+ * Converts the buffer to JSON with dom_xml_to_json(). Returns number of
+ * bytes of JSON.
+ */
+static size_t bench_json(const char *buffer, size_t buffer_len){
+	size_t len=0;
+
+	dom_xml_to_json(buffer, buffer_len, bench_json_write, &len, NULL);
+	return len;
+}
+
+//output of the conversion through the tree
+typedef struct{
+	char *data;
+	size_t len;
+	size_t size;
+}bench_out_t;
+
+static void bench_put(bench_out_t *out, const char *s, size_t len){
+	char *temp;
+
+	if(out->len+len>out->size){
+		out->size=(out->len+len)*2;
+		if(NULL==(temp=realloc(out->data, out->size))){
+			return;
+		}
+		out->data=temp;
+	}
+	memcpy(out->data+out->len, s, len);
+	out->len+=len;
+}
+
+static void bench_put_string(bench_out_t *out, const char *s, size_t len){
+	char escaped[8];
+	size_t i;
+
+	bench_put(out, "\"", 1);
+	for(i=0; i<len; i++){
+		if(s[i]=='"' || s[i]=='\\'){
+			escaped[0]='\\';
+			escaped[1]=s[i];
+			bench_put(out, escaped, 2);
+		}else if((unsigned char)s[i]<0x20){
+			snprintf(escaped, sizeof(escaped), "\\u%04x", (unsigned char)s[i]);
+			bench_put(out, escaped, 6);
+		}else{
+			bench_put(out, s+i, 1);
+		}
+	}
+	bench_put(out, "\"", 1);
+}
+
+/*
+ * Writes the node as a JSON value with the conventions of dom_xml_to_json():
+ * siblings are grouped by looking at the next ones in the tree.
+ */
+static void bench_dom_json(bench_out_t *out, dom_t *dom){
+	dom_attr_t *attr;
+	dom_t *child;
+	int members=0;
+
+	if( !dom->attr && !dom->child){
+		if(dom->data_len){
+			bench_put_string(out, dom->data, dom->data_len);
+		}else{
+			bench_put(out, "null", 4);
+		}
+		return;
+	}
+	bench_put(out, "{", 1);
+	for(attr=dom->attr; attr; attr=attr->next, members++){
+		bench_put(out, ",\"@", members? 3 : 2);
+		bench_put(out, attr->var, strlen(attr->var));
+		bench_put(out, "\":", 2);
+		bench_put_string(out, attr->val, strlen(attr->val));
+	}
+	for(child=dom->child; child; members++){
+		if(members){
+			bench_put(out, ",", 1);
+		}
+		bench_put_string(out, child->name, strlen(child->name));
+		bench_put(out, ":", 1);
+		if(child->next && 0==strcmp(child->name, child->next->name)){
+			bench_put(out, "[", 1);
+			bench_dom_json(out, child);
+			for(; child->next && 0==strcmp(child->name, child->next->name); child=child->next){
+				bench_put(out, ",", 1);
+				bench_dom_json(out, child->next);
+			}
+			bench_put(out, "]", 1);
+		}else{
+			bench_dom_json(out, child);
+		}
+		child=child->next;
+	}
+	bench_put(out, "}", 1);
+}
+
+/*
+ * Parses the buffer into a tree, writes the tree as JSON and frees it, the
+ * way dom_xml_to_json() is replaced without it. Returns number of bytes.
+ */
+static size_t bench_tree_json(const char *buffer, size_t buffer_len){
+	bench_out_t out={NULL, 0, 0};
+	dom_t *dom;
+
+	if((dom=dom_parse_buffer(buffer, buffer_len))){
+		bench_put(&out, "{", 1);
+		bench_put_string(&out, dom->name, strlen(dom->name));
+		bench_put(&out, ":", 1);
+		bench_dom_json(&out, dom);
+		bench_put(&out, "}", 1);
+		dom_free(dom);
+	}
+	free(out.data);
+	return out.len;
+}
+
+static void usage(const char *name){
+	fprintf(stderr, "Usage: %s [-p] [-n records] [file.xml]\n"
+			"  -p          read hardware counters around every phase\n"
+			"  -n records  number of records of the generated document\n", name);
+}
+
+int main(int argc, char *argv[]){
+	int records=BENCH_RECORDS;
+	char *buffer;
+	size_t buffer_len;
+	FILE *null;
+	dom_t *dom;
+	double mb;
+	int nodes;
+	int opt;
+	int i;
+
+	while(-1 !=(opt=getopt(argc, argv, "pn:h"))){
+		switch(opt){
+		case 'p':
+			use_counters=1;
+			break;
+		case 'n':
+			records=atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	if(optind<argc){
+		buffer=bench_read(argv[optind], &buffer_len);
+	}else{
+		buffer=bench_generate(records, &buffer_len);
+	}
+	if( !buffer){
+		fprintf(stderr, "Could not read input: %s\n", strerror(errno));
+		return 1;
+	}
+	if(use_counters && !bench_counters_open()){
+		fprintf(stderr, "Hardware counters are not available, timing only\n");
+		use_counters=0;
+	}
+	mb=buffer_len/(1024.0*1024.0);
+
+	//parse once to warm up the allocator and count the nodes
+	if(NULL==(dom=dom_parse_buffer(buffer, buffer_len))){
+		fprintf(stderr, "Parse error: %s\n", strerror(errno));
+		return 1;
+	}
+	nodes=bench_count(dom);
+	dom_free(dom);
+	printf("input  %10.2f MB %10d nodes\n", mb, nodes);
+
+	bench_start();
+	dom=dom_parse_buffer(buffer, buffer_len);
+	bench_stop("parse", mb, nodes);
+
+	//the name is not in the document, so every node is visited
+	bench_start();
+	for(i=0; i<BENCH_FIND_LOOPS; i++){
+		if(dom_find_node(dom, "missing")){
+			break;
+		}
+	}
+	bench_stop("find", mb*BENCH_FIND_LOOPS, nodes*BENCH_FIND_LOOPS);
+
+	if((null=fopen("/dev/null", "w"))){
+		bench_start();
+		dom_print(null, dom, 0);
+		fflush(null);
+		bench_stop("print", mb, nodes);
+		fclose(null);
+	}
+
+	bench_start();
+	dom_free(dom);
+	bench_stop("free", mb, nodes);
+
+	bench_start();
+	i=bench_expat(buffer, buffer_len);
+	bench_stop("expat", mb, i);
+
+	bench_start();
+	i=bench_reader(buffer, buffer_len);
+	bench_stop("reader", mb, i);
+
+	bench_start();
+	bench_tree_json(buffer, buffer_len);
+	bench_stop("tree2j", mb, nodes);
+
+	bench_start();
+	bench_json(buffer, buffer_len);
+	bench_stop("json", mb, nodes);
+
+	for(i=0; i<BENCH_COUNTERS; i++){
+		if(counters[i].fd !=-1){
+			close(counters[i].fd);
+		}
+	}
+	free(buffer);
+	return 0;
+}
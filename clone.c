@@ -0,0 +1,173 @@
+/*
+ * Copyright (c) 2011 Sergey Kolotsey.
+ * This file if part of expat-dom library.
+ * See the file COPYING for copying permission.
+ *
+ * This file defines functions that clone DOM trees. Clones share names,
+ * attributes and data with the source tree, only the nodes are copied.
+ */
+
+#include "expat-config.h"
+
+#ifdef STDC_HEADERS
+# include <stdlib.h>
+# include <stddef.h>
+#else
+# ifdef HAVE_STDLIB_H
+#  include <stdlib.h>
+# endif
+#endif
+#ifdef HAVE_STRING_H
+# if !defined STDC_HEADERS && defined HAVE_MEMORY_H
+#  include <memory.h>
+# endif
+# include <string.h>
+#endif
+#include <errno.h>
+#include "expat-dom-private.h"
+#ifdef DOM_MMAP
+#include <sys/mman.h>
+#endif
+
+
+
+int dom_storage_holds(const dom_storage_t *s, const void *ptr){
+	if( !ptr){
+		return 0;
+	}
+	while(s){
+		if(s->type==DOM_STORAGE_NODE){
+			if(ptr==s->name || ptr==s->attr || ptr==s->data){
+				return 1;
+			}
+		}else{
+			if((const char *)ptr>=s->block && (const char *)ptr<s->block+s->block_len){
+				return 1;
+			}
+		}
+		s=s->parent;
+	}
+	return 0;
+}
+
+dom_storage_t *dom_storage_ref(dom_storage_t *s){
+	__atomic_add_fetch(&s->refs, 1, __ATOMIC_RELAXED);
+	return s;
+}
+
+void dom_storage_release(dom_storage_t *s){
+	dom_storage_t *parent;
+	size_t i;
+
+	while(s && 0==__atomic_sub_fetch(&s->refs, 1, __ATOMIC_ACQ_REL)){
+		for(i=0; i<s->interned_count; i++){
+			dom_ns_release(s->interned[i]);
+		}
+		if(s->type==DOM_STORAGE_NODE){
+			if(s->name)
+				free(s->name);
+			if(s->data)
+				free(s->data);
+			dom_attr_free(s->attr);
+		}else if(s->type==DOM_STORAGE_BLOCK){
+			free(s->block);
+#ifdef DOM_MMAP
+		}else if(s->type==DOM_STORAGE_MMAP){
+			munmap(s->block, s->block_len);
+#endif
+		}
+		parent=s->parent;
+		free(s);
+		s=parent;
+	}
+}
+
+dom_storage_t *dom_storage_share(dom_t *node){
+	dom_storage_t *s;
+	dom_storage_t *temp;
+
+	while(1){
+		s=__atomic_load_n(&node->storage, __ATOMIC_ACQUIRE);
+		if(( !node->name || dom_storage_holds(s, node->name))
+				&& ( !node->attr || dom_storage_holds(s, node->attr))
+				&& ( !node->data || dom_storage_holds(s, node->data))){
+			return s? dom_storage_ref(s) : NULL;
+		}
+		if(NULL==(temp=calloc(1, sizeof(dom_storage_t)+3*sizeof(const char *)))){
+			return NULL;
+		}
+		//one reference is kept by the node, another one is for the caller
+		temp->refs=2;
+		temp->type=DOM_STORAGE_NODE;
+		temp->name=dom_storage_holds(s, node->name)? NULL : node->name;
+		temp->attr=dom_storage_holds(s, node->attr)? NULL : node->attr;
+		temp->data=dom_storage_holds(s, node->data)? NULL : node->data;
+		//interned parts of the name belong to the name
+		if(temp->name){
+			temp->interned=(const char **)(temp+1);
+			temp->interned[0]=node->ns;
+			temp->interned[1]=node->local_name;
+			temp->interned[2]=node->prefix;
+			temp->interned_count=3;
+		}
+		//reference of the node to its old storage is moved to the new one
+		temp->parent=s;
+		if(__atomic_compare_exchange_n(&node->storage, &s, temp, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)){
+			return temp;
+		}
+		free(temp);
+	}
+}
+
+static dom_t *dom_clone_node(dom_t *src, dom_t *parent){
+	dom_t *clone;
+	dom_t *child;
+	dom_t *tail;
+	dom_t *temp;
+
+	if(NULL==(clone=malloc(sizeof(dom_t)))){
+		return NULL;
+	}
+	*clone=*src;
+	clone->parent=parent;
+	clone->child=NULL;
+	clone->next=NULL;
+	clone->storage=dom_storage_share(src);
+	//children of an alias are copied, so the clone owns them
+	clone->alias=NULL;
+	clone->index=NULL;
+	clone->skip=NULL;
+	if( !clone->storage && (src->name || src->attr || src->data)){
+		free(clone);
+		return NULL;
+	}
+
+	tail=NULL;
+	for(child=src->child; child; child=child->next){
+		if(NULL==(temp=dom_clone_node(child, clone))){
+			dom_free(clone);
+			return NULL;
+		}
+		if(tail){
+			tail->next=temp;
+		}else{
+			clone->child=temp;
+		}
+		tail=temp;
+	}
+	clone->last=tail;
+	return clone;
+}
+
+dom_t *dom_clone(dom_t *dom){
+	dom_t *clone;
+
+	if( !dom){
+		errno=EINVAL;
+		return NULL;
+	}
+	if(NULL==(clone=dom_clone_node(dom, NULL))){
+		errno=ENOMEM;
+	}
+	return clone;
+}
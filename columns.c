@@ -0,0 +1,250 @@
+/*
+ * Copyright (c) 2011 Sergey Kolotsey.
+ * This file if part of expat-dom library.
+ * See the file COPYING for copying permission.
+ *
+ * This file defines extraction of repeated records of a DOM tree into
+ * column arrays.
+ */
+
+#include "expat-config.h"
+
+#ifdef STDC_HEADERS
+# include <stdlib.h>
+# include <stddef.h>
+#else
+# ifdef HAVE_STDLIB_H
+#  include <stdlib.h>
+# endif
+#endif
+#ifdef HAVE_STRING_H
+# if !defined STDC_HEADERS && defined HAVE_MEMORY_H
+#  include <memory.h>
+# endif
+# include <string.h>
+#endif
+#ifdef HAVE_STRINGS_H
+# include <strings.h>
+#endif
+#include <errno.h>
+#include "expat-dom-private.h"
+
+
+
+//initial number of rows the columns are allocated for
+#define DOM_COLUMN_ROWS 64
+
+typedef struct{
+	const dom_column_spec_t *specs;
+	dom_column_t *columns;
+	int count;
+	//number of rows the arrays are allocated for
+	int rows;
+	//size of string data buffers
+	size_t *data_size;
+}dom_columns_t;
+
+
+
+/*
+ * Returns the value of the column in the record or NULL if the value is
+ * missing.
+ */
+static const char *dom_column_value(const dom_column_spec_t *spec, dom_t *record, size_t *len){
+	const char *val;
+	dom_t *node;
+
+	if(spec->attr){
+		if((val=dom_find_attr(record->attr, spec->attr))){
+			*len=strlen(val);
+		}
+		return val;
+	}
+	node=record;
+	if(spec->child){
+		for(node=record->child; node; node=node->next){
+			if(0==strcasecmp(node->name, spec->child)){
+				break;
+			}
+		}
+		if( !node){
+			return NULL;
+		}
+	}
+	if(node->user_data){
+		*len=node->user_data_len;
+		return node->user_data;
+	}
+	*len=node->data_len;
+	return node->data? node->data : "";
+}
+
+static int dom_columns_grow(dom_columns_t *ctx){
+	dom_column_t *column;
+	void *temp;
+	int rows=ctx->rows? ctx->rows*2 : DOM_COLUMN_ROWS;
+	int i;
+
+	for(i=0; i<ctx->count; i++){
+		column=&ctx->columns[i];
+		if(NULL==(temp=realloc(column->validity, rows/8))){
+			return ENOMEM;
+		}
+		column->validity=temp;
+		memset(column->validity+ctx->rows/8, 0, (rows-ctx->rows)/8);
+		if(column->type==DOM_COLUMN_STRING){
+			temp=realloc(column->offsets, (rows+1)*sizeof(int32_t));
+		}else{
+			temp=realloc(column->values, rows*(column->type==DOM_COLUMN_INT64? sizeof(int64_t) : sizeof(double)));
+		}
+		if( !temp){
+			return ENOMEM;
+		}
+		if(column->type==DOM_COLUMN_STRING){
+			column->offsets=temp;
+			column->offsets[0]=0;
+		}else{
+			column->values=temp;
+		}
+	}
+	ctx->rows=rows;
+	return 0;
+}
+
+static int dom_columns_add(dom_columns_t *ctx, dom_t *record){
+	const dom_column_spec_t *spec;
+	dom_column_t *column;
+	const char *val;
+	char *temp;
+	int row;
+	size_t len;
+	size_t size;
+	int ret;
+	int i;
+
+	if(ctx->columns[0].length==ctx->rows && (ret=dom_columns_grow(ctx))){
+		return ret;
+	}
+	for(i=0; i<ctx->count; i++){
+		spec=&ctx->specs[i];
+		column=&ctx->columns[i];
+		row=column->length++;
+		val=dom_column_value(spec, record, &len);
+		ret=val? 0 : ENOENT;
+
+		if(column->type==DOM_COLUMN_INT64){
+			((int64_t *)column->values)[row]=0;
+			if( !ret){
+				ret=dom_to_int64(val, len, (int64_t *)column->values+row);
+			}
+		}else if(column->type==DOM_COLUMN_DOUBLE){
+			((double *)column->values)[row]=0;
+			if( !ret && (ret=dom_to_double(val, len, (double *)column->values+row))==ERANGE){
+				ret=0;
+			}
+		}else{
+			if(ret){
+				len=0;
+			}
+			//offsets of Arrow strings are 32-bit
+			if(len>(size_t)(INT32_MAX-column->offsets[row])){
+				return E2BIG;
+			}
+			size=column->offsets[row]+len;
+			if(size>ctx->data_size[i]){
+				size=size>2*ctx->data_size[i]? size : 2*ctx->data_size[i];
+				if(NULL==(temp=realloc(column->data, size))){
+					return ENOMEM;
+				}
+				column->data=temp;
+				ctx->data_size[i]=size;
+			}
+			if(len){
+				memcpy(column->data+column->offsets[row], val, len);
+			}
+			column->offsets[row+1]=column->offsets[row]+len;
+		}
+		if(ret==ENOMEM){
+			return ret;
+		}else if(ret){
+			column->null_count++;
+		}else{
+			column->validity[row/8]|=1<<(row%8);
+		}
+	}
+	return 0;
+}
+
+/*
+ * Calls dom_columns_add() for every descendant of node that matches path.
+ */
+static int dom_columns_walk(dom_columns_t *ctx, dom_t *node, const char *path){
+	const char *end;
+	dom_t *child;
+	int len;
+	int ret;
+
+	if( !(end=strchr(path, '/'))){
+		end=path+strlen(path);
+	}
+	len=end-path;
+	for(child=node->child; child; child=child->next){
+		if(0 !=strncasecmp(child->name, path, len) || child->name[len]){
+			continue;
+		}
+		if(*end){
+			ret=dom_columns_walk(ctx, child, end+1);
+		}else{
+			ret=dom_columns_add(ctx, child);
+		}
+		if(ret){
+			return ret;
+		}
+	}
+	return 0;
+}
+
+void dom_columns_free(dom_column_t *columns, int count){
+	int i;
+
+	for(i=0; columns && i<count; i++){
+		free(columns[i].validity);
+		free(columns[i].values);
+		free(columns[i].offsets);
+		free(columns[i].data);
+		memset(&columns[i], 0, sizeof(dom_column_t));
+	}
+}
+
+int dom_extract_columns(dom_t *root, const char *record_path, const dom_column_spec_t *specs, int count,
+		dom_column_t *columns){
+	dom_columns_t ctx;
+	int ret;
+	int i;
+
+	if( !root || !record_path || !*record_path || !specs || count<=0 || !columns){
+		return EINVAL;
+	}
+	for(i=0; i<count; i++){
+		if(specs[i].type<DOM_COLUMN_INT64 || specs[i].type>DOM_COLUMN_STRING
+				|| (specs[i].attr && specs[i].child)){
+			return EINVAL;
+		}
+	}
+	memset(columns, 0, count*sizeof(dom_column_t));
+	for(i=0; i<count; i++){
+		columns[i].type=specs[i].type;
+	}
+	memset(&ctx, 0, sizeof(ctx));
+	ctx.specs=specs;
+	ctx.columns=columns;
+	ctx.count=count;
+	if(NULL==(ctx.data_size=calloc(count, sizeof(size_t)))){
+		return ENOMEM;
+	}
+	if((ret=dom_columns_grow(&ctx)) || (ret=dom_columns_walk(&ctx, root, record_path))){
+		dom_columns_free(columns, count);
+	}
+	free(ctx.data_size);
+	return ret;
+}
@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2011 Sergey Kolotsey.
+ * This file if part of expat-dom library.
+ * See the file COPYING for copying permission.
+ *
+ * This file defines dom_compact() that moves a tree into one contiguous block
+ * of memory.
+ */
+
+#include "expat-config.h"
+
+#ifdef STDC_HEADERS
+# include <stdlib.h>
+# include <stddef.h>
+#else
+# ifdef HAVE_STDLIB_H
+#  include <stdlib.h>
+# endif
+#endif
+#ifdef HAVE_STRING_H
+# if !defined STDC_HEADERS && defined HAVE_MEMORY_H
+#  include <memory.h>
+# endif
+# include <string.h>
+#endif
+#include <errno.h>
+#include "expat-dom-private.h"
+
+
+
+//bookkeeping overhead of a typical malloc() per allocation
+#define DOM_MALLOC_OVERHEAD (2*sizeof(size_t))
+
+typedef struct{
+	//number of nodes and attributes, size of strings
+	int nodes;
+	int attrs;
+	long chars;
+	//memory used by the tree before compaction
+	long bytes;
+
+	dom_t *node;
+	dom_attr_t *attr;
+	char *str;
+	dom_storage_t *storage;
+}dom_compact_t;
+
+//interned strings of a node or an attribute: namespace, local name and prefix
+#define DOM_COMPACT_INTERNED 3
+
+
+
+/*
+ * Returns text of the node that is kept by dom_compact().
+ */
+static const char *dom_compact_text(const dom_t *node, size_t *len){
+	if(node->user_data){
+		*len=node->user_data_len;
+		return node->user_data;
+	}
+	*len=node->data_len;
+	return node->data;
+}
+
+static void dom_compact_count(dom_compact_t *ctx, const dom_t *dom){
+	const dom_attr_t *attr;
+	size_t len;
+
+	for(; dom; dom=dom->next){
+		ctx->nodes++;
+		ctx->chars+=strlen(dom->name)+1;
+		dom_compact_text(dom, &len);
+		ctx->chars+=len;
+		ctx->bytes+=sizeof(dom_t)+strlen(dom->name)+1+2*DOM_MALLOC_OVERHEAD;
+		if(dom->data){
+			ctx->bytes+=dom->data_len+DOM_MALLOC_OVERHEAD;
+		}
+		for(attr=dom->attr; attr; attr=attr->next){
+			ctx->attrs++;
+			ctx->chars+=strlen(attr->var)+strlen(attr->val)+2;
+			ctx->bytes+=sizeof(dom_attr_t)+strlen(attr->var)+strlen(attr->val)+2+3*DOM_MALLOC_OVERHEAD;
+		}
+		dom_compact_count(ctx, dom->child);
+	}
+}
+
+/*
+ * Takes a reference of the interned string for the block.
+ */
+static const char *dom_compact_interned(dom_compact_t *ctx, const char *str){
+	if(str){
+		ctx->storage->interned[ctx->storage->interned_count++]=dom_ns_ref(str);
+	}
+	return str;
+}
+
+static char *dom_compact_str(dom_compact_t *ctx, const char *str, size_t len){
+	char *ret=ctx->str;
+
+	memcpy(ret, str, len);
+	ctx->str+=len;
+	return ret;
+}
+
+/*
+ * Copies list of siblings src and their descendants into the block in
+ * preorder. Returns the copy of the first sibling.
+ */
+static dom_t *dom_compact_copy(dom_compact_t *ctx, const dom_t *src, dom_t *parent){
+	dom_t *head=NULL;
+	dom_t *prev=NULL;
+	dom_t *node;
+	const dom_attr_t *attr;
+	dom_attr_t *tail;
+	const char *text;
+	size_t len;
+
+	for(; src; src=src->next){
+		node=ctx->node++;
+		memset(node, 0, sizeof(dom_t));
+		node->name=dom_compact_str(ctx, src->name, strlen(src->name)+1);
+		node->ns=dom_compact_interned(ctx, src->ns);
+		node->local_name=dom_compact_interned(ctx, src->local_name);
+		node->prefix=dom_compact_interned(ctx, src->prefix);
+		tail=NULL;
+		for(attr=src->attr; attr; attr=attr->next){
+			if(tail){
+				tail->next=ctx->attr;
+			}else{
+				node->attr=ctx->attr;
+			}
+			tail=ctx->attr++;
+			tail->next=NULL;
+			tail->var=dom_compact_str(ctx, attr->var, strlen(attr->var)+1);
+			tail->val=dom_compact_str(ctx, attr->val, strlen(attr->val)+1);
+			tail->ns=dom_compact_interned(ctx, attr->ns);
+			tail->local_name=dom_compact_interned(ctx, attr->local_name);
+			tail->prefix=dom_compact_interned(ctx, attr->prefix);
+		}
+		if((text=dom_compact_text(src, &len)) && len){
+			node->data=node->user_data=dom_compact_str(ctx, text, len);
+			node->data_len=node->user_data_len=len;
+		}
+		node->closed=src->closed;
+		//the hash is not copied, it changes if text outside of CDATA is dropped
+		node->parent=parent;
+		node->storage=ctx->storage;
+		node->child=dom_compact_copy(ctx, src->child, node);
+		if(prev){
+			prev->next=node;
+		}else{
+			head=node;
+		}
+		prev=node;
+		if(parent){
+			parent->last=node;
+			parent->child_count++;
+		}
+	}
+	return head;
+}
+
+dom_t *dom_compact(dom_t *dom, long *bytes_before, long *bytes_after){
+	dom_compact_t ctx;
+	dom_t *ret;
+	long len;
+
+	if( !dom || dom->parent){
+		errno=EINVAL;
+		return NULL;
+	}
+	memset(&ctx, 0, sizeof(ctx));
+	dom_compact_count(&ctx, dom);
+	len=ctx.nodes*sizeof(dom_t)+ctx.attrs*sizeof(dom_attr_t)
+		+(ctx.nodes+ctx.attrs)*DOM_COMPACT_INTERNED*sizeof(const char *)+ctx.chars;
+
+	if(NULL==(ctx.storage=calloc(1, sizeof(dom_storage_t)))){
+		errno=ENOMEM;
+		return NULL;
+	}
+	if(NULL==(ctx.storage->block=malloc(len))){
+		free(ctx.storage);
+		errno=ENOMEM;
+		return NULL;
+	}
+	ctx.storage->type=DOM_STORAGE_BLOCK;
+	ctx.storage->block_len=len;
+	ctx.storage->refs=ctx.nodes;
+	//nodes go first, attributes, interned strings and strings need weaker
+	//alignment
+	ctx.node=(dom_t *)ctx.storage->block;
+	ctx.attr=(dom_attr_t *)(ctx.node+ctx.nodes);
+	ctx.storage->interned=(const char **)(ctx.attr+ctx.attrs);
+	ctx.str=(char *)(ctx.storage->interned+(ctx.nodes+ctx.attrs)*DOM_COMPACT_INTERNED);
+
+	ret=dom_compact_copy(&ctx, dom, NULL);
+	dom_free(dom);
+	if(bytes_before){
+		*bytes_before=ctx.bytes;
+	}
+	if(bytes_after){
+		*bytes_after=len+sizeof(dom_storage_t)+2*DOM_MALLOC_OVERHEAD;
+	}
+	return ret;
+}
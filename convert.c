@@ -0,0 +1,359 @@
+/*
+ * Copyright (c) 2011 Sergey Kolotsey.
+ * This file if part of expat-dom library.
+ * See the file COPYING for copying permission.
+ *
+ * This file defines functions that convert data and attribute values of
+ * nodes into numbers and booleans without copying them.
+ */
+
+//strtod_l() is a GNU extension in glibc
+#ifndef _GNU_SOURCE
+# define _GNU_SOURCE
+#endif
+#include "expat-config.h"
+
+#ifdef STDC_HEADERS
+# include <stdlib.h>
+# include <stddef.h>
+#else
+# ifdef HAVE_STDLIB_H
+#  include <stdlib.h>
+# endif
+#endif
+#ifdef HAVE_STRING_H
+# if !defined STDC_HEADERS && defined HAVE_MEMORY_H
+#  include <memory.h>
+# endif
+# include <string.h>
+#endif
+#include <errno.h>
+#include <float.h>
+#ifdef HAVE_LOCALE_H
+# include <locale.h>
+#endif
+#ifdef HAVE_XLOCALE_H
+# include <xlocale.h>
+#endif
+#include "expat-dom-private.h"
+
+#if defined HAVE_NEWLOCALE && defined HAVE_STRTOD_L
+# define DOM_STRTOD_L 1
+#endif
+
+
+
+#define DOM_DIGIT(a) ((a)>='0' && (a)<='9')
+
+//numbers that are longer are copied to heap before they are passed to strtod()
+#define DOM_NUMBER_LEN 64
+
+//the largest integer such that all smaller integers are exact doubles
+#define DOM_MAX_EXACT 9007199254740992ULL
+
+/*
+ * Fast path of the conversion is exact only if double arithmetic is not
+ * carried out in extended precision.
+ */
+#if defined FLT_EVAL_METHOD && FLT_EVAL_METHOD>=0 && FLT_EVAL_METHOD<2
+#define DOM_FAST_DOUBLE
+static const double dom_pow10[]={
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+#endif
+
+
+
+/*
+ * Removes white space around the value. Returns 0 if nothing is left.
+ */
+static int dom_trim(const char **str, size_t *len){
+	while(*len && DOM_SPACE(**str)){
+		(*str)++;
+		(*len)--;
+	}
+	while(*len && DOM_SPACE((*str)[*len-1])){
+		(*len)--;
+	}
+	return *len !=0;
+}
+
+/*
+ * Returns text of the node: field user_data, which is already trimmed, or
+ * field data.
+ */
+static const char *dom_text(const dom_t *node, size_t *len){
+	if(node->user_data){
+		*len=node->user_data_len;
+		return node->user_data;
+	}
+	*len=node->data_len;
+	return node->data;
+}
+
+int dom_to_int64(const char *str, size_t len, int64_t *value){
+	uint64_t limit=INT64_MAX;
+	uint64_t v=0;
+	int negative=0;
+	int digit;
+
+	if( !str || !dom_trim(&str, &len)){
+		return EINVAL;
+	}
+	if(*str=='-' || *str=='+'){
+		negative=(*str=='-');
+		limit+=negative;
+		str++;
+		len--;
+	}
+	if( !len){
+		return EINVAL;
+	}
+	for(; len; str++, len--){
+		if( !DOM_DIGIT(*str)){
+			return EINVAL;
+		}
+		digit=*str-'0';
+		if(v>(limit-digit)/10){
+			return ERANGE;
+		}
+		v=v*10+digit;
+	}
+	*value=negative? (int64_t)(0-v) : (int64_t)v;
+	return 0;
+}
+
+#ifdef DOM_STRTOD_L
+/*
+ * Returns the "C" locale, created on the first call and kept until exit, or
+ * 0 if there is not enough memory.
+ */
+static locale_t dom_c_locale(void){
+	static locale_t c_locale;
+	locale_t expected=(locale_t)0;
+	locale_t temp;
+
+	if((temp=__atomic_load_n(&c_locale, __ATOMIC_ACQUIRE))){
+		return temp;
+	}
+	if( !(temp=newlocale(LC_ALL_MASK, "C", (locale_t)0))){
+		return (locale_t)0;
+	}
+	if( !__atomic_compare_exchange_n(&c_locale, &expected, temp, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)){
+		//another thread created it first
+		freelocale(temp);
+		temp=expected;
+	}
+	return temp;
+}
+#endif
+
+/*
+ * Converts the number with strtod() in the "C" locale, so that the decimal
+ * point is always '.'. The number is copied, since it is not terminated with
+ * NULL character.
+ */
+static int dom_to_double_slow(const char *str, size_t len, double *value){
+	char buffer[DOM_NUMBER_LEN];
+	char *temp=buffer;
+	char *end;
+	double v;
+	int ret=0;
+#ifdef DOM_STRTOD_L
+	locale_t c_locale;
+
+	if( !(c_locale=dom_c_locale())){
+		return ENOMEM;
+	}
+#elif defined HAVE_LOCALE_H
+	char point=*localeconv()->decimal_point;
+	char *p;
+#endif
+
+	if(len>=DOM_NUMBER_LEN && NULL==(temp=malloc(len+1))){
+		return ENOMEM;
+	}
+	memcpy(temp, str, len);
+	temp[len]=0;
+	errno=0;
+#ifdef DOM_STRTOD_L
+	v=strtod_l(temp, &end, c_locale);
+#else
+# ifdef HAVE_LOCALE_H
+	//swap '.' and the decimal point of the locale, so that the point of the
+	//locale is rejected by strtod() and '.' is accepted
+	if(point && point !='.'){
+		for(p=temp; *p; p++){
+			if(*p==point){
+				*p='.';
+			}else if(*p=='.'){
+				*p=point;
+			}
+		}
+	}
+# endif
+	v=strtod(temp, &end);
+#endif
+	if(end !=temp+len || end==temp){
+		ret=EINVAL;
+	}else{
+		*value=v;
+		if(errno==ERANGE){
+			ret=ERANGE;
+		}
+	}
+	if(temp !=buffer){
+		free(temp);
+	}
+	return ret;
+}
+
+int dom_to_double(const char *str, size_t len, double *value){
+#ifdef DOM_FAST_DOUBLE
+	const char *p;
+	const char *end;
+	uint64_t mantissa=0;
+	int digits=0;
+	int seen=0;
+	int exponent=0;
+	int exp_value=0;
+	int exp_negative=0;
+	int negative=0;
+	double v;
+#endif
+
+	if( !str || !dom_trim(&str, &len)){
+		return EINVAL;
+	}
+#ifdef DOM_FAST_DOUBLE
+	//Clinger's fast path: mantissa and power of ten are both exact doubles
+	p=str;
+	end=str+len;
+	if(*p=='-' || *p=='+'){
+		negative=(*p=='-');
+		p++;
+	}
+	for(; p<end && DOM_DIGIT(*p); p++, seen++){
+		if(digits<19){
+			mantissa=mantissa*10+(*p-'0');
+			digits+=(mantissa !=0);
+		}else{
+			return dom_to_double_slow(str, len, value);
+		}
+	}
+	if(p<end && *p=='.'){
+		for(p++; p<end && DOM_DIGIT(*p); p++, seen++){
+			if(digits<19){
+				mantissa=mantissa*10+(*p-'0');
+				digits+=(mantissa !=0);
+				exponent--;
+			}else{
+				return dom_to_double_slow(str, len, value);
+			}
+		}
+	}
+	if(p<end && (*p=='e' || *p=='E')){
+		p++;
+		if(p<end && (*p=='-' || *p=='+')){
+			exp_negative=(*p=='-');
+			p++;
+		}
+		if(p==end || !seen){
+			return EINVAL;
+		}
+		for(; p<end && DOM_DIGIT(*p); p++){
+			if(exp_value>=10000){
+				return dom_to_double_slow(str, len, value);
+			}
+			exp_value=exp_value*10+(*p-'0');
+		}
+		exponent+=exp_negative? -exp_value : exp_value;
+	}
+	if(p==end && seen && mantissa<=DOM_MAX_EXACT && exponent>=-22 && exponent<=22){
+		v=(double)mantissa;
+		v=(exponent<0)? v/dom_pow10[-exponent] : v*dom_pow10[exponent];
+		*value=negative? -v : v;
+		return 0;
+	}
+#endif
+	//long mantissa, large exponent, INF, NaN, hexadecimal or invalid number
+	return dom_to_double_slow(str, len, value);
+}
+
+static int dom_to_bool(const char *str, size_t len, int *value){
+	if( !str || !dom_trim(&str, &len)){
+		return EINVAL;
+	}
+	if((len==1 && *str=='1') || (len==4 && 0==memcmp(str, "true", 4))){
+		*value=1;
+	}else if((len==1 && *str=='0') || (len==5 && 0==memcmp(str, "false", 5))){
+		*value=0;
+	}else{
+		return EINVAL;
+	}
+	return 0;
+}
+
+int dom_attr_int64(dom_attr_t *attr, const char *var, int64_t *value){
+	const char *val;
+
+	if( !var || !value){
+		return EINVAL;
+	}
+	if( !(val=dom_find_attr(attr, var))){
+		return ENOENT;
+	}
+	return dom_to_int64(val, strlen(val), value);
+}
+
+int dom_attr_double(dom_attr_t *attr, const char *var, double *value){
+	const char *val;
+
+	if( !var || !value){
+		return EINVAL;
+	}
+	if( !(val=dom_find_attr(attr, var))){
+		return ENOENT;
+	}
+	return dom_to_double(val, strlen(val), value);
+}
+
+int dom_text_int64(const dom_t *node, int64_t *value){
+	const char *text;
+	size_t len;
+
+	if( !node || !value){
+		return EINVAL;
+	}
+	if( !(text=dom_text(node, &len))){
+		return ENOENT;
+	}
+	return dom_to_int64(text, len, value);
+}
+
+int dom_text_double(const dom_t *node, double *value){
+	const char *text;
+	size_t len;
+
+	if( !node || !value){
+		return EINVAL;
+	}
+	if( !(text=dom_text(node, &len))){
+		return ENOENT;
+	}
+	return dom_to_double(text, len, value);
+}
+
+int dom_text_bool(const dom_t *node, int *value){
+	const char *text;
+	size_t len;
+
+	if( !node || !value){
+		return EINVAL;
+	}
+	if( !(text=dom_text(node, &len))){
+		return ENOENT;
+	}
+	return dom_to_bool(text, len, value);
+}
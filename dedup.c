@@ -0,0 +1,252 @@
+/*
+ * Copyright (c) 2011 Sergey Kolotsey.
+ * This file if part of expat-dom library.
+ * See the file COPYING for copying permission.
+ *
+ * This file defines deduplication of identical subtrees at parse time. Every
+ * closed element is hashed together with its subtree and looked up among the
+ * subtrees closed before it; a duplicate is turned into an alias that shares
+ * name, attributes, data and children with the first copy.
+ */
+
+#include "expat-config.h"
+
+#ifdef STDC_HEADERS
+# include <stdlib.h>
+# include <stddef.h>
+#else
+# ifdef HAVE_STDLIB_H
+#  include <stdlib.h>
+# endif
+#endif
+#ifdef HAVE_STRING_H
+# if !defined STDC_HEADERS && defined HAVE_MEMORY_H
+#  include <memory.h>
+# endif
+# include <string.h>
+#endif
+#include <errno.h>
+#include "expat-dom-private.h"
+
+
+
+//initial number of slots of the table, always a power of 2
+#define DOM_DEDUP_SLOTS 1024
+//initial depth of the stack
+#define DOM_DEDUP_DEPTH 32
+
+typedef struct{
+	uint64_t hash;
+	dom_t *node;
+}dom_dedup_slot_t;
+
+struct dom_dedup_s{
+	//open addressing table of subtrees that are not aliases
+	dom_dedup_slot_t *slots;
+	size_t size;
+	size_t count;
+	//set when the table could not grow, no more subtrees are shared then
+	int full;
+
+	//hash of the children closed so far, one per open element
+	uint64_t *stack;
+	int depth;
+	int stack_size;
+};
+
+
+
+static uint64_t dom_fnv(uint64_t hash, const void *data, size_t len){
+	const unsigned char *p=data;
+
+	while(len--){
+		hash=(hash^*p++)*DOM_FNV_PRIME;
+	}
+	return hash;
+}
+
+/*
+ * Returns hash of the node itself, children is the combined hash of its
+ * children.
+ */
+static uint64_t dom_dedup_hash(const dom_t *node, uint64_t children){
+	const dom_attr_t *attr;
+	uint64_t hash=DOM_FNV_OFFSET;
+	long offset;
+
+	hash=dom_fnv(hash, node->name, strlen(node->name)+1);
+	for(attr=node->attr; attr; attr=attr->next){
+		hash=dom_fnv(hash, attr->var, strlen(attr->var)+1);
+		hash=dom_fnv(hash, attr->val, strlen(attr->val)+1);
+	}
+	if(node->data_len){
+		hash=dom_fnv(hash, node->data, node->data_len);
+	}
+	offset=node->user_data? node->user_data-node->data : -1;
+	hash=dom_fnv(hash, &offset, sizeof(offset));
+	hash=dom_fnv(hash, &node->user_data_len, sizeof(node->user_data_len));
+	return dom_fnv(hash, &children, sizeof(children));
+}
+
+static int dom_dedup_equal(const dom_t *a, const dom_t *b){
+	const dom_attr_t *attr_a;
+	const dom_attr_t *attr_b;
+
+	a=a->alias? a->alias : a;
+	b=b->alias? b->alias : b;
+	if(a==b){
+		return 1;
+	}
+	if(a->ns !=b->ns || a->prefix !=b->prefix || a->data_len !=b->data_len
+			|| a->user_data_len !=b->user_data_len || a->child_count !=b->child_count
+			|| (a->user_data? a->user_data-a->data : -1) !=(b->user_data? b->user_data-b->data : -1)
+			|| strcmp(a->name, b->name) || (a->data_len && memcmp(a->data, b->data, a->data_len))){
+		return 0;
+	}
+	for(attr_a=a->attr, attr_b=b->attr; attr_a && attr_b; attr_a=attr_a->next, attr_b=attr_b->next){
+		if(attr_a->ns !=attr_b->ns || attr_a->prefix !=attr_b->prefix
+				|| strcmp(attr_a->var, attr_b->var) || strcmp(attr_a->val, attr_b->val)){
+			return 0;
+		}
+	}
+	if(attr_a || attr_b){
+		return 0;
+	}
+	for(a=a->child, b=b->child; a && b; a=a->next, b=b->next){
+		if( !dom_dedup_equal(a, b)){
+			return 0;
+		}
+	}
+	return !a && !b;
+}
+
+/*
+ * Turns node into an alias of the earlier copy of its subtree. Nodes made by
+ * the parser own all their fields except data borrowed from the input. If
+ * there is not enough memory, the node is left as it is.
+ */
+static void dom_dedup_alias(dom_t *node, dom_t *copy){
+	dom_storage_t *storage;
+
+	if(NULL==(storage=dom_storage_share(copy))){
+		return;
+	}
+	dom_free(node->child);
+	free(node->name);
+	dom_ns_release(node->ns);
+	dom_ns_release(node->local_name);
+	dom_ns_release(node->prefix);
+	if( !dom_storage_holds(node->storage, node->data)){
+		free(node->data);
+	}
+	dom_attr_free(node->attr);
+	dom_storage_release(node->storage);
+
+	node->name=copy->name;
+	node->attr=copy->attr;
+	node->data=copy->data;
+	node->data_len=copy->data_len;
+	node->user_data=copy->user_data;
+	node->user_data_len=copy->user_data_len;
+	node->child=copy->child;
+	node->last=copy->last;
+	node->child_count=copy->child_count;
+	node->ns=copy->ns;
+	node->local_name=copy->local_name;
+	node->prefix=copy->prefix;
+	node->storage=storage;
+	node->alias=copy;
+}
+
+static int dom_dedup_grow(dom_dedup_t *d){
+	dom_dedup_slot_t *slots;
+	size_t size=d->size*2;
+	size_t i;
+	size_t j;
+
+	if(NULL==(slots=calloc(size, sizeof(dom_dedup_slot_t)))){
+		return ENOMEM;
+	}
+	for(i=0; i<d->size; i++){
+		if(d->slots[i].node){
+			for(j=d->slots[i].hash&(size-1); slots[j].node; j=(j+1)&(size-1));
+			slots[j]=d->slots[i];
+		}
+	}
+	free(d->slots);
+	d->slots=slots;
+	d->size=size;
+	return 0;
+}
+
+dom_dedup_t *dom_dedup_new(void){
+	dom_dedup_t *d;
+
+	if(NULL==(d=calloc(1, sizeof(dom_dedup_t)))){
+		return NULL;
+	}
+	d->size=DOM_DEDUP_SLOTS;
+	d->stack_size=DOM_DEDUP_DEPTH;
+	if(NULL==(d->slots=calloc(d->size, sizeof(dom_dedup_slot_t)))
+			|| NULL==(d->stack=malloc(d->stack_size*sizeof(uint64_t)))){
+		dom_dedup_free(d);
+		return NULL;
+	}
+	d->stack[0]=DOM_FNV_OFFSET;
+	return d;
+}
+
+void dom_dedup_free(dom_dedup_t *d){
+	if(d){
+		free(d->slots);
+		free(d->stack);
+		free(d);
+	}
+}
+
+int dom_dedup_open(dom_dedup_t *d){
+	uint64_t *temp;
+
+	if(d->depth+1==d->stack_size){
+		if(NULL==(temp=realloc(d->stack, 2*d->stack_size*sizeof(uint64_t)))){
+			return ENOMEM;
+		}
+		d->stack=temp;
+		d->stack_size*=2;
+	}
+	d->stack[++d->depth]=DOM_FNV_OFFSET;
+	return 0;
+}
+
+void dom_dedup_close(dom_dedup_t *d, dom_t *node){
+	uint64_t hash;
+	size_t i;
+
+	hash=dom_dedup_hash(node, d->stack[d->depth--]);
+	//order of the children matters
+	d->stack[d->depth]=(d->stack[d->depth]^hash)*DOM_FNV_PRIME;
+	//the root has nothing to share with
+	if( !node->parent || d->full){
+		return;
+	}
+	for(i=hash&(d->size-1); d->slots[i].node; i=(i+1)&(d->size-1)){
+		if(d->slots[i].hash==hash && dom_dedup_equal(d->slots[i].node, node)){
+			dom_dedup_alias(node, d->slots[i].node);
+			return;
+		}
+	}
+	/*
+	 * Once a subtree is not remembered, a later copy of it could be kept
+	 * while its parent becomes an alias and frees it, so sharing stops.
+	 */
+	if(2*(d->count+1)>d->size){
+		if(dom_dedup_grow(d)){
+			d->full=1;
+			return;
+		}
+		for(i=hash&(d->size-1); d->slots[i].node; i=(i+1)&(d->size-1));
+	}
+	d->slots[i].hash=hash;
+	d->slots[i].node=node;
+	d->count++;
+}
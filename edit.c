@@ -0,0 +1,263 @@
+/*
+ * Copyright (c) 2011 Sergey Kolotsey.
+ * This file if part of expat-dom library.
+ * See the file COPYING for copying permission.
+ *
+ * This file defines functions that build and change DOM trees.
+ */
+
+#include "expat-config.h"
+
+#ifdef STDC_HEADERS
+# include <stdlib.h>
+# include <stddef.h>
+#else
+# ifdef HAVE_STDLIB_H
+#  include <stdlib.h>
+# endif
+#endif
+#ifdef HAVE_STRING_H
+# if !defined STDC_HEADERS && defined HAVE_MEMORY_H
+#  include <memory.h>
+# endif
+# include <string.h>
+#endif
+#ifdef HAVE_STRINGS_H
+# include <strings.h>
+#endif
+#include <errno.h>
+#include "expat-dom-private.h"
+
+
+
+/*
+ * Returns last child of the node. The field last is recalculated if the
+ * children were linked into the tree manually.
+ */
+static dom_t *dom_last_child(dom_t *parent){
+	dom_t *temp;
+
+	if( !parent->last && parent->child){
+		parent->child_count=0;
+		for(temp=parent->child; temp; temp=temp->next){
+			parent->last=temp;
+			parent->child_count++;
+		}
+	}
+	return parent->last;
+}
+
+/*
+ * Returns 1 if child can be linked to parent: the child is not a part of a
+ * tree and is not an ancestor of parent.
+ */
+static int dom_can_link(dom_t *parent, dom_t *child){
+	if( !parent || !child || child->parent || child->next){
+		return 0;
+	}
+	return parent !=child && !dom_is_ancestor(child, parent);
+}
+
+dom_t *dom_new_element(const char *name){
+	dom_t *dom;
+
+	if( !name){
+		errno=EINVAL;
+		return NULL;
+	}
+	if(NULL==(dom=dom_node_new(name, NULL))){
+		errno=ENOMEM;
+		return NULL;
+	}
+	dom->closed=1;
+	return dom;
+}
+
+int dom_append_child(dom_t *parent, dom_t *child){
+	dom_t *last;
+
+	if( !dom_can_link(parent, child)){
+		return EINVAL;
+	}
+	if((last=dom_last_child(parent))){
+		last->next=child;
+	}else{
+		parent->child=child;
+	}
+	parent->last=child;
+	parent->child_count++;
+	child->parent=parent;
+	dom_hash_invalidate(parent);
+	dom_index_invalidate(parent);
+	return 0;
+}
+
+int dom_insert_before(dom_t *parent, dom_t *child, dom_t *ref){
+	dom_t *prev;
+
+	if( !ref){
+		return dom_append_child(parent, child);
+	}
+	if( !dom_can_link(parent, child) || ref->parent !=parent){
+		return EINVAL;
+	}
+	dom_last_child(parent);
+	if(parent->child==ref){
+		parent->child=child;
+	}else{
+		for(prev=parent->child; prev && prev->next !=ref; prev=prev->next);
+		if( !prev){
+			return EINVAL;
+		}
+		prev->next=child;
+	}
+	child->next=ref;
+	child->parent=parent;
+	parent->child_count++;
+	dom_hash_invalidate(parent);
+	dom_index_invalidate(parent);
+	return 0;
+}
+
+dom_t *dom_remove(dom_t *node){
+	dom_t *parent;
+	dom_t *prev;
+
+	if( !node || !(parent=node->parent)){
+		return node;
+	}
+	dom_last_child(parent);
+	if(parent->child==node){
+		prev=NULL;
+		parent->child=node->next;
+	}else{
+		for(prev=parent->child; prev && prev->next !=node; prev=prev->next);
+		if( !prev){
+			//the node is not among the children of its parent
+			errno=EINVAL;
+			return NULL;
+		}
+		prev->next=node->next;
+	}
+	if(parent->last==node){
+		parent->last=prev;
+	}
+	parent->child_count--;
+	dom_hash_invalidate(parent);
+	dom_index_invalidate(parent);
+	node->parent=NULL;
+	node->next=NULL;
+	return node;
+}
+
+/*
+ * Replaces the attribute list of the node with its copy if the list is
+ * shared with other trees.
+ */
+static int dom_own_attr(dom_t *node){
+	dom_attr_t *head=NULL;
+	dom_attr_t *tail=NULL;
+	dom_attr_t *attr;
+	dom_attr_t *temp;
+
+	if( !dom_storage_holds(node->storage, node->attr)){
+		return 0;
+	}
+	for(attr=node->attr; attr; attr=attr->next){
+		if(NULL==(temp=calloc(1, sizeof(dom_attr_t)))
+				|| NULL==(temp->var=strdup(attr->var))
+				|| NULL==(temp->val=strdup(attr->val))){
+			dom_attr_free(temp);
+			dom_attr_free(head);
+			return ENOMEM;
+		}
+		temp->ns=dom_ns_ref(attr->ns);
+		temp->local_name=dom_ns_ref(attr->local_name);
+		temp->prefix=dom_ns_ref(attr->prefix);
+		if(tail){
+			tail->next=temp;
+		}else{
+			head=temp;
+		}
+		tail=temp;
+	}
+	node->attr=head;
+	return 0;
+}
+
+int dom_set_attr(dom_t *node, const char *var, const char *val){
+	dom_attr_t *attr;
+	dom_attr_t *prev;
+	char *temp;
+	int ret;
+
+	if( !node || !var){
+		return EINVAL;
+	}
+	if((ret=dom_own_attr(node))){
+		return ret;
+	}
+	dom_hash_invalidate(node);
+	prev=NULL;
+	for(attr=node->attr; attr; attr=attr->next){
+		if(0==strcasecmp(var, attr->var)){
+			break;
+		}
+		prev=attr;
+	}
+	if( !val){
+		if(attr){
+			if(prev){
+				prev->next=attr->next;
+			}else{
+				node->attr=attr->next;
+			}
+			attr->next=NULL;
+			dom_attr_free(attr);
+		}
+		return 0;
+	}
+	if(NULL==(temp=strdup(val))){
+		return ENOMEM;
+	}
+	if(attr){
+		free(attr->val);
+		attr->val=temp;
+		return 0;
+	}
+	if(NULL==(attr=calloc(1, sizeof(dom_attr_t))) || NULL==(attr->var=strdup(var))){
+		free(attr);
+		free(temp);
+		return ENOMEM;
+	}
+	attr->val=temp;
+	if(prev){
+		prev->next=attr;
+	}else{
+		node->attr=attr;
+	}
+	return 0;
+}
+
+int dom_set_text(dom_t *node, const char *text, size_t text_len){
+	char *data=NULL;
+
+	if( !node){
+		return EINVAL;
+	}
+	if(text && text_len){
+		if(NULL==(data=malloc(text_len))){
+			return ENOMEM;
+		}
+		memcpy(data, text, text_len);
+	}else{
+		text_len=0;
+	}
+	if(node->data && !dom_storage_holds(node->storage, node->data)){
+		free(node->data);
+	}
+	dom_hash_invalidate(node);
+	node->data=node->user_data=data;
+	node->data_len=node->user_data_len=text_len;
+	return 0;
+}
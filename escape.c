@@ -60,8 +60,8 @@
  * "&quot;" -> "\""
  * "&amp;"  -> "&"
  */
-int unescape_xml_r( const char *input, int input_len, char *output){
-	int output_len=0;
+size_t unescape_xml_r( const char *input, size_t input_len, char *output){
+	size_t output_len=0;
 
 	while(input_len){
 		if(*input=='&'){
@@ -101,14 +101,37 @@ int unescape_xml_r( const char *input, int input_len, char *output){
 }
 
 #define MIN(a,b) ((a)<(b)?(a):(b))
+
+/*
+ * Characters that are converted to entities by escape_xml_r()
+ */
+static const unsigned char escaped[256]={
+	['<']=1, ['>']=1, ['\'']=1, ['"']=1, ['&']=1
+};
+
 /*
  * input and output must not be the same
  */
-int escape_xml_r( const char *input, int input_len, char *output, int output_max_len){
-	int output_len=0;
-	int l;
+size_t escape_xml_r( const char *input, size_t input_len, char *output, size_t output_max_len){
+	size_t output_len=0;
+	size_t run;
+	size_t l;
 
 	while(input_len){
+		//copy run of characters that need no conversion at once
+		for(run=0; run<input_len && !escaped[(unsigned char)input[run]]; run++);
+		if(run){
+			if(output_max_len>0){
+				l=MIN(run, output_max_len);
+				memcpy(output, input, l);
+				output+=l;
+				output_max_len-=l;
+			}
+			output_len+=run;
+			input+=run;
+			input_len-=run;
+			continue;
+		}
 		if(*input=='<'){
 			if(output_max_len>0){
 				l=MIN(LT_LEN, output_max_len);
@@ -170,11 +193,11 @@ int escape_xml_r( const char *input, int input_len, char *output, int output_max
 
 
 #define ESCAPE_TEMP_LEN 1024
-static int temp_len=0;
+static size_t temp_len=0;
 static char *temp=NULL;
 static char *empty="";
 char *unescape_xml( const char *input){
-	int len=strlen(input);
+	size_t len=strlen(input);
 	while(len+1>temp_len){
 		if((temp=realloc(temp, temp_len+ESCAPE_TEMP_LEN))){
 			temp_len+=ESCAPE_TEMP_LEN;
@@ -193,8 +216,8 @@ char *unescape_xml( const char *input){
 }
 
 char *escape_xml( const char *input){
-	int in_len;
-	int out_len;
+	size_t in_len;
+	size_t out_len;
 
 	in_len=strlen(input);
 
@@ -204,7 +227,7 @@ char *escape_xml( const char *input){
 		return temp;
 	}
 
-	int new_len=(out_len+1)/1024*1024+ESCAPE_TEMP_LEN;
+	size_t new_len=(out_len+1)/1024*1024+ESCAPE_TEMP_LEN;
 	if((temp=realloc(temp, new_len))){
 		temp_len=new_len;
 		out_len=escape_xml_r( input, in_len, temp, temp_len);
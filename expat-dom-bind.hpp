@@ -0,0 +1,382 @@
+/*
+ * Copyright (c) 2011 Sergey Kolotsey.
+ * This file if part of expat-dom library.
+ * See the file COPYING for copying permission.
+ */
+
+#ifndef __EXPAT_DOM_BIND_HPP_INCLUDED
+#define __EXPAT_DOM_BIND_HPP_INCLUDED
+
+#include <cstddef>
+#include <climits>
+#include <cstring>
+#include <exception>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <strings.h>
+#include <expat.h>
+#include "expat-dom.hpp"
+
+/**
+ * @file expat-dom-bind.hpp
+ * Header-only binding of XML records to C++ structures
+ * @ingroup expat-dom
+ * @{
+ */
+
+/**
+ * @brief Parsing of records directly into C++ structures.
+ *
+ * A schema describes at compile time which attributes of a record element
+ * and which of its child elements go to which members of a structure. The
+ * parser installs expat handlers that write matched values straight into
+ * an instance of the structure and skip everything else, so no DOM tree is
+ * built. Names are compared case-insensitively, as dom_find_node() does,
+ * and values are converted as dom_text_int64(), dom_text_double() and
+ * dom_text_bool() do.
+ *
+ * Supported member types are integers, @c float, @c double, @c bool,
+ * @c std::string and @c std::optional of them. A member whose value is
+ * missing or can not be converted keeps its default value; an optional
+ * member stays empty.
+ *
+ * @par Example:
+ * @code
+#include "expat-dom-bind.hpp"
+
+struct item{
+	int64_t id;
+	std::string name;
+	double price;
+};
+
+namespace bind=expat_dom::bind;
+constexpr auto item_schema=bind::record<item>( "item",
+	bind::attr( "id", &item::id),
+	bind::child( "name", &item::name),
+	bind::child( "price", &item::price));
+
+bind::parse( xml, item_schema, []( item &i){
+	std::cout << i.id << " " << i.name << " " << i.price << "\n";
+});
+ * @endcode
+ */
+namespace expat_dom{
+namespace bind{
+
+/**
+ * @brief Attribute of the record element bound to a member.
+ */
+template<class T, class M> struct attr_field{
+	static constexpr bool is_child=false;
+	const char *name;
+	M T::*member;
+};
+
+/**
+ * @brief Text of a child element of the record bound to a member.
+ */
+template<class T, class M> struct child_field{
+	static constexpr bool is_child=true;
+	const char *name;
+	M T::*member;
+};
+
+template<class T, class M> constexpr attr_field<T, M> attr(const char *name, M T::*member){
+	return attr_field<T, M>{ name, member};
+}
+
+template<class T, class M> constexpr child_field<T, M> child(const char *name, M T::*member){
+	return child_field<T, M>{ name, member};
+}
+
+/**
+ * @brief Schema of a record: name of the record element and its fields.
+ */
+template<class T, class... F> class schema{
+public:
+	using value_type=T;
+
+	constexpr schema(const char *name, F... fields) : name_(name), fields_(fields...){}
+	constexpr const char *name() const{ return name_; }
+	constexpr const std::tuple<F...> &fields() const{ return fields_; }
+
+private:
+	const char *name_;
+	std::tuple<F...> fields_;
+};
+
+/**
+ * Creates schema of records of type @c T found in elements named @c name.
+ */
+template<class T, class... F> constexpr schema<T, F...> record(const char *name, F... fields){
+	return schema<T, F...>(name, fields...);
+}
+
+namespace detail{
+
+inline bool is_space(char c){
+	return c==' ' || c=='\t' || c=='\r' || c=='\n';
+}
+
+inline std::string_view trim(const char *str, size_t len){
+	while(len && is_space(*str)){
+		str++;
+		len--;
+	}
+	while(len && is_space(str[len-1])){
+		len--;
+	}
+	return std::string_view(str, len);
+}
+
+/*
+ * Node on the stack that only carries the text, so the conversion functions
+ * of the library can be used without building a tree.
+ */
+inline dom_t text_node(std::string_view text){
+	dom_t node;
+
+	std::memset(&node, 0, sizeof(node));
+	node.data=const_cast<char *>(text.data());
+	node.data_len=text.size();
+	return node;
+}
+
+template<class M> struct is_optional : std::false_type{};
+template<class M> struct is_optional<std::optional<M>> : std::true_type{};
+
+/*
+ * Converts the text and stores it into the member. Returns false if the text
+ * is not a value of the type.
+ */
+template<class M> bool assign(M &member, std::string_view text){
+	if constexpr(is_optional<M>::value){
+		typename M::value_type value{};
+		if( !assign(value, text)){
+			return false;
+		}
+		member=std::move(value);
+		return true;
+	}else if constexpr(std::is_same_v<M, std::string>){
+		text=trim(text.data(), text.size());
+		member.assign(text.data(), text.size());
+		return true;
+	}else if constexpr(std::is_same_v<M, bool>){
+		dom_t node=text_node(text);
+		int value;
+		if(dom_text_bool(&node, &value)){
+			return false;
+		}
+		member=value !=0;
+		return true;
+	}else if constexpr(std::is_integral_v<M>){
+		dom_t node=text_node(text);
+		int64_t value;
+		if(dom_text_int64(&node, &value) || (int64_t)(M)value !=value || (value<0 && std::is_unsigned_v<M>)){
+			return false;
+		}
+		member=(M)value;
+		return true;
+	}else if constexpr(std::is_floating_point_v<M>){
+		dom_t node=text_node(text);
+		double value;
+		int ret=dom_text_double(&node, &value);
+		if(ret && ret !=ERANGE){
+			return false;
+		}
+		member=(M)value;
+		return true;
+	}else{
+		static_assert(std::is_same_v<M, std::string>, "type of the member is not supported");
+		return false;
+	}
+}
+
+/*
+ * State of the parser, passed to expat handlers as user data.
+ */
+template<class S, class C> class parser{
+public:
+	using T=typename S::value_type;
+	static constexpr size_t fields=std::tuple_size_v<std::decay_t<decltype(std::declval<S>().fields())>>;
+
+	parser(const S &schema, C &callback) : schema_(schema), callback_(callback){
+		if(nullptr==(parser_=XML_ParserCreate(nullptr))){
+			throw error(ENOMEM, "XML_ParserCreate");
+		}
+		XML_SetUserData(parser_, this);
+		XML_SetElementHandler(parser_, start_element, end_element);
+		XML_SetCharacterDataHandler(parser_, character_data);
+	}
+	parser(const parser &)=delete;
+	parser &operator=(const parser &)=delete;
+	~parser(){ XML_ParserFree(parser_); }
+
+	//expat takes int lengths, longer buffers are passed in pieces as by
+	//dom_parse_buffer()
+	static constexpr int chunk=1<<28;
+
+	void parse(const char *buffer, size_t len, bool final){
+		int piece=len>INT_MAX? chunk : (int)len;
+		int n;
+
+		do{
+			n=len>(size_t)piece? piece : (int)len;
+			if(XML_STATUS_ERROR==XML_Parse(parser_, buffer, n, final && (size_t)n==len)){
+				if(exception_){
+					std::rethrow_exception(exception_);
+				}
+				throw error(EINVAL, XML_ErrorString(XML_GetErrorCode(parser_)));
+			}
+			buffer+=n;
+			len-=n;
+		}while(len);
+	}
+
+private:
+	template<size_t I> bool match_attr(const char *name, const char *value){
+		const auto &field=std::get<I>(schema_.fields());
+		if constexpr(std::decay_t<decltype(field)>::is_child){
+			return false;
+		}else{
+			if(strcasecmp(name, field.name)){
+				return false;
+			}
+			assign(record_.*field.member, std::string_view(value));
+			return true;
+		}
+	}
+
+	template<size_t I> bool match_child(const char *name){
+		const auto &field=std::get<I>(schema_.fields());
+		if constexpr( !std::decay_t<decltype(field)>::is_child){
+			return false;
+		}else{
+			if(strcasecmp(name, field.name)){
+				return false;
+			}
+			active_=I;
+			return true;
+		}
+	}
+
+	template<size_t I> void store_child(){
+		const auto &field=std::get<I>(schema_.fields());
+		if constexpr(std::decay_t<decltype(field)>::is_child){
+			assign(record_.*field.member, std::string_view(text_));
+		}
+	}
+
+	template<size_t... I> void start_record(const char **atts, std::index_sequence<I...>){
+		for(; atts[0]; atts+=2){
+			(match_attr<I>(atts[0], atts[1]) || ...);
+		}
+	}
+
+	template<size_t... I> void start_child(const char *name, std::index_sequence<I...>){
+		(match_child<I>(name) || ...);
+	}
+
+	template<size_t... I> void end_child(std::index_sequence<I...>){
+		((I==active_? store_child<I>() : void()), ...);
+	}
+
+	static void XMLCALL start_element(void *data, const char *name, const char **atts){
+		parser *p=(parser *)data;
+
+		p->depth_++;
+		if(p->record_depth_<0){
+			if(0==strcasecmp(name, p->schema_.name())){
+				p->record_depth_=p->depth_;
+				p->record_=T{};
+				p->start_record(atts, std::make_index_sequence<fields>());
+			}
+		}else if(p->depth_==p->record_depth_+1){
+			p->text_.clear();
+			p->start_child(name, std::make_index_sequence<fields>());
+		}
+	}
+
+	static void XMLCALL end_element(void *data, const char *name){
+		parser *p=(parser *)data;
+
+		if(p->depth_==p->record_depth_+1 && p->active_ !=none){
+			p->end_child(std::make_index_sequence<fields>());
+			p->active_=none;
+		}else if(p->depth_==p->record_depth_){
+			p->record_depth_=-1;
+			try{
+				p->callback_(p->record_);
+			}catch(...){
+				p->exception_=std::current_exception();
+				XML_StopParser(p->parser_, XML_FALSE);
+			}
+		}
+		p->depth_--;
+	}
+
+	static void XMLCALL character_data(void *data, const char *s, int len){
+		parser *p=(parser *)data;
+
+		//text of nested elements belongs to the field as well
+		if(p->active_ !=none){
+			p->text_.append(s, len);
+		}
+	}
+
+	static constexpr size_t none=(size_t)-1;
+
+	const S &schema_;
+	C &callback_;
+	XML_Parser parser_;
+	T record_;
+	//text of the active child field, the buffer is reused for all records
+	std::string text_;
+	size_t active_=none;
+	int depth_=0;
+	int record_depth_=-1;
+	std::exception_ptr exception_;
+};
+
+} //namespace detail
+
+/**
+ * @brief Parses the buffer and calls the callback for every record.
+ *
+ * Records are elements with the name of the schema at any depth; a record
+ * nested in another record is not reported. The callback receives a
+ * reference to the record that is reused after the callback returns, move
+ * from it to keep it. Exceptions thrown by the callback stop the parsing
+ * and are passed to the caller.
+ *
+ * @throws error with code @c EINVAL if the buffer is not well-formed XML,
+ * 	or @c ENOMEM.
+ */
+template<class S, class C> void parse(std::string_view xml, const S &schema, C &&callback){
+	detail::parser<S, C> p(schema, callback);
+	p.parse(xml.data(), xml.size(), true);
+}
+
+/**
+ * @brief Parses the buffer and returns all records.
+ */
+template<class S> std::vector<typename S::value_type> parse_all(std::string_view xml, const S &schema){
+	std::vector<typename S::value_type> ret;
+	parse(xml, schema, [&ret](typename S::value_type &record){
+		ret.push_back(std::move(record));
+	});
+	return ret;
+}
+
+} //namespace bind
+} //namespace expat_dom
+
+/** @} */
+
+#endif //__EXPAT_DOM_BIND_HPP_INCLUDED
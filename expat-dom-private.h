@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2011 Sergey Kolotsey.
+ * This file if part of expat-dom library.
+ * See the file COPYING for copying permission.
+ *
+ * Internal definitions shared by the library source files. This file is not
+ * installed and must not be included by users of the library.
+ */
+
+#ifndef __EXPAT_DOM_PRIVATE_INCLUDED
+#define __EXPAT_DOM_PRIVATE_INCLUDED
+
+#include "expat-dom.h"
+
+
+/*
+ * Storage types
+ *
+ * DOM_STORAGE_NODE holds name, attributes and data of a node that have been
+ * shared with clones of the node. A pointer is held by the storage if it is
+ * equal to one of the storage fields.
+ */
+#define DOM_STORAGE_NODE 1
+/*
+ * DOM_STORAGE_BLOCK is a block of memory allocated by dom_compact(). The block
+ * contains nodes, attributes and strings of a tree. A pointer is held by the
+ * storage if it points inside the block. Every node of the block keeps one
+ * reference to the storage.
+ */
+#define DOM_STORAGE_BLOCK 2
+/*
+ * DOM_STORAGE_INPUT is the input of the parser owned by the caller, data of
+ * nodes parsed with DOM_PARSE_BORROW points into it. DOM_STORAGE_MMAP is a
+ * file mapped into memory by the parser, it is unmapped when the storage is
+ * freed. A pointer is held by these storages if it points inside the block.
+ */
+#define DOM_STORAGE_INPUT 3
+#define DOM_STORAGE_MMAP 4
+
+#if defined HAVE_MMAP && defined HAVE_SYS_MMAN_H && defined HAVE_SYS_STAT_H
+# define DOM_MMAP 1
+#endif
+
+//white space of XML
+#define DOM_SPACE(a) ((a)==' ' || (a)=='\t' || (a)=='\r' || (a)=='\n')
+
+//64-bit FNV-1a, used to hash strings in the tables of dedup.c and keys.c
+#define DOM_FNV_OFFSET 14695981039346656037ULL
+#define DOM_FNV_PRIME 1099511628211ULL
+
+/*
+ * Memory referenced by nodes but not owned by them.
+ *
+ * A node that points to memory it does not own keeps a reference to a storage
+ * in its field storage. The memory is freed when the last reference is
+ * released. A storage may itself depend on other storage through the field
+ * parent.
+ */
+struct dom_storage_s{
+	int refs;
+	int type;
+	char *name;
+	dom_attr_t *attr;
+	char *data;
+	//DOM_STORAGE_BLOCK, DOM_STORAGE_INPUT and DOM_STORAGE_MMAP: the block and
+	//its size
+	char *block;
+	size_t block_len;
+	//interned strings referenced by the held names, released with them
+	const char **interned;
+	size_t interned_count;
+	dom_storage_t *parent;
+};
+
+/*
+ * Returns 1 if memory pointed to by ptr is held by storage s or by any of its
+ * parents and so must not be freed by the node, otherwise returns 0.
+ */
+int dom_storage_holds(const dom_storage_t *s, const void *ptr);
+
+/*
+ * Increments reference count of the storage s. Returns s.
+ */
+dom_storage_t *dom_storage_ref(dom_storage_t *s);
+
+/*
+ * Decrements reference count of the storage s and frees it with all the
+ * memory it holds when the count drops to zero. s may be NULL.
+ */
+void dom_storage_release(dom_storage_t *s);
+
+/*
+ * Returns storage that holds name, attributes and data of the node with
+ * one reference taken for the caller. If some of these fields are owned by
+ * the node, their ownership is moved to a new storage that replaces the
+ * storage of the node. Returns NULL if the node has none of these fields or
+ * if there is not enough memory.
+ */
+dom_storage_t *dom_storage_share(dom_t *node);
+
+/*
+ * Allocates new node with the specified name and attributes. The attributes
+ * are passed as expat passes them to start element handler, atts may be
+ * NULL. This function is used both by the parser and by dom_new_element().
+ * Returns NULL if there is not enough memory.
+ */
+dom_t *dom_node_new(const char *name, const char **atts);
+
+/*
+ * Separator of namespace URI, local name and prefix in names reported by
+ * namespace-aware expat parser.
+ */
+#define DOM_NS_SEP '\x01'
+
+/*
+ * Strings interned by one parser. The parser keeps references of recently
+ * used namespace URIs, local names and prefixes, so that repeated names are
+ * interned without locking the table. bytes is the size of the strings that
+ * were interned or referenced for the first time, the parser charges it to
+ * max_tree_bytes.
+ */
+#define DOM_NS_CACHE 64
+typedef struct{
+	const char *str[DOM_NS_CACHE];
+	int64_t bytes;
+}dom_ns_cache_t;
+
+dom_ns_cache_t *dom_ns_cache_new(void);
+void dom_ns_cache_free(dom_ns_cache_t *cache);
+
+/*
+ * Takes another reference of the interned string str, the caller must
+ * already hold one. Returns str, which may be NULL.
+ */
+const char *dom_ns_ref(const char *str);
+
+/*
+ * Releases a reference of the interned string str and frees the string when
+ * it was the last one. str may be NULL.
+ */
+void dom_ns_release(const char *str);
+
+/*
+ * Same as dom_node_new() but name and atts are reported by namespace-aware
+ * parser. Namespace declarations decls made by the element are prepended to
+ * its attributes. decls are freed if there is not enough memory. Interned
+ * strings are owned by the node name and the attribute names. cache may be
+ * NULL.
+ */
+dom_t *dom_node_new_ns(const char *name, const char **atts, dom_attr_t *decls, dom_ns_cache_t *cache);
+
+/*
+ * Appends namespace declaration to the list decls as attribute xmlns:prefix
+ * or xmlns. Returns the list or NULL if there is not enough memory.
+ */
+dom_attr_t *dom_ns_decl(dom_attr_t *decls, const char *prefix, const char *uri, dom_ns_cache_t *cache);
+
+/*
+ * Convert first len bytes of str, surrounded by optional white space, to a
+ * number. Return 0, EINVAL, ERANGE or ENOMEM. value is changed only on
+ * success, or if a double overflows or underflows.
+ */
+int dom_to_int64(const char *str, size_t len, int64_t *value);
+int dom_to_double(const char *str, size_t len, double *value);
+
+/*
+ * State of deduplication of subtrees during one parse, see dedup.c. The
+ * parser calls dom_dedup_open() for every started element, which returns 0
+ * or ENOMEM, and dom_dedup_close() for every closed element, whose data
+ * must be final. dom_dedup_close() turns the element into an alias if its
+ * subtree has been seen before.
+ */
+typedef struct dom_dedup_s dom_dedup_t;
+dom_dedup_t *dom_dedup_new(void);
+void dom_dedup_free(dom_dedup_t *d);
+int dom_dedup_open(dom_dedup_t *d);
+void dom_dedup_close(dom_dedup_t *d, dom_t *node);
+
+/*
+ * Structural index shared by the nodes it numbers, see structure.c. Every
+ * node keeps a reference. The index is invalidated when the tree changes,
+ * the numbers of its nodes are not used then.
+ */
+struct dom_index_s{
+	int refs;
+	int valid;
+};
+/*
+ * Returns new valid index with one reference or NULL if there is not enough
+ * memory.
+ */
+dom_index_t *dom_index_new(void);
+void dom_index_release(dom_index_t *index);
+/*
+ * Makes the node reference the index instead of its previous one.
+ */
+void dom_index_set(dom_t *node, dom_index_t *index);
+/*
+ * Invalidates the index of the tree the node belongs to.
+ */
+void dom_index_invalidate(dom_t *node);
+/*
+ * Sets skip pointers of the list of nodes linked through their skip
+ * pointers to node.
+ */
+void dom_index_resolve(dom_t *pending, dom_t *node);
+
+/*
+ * Key index, see keys.c. The parser adds every started element with
+ * dom_key_index_add_node(), which returns 0 or ENOMEM, and drops the
+ * elements of a failed parse with dom_key_index_truncate() to the number
+ * returned by dom_key_index_count() before the parse.
+ */
+int dom_key_index_add_node(dom_key_index_t *index, dom_t *node);
+int dom_key_index_count(const dom_key_index_t *index);
+void dom_key_index_truncate(dom_key_index_t *index, int count);
+
+#endif //__EXPAT_DOM_PRIVATE_INCLUDED
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2011 Sergey Kolotsey.
+ * This file if part of expat-dom library.
+ * See the file COPYING for copying permission.
+ *
+ * Static probes of the parser, for tracing with bpftrace, perf or SystemTap.
+ * A probe is a single nop instruction and an ELF note when nobody is tracing.
+ * Durations are measured only while a tracer is attached to the probe that
+ * reports them. This file is included by expat-dom.c only: it defines the
+ * semaphores of the probes.
+ *
+ * Provider expat_dom:
+ *
+ *   parse__start(flags)                     a parser has been created
+ *   parse__done(input_bytes, tree_bytes, status, ns)
+ *                                           the parser is freed, ns since start
+ *   xml__parse(len, is_final, ns)           one call of XML_Parse()
+ *   read(fd, bytes, ns)                     one read() of dom_parse_file(),
+ *                                           bytes is -1 on error
+ *   text__realloc(old_size, new_size, ns)   text grows past DOM_DATA_GROW_MIN
+ *   free__start(node)                       dom_free() of a tree is called
+ *   free__done(node, nodes, ns)             the tree of nodes is freed
+ *
+ * Example:
+ *
+ *   bpftrace -p PID -e 'usdt:./libexpat-dom.so:expat_dom:xml__parse
+ *   	{ @us=hist(arg2/1000); @mb=sum(arg0)/1048576; }'
+ */
+
+#ifndef __EXPAT_DOM_PROBES_INCLUDED
+#define __EXPAT_DOM_PROBES_INCLUDED
+
+#ifdef HAVE_SYS_SDT_H
+
+#include <stdint.h>
+#include <time.h>
+//every probe has a semaphore the tracer increments while it is attached
+#define _SDT_HAS_SEMAPHORES 1
+#include <sys/sdt.h>
+
+#define DOM_PROBE_SEMAPHORE(name) \
+	__attribute__((section(".probes"), used)) static volatile unsigned short expat_dom_##name##_semaphore
+
+DOM_PROBE_SEMAPHORE(parse__start);
+DOM_PROBE_SEMAPHORE(parse__done);
+DOM_PROBE_SEMAPHORE(xml__parse);
+DOM_PROBE_SEMAPHORE(read);
+DOM_PROBE_SEMAPHORE(text__realloc);
+DOM_PROBE_SEMAPHORE(free__start);
+DOM_PROBE_SEMAPHORE(free__done);
+
+//arguments are evaluated only while the probe is traced
+#define DOM_PROBE_ENABLED(name) __builtin_expect(expat_dom_##name##_semaphore !=0, 0)
+#define DOM_PROBE1(name, a) do{ \
+	if(DOM_PROBE_ENABLED(name)) DTRACE_PROBE1(expat_dom, name, a); \
+}while(0)
+#define DOM_PROBE3(name, a, b, c) do{ \
+	if(DOM_PROBE_ENABLED(name)) DTRACE_PROBE3(expat_dom, name, a, b, c); \
+}while(0)
+#define DOM_PROBE4(name, a, b, c, d) do{ \
+	if(DOM_PROBE_ENABLED(name)) DTRACE_PROBE4(expat_dom, name, a, b, c, d); \
+}while(0)
+
+/*
+ * Returns monotonic time in nanoseconds if the probe is enabled, otherwise 0.
+ */
+#define DOM_PROBE_TIME(name) (DOM_PROBE_ENABLED(name)? dom_probe_now() : 0)
+
+static inline uint64_t dom_probe_now(void){
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000000+ts.tv_nsec;
+}
+
+/*
+ * Returns nanoseconds since start, or 0 if the time was not measured.
+ */
+static inline uint64_t dom_probe_since(uint64_t start){
+	return start? dom_probe_now()-start : 0;
+}
+
+#else
+
+//arguments are only referenced, so the variables they use are not unused
+#define DOM_PROBE_ENABLED(name) 0
+#define DOM_PROBE1(name, a) do{ (void)(a); }while(0)
+#define DOM_PROBE3(name, a, b, c) do{ (void)(a); (void)(b); (void)(c); }while(0)
+#define DOM_PROBE4(name, a, b, c, d) do{ (void)(a); (void)(b); (void)(c); (void)(d); }while(0)
+#define DOM_PROBE_TIME(name) ((uint64_t)0)
+#define dom_probe_since(start) ((void)(start), (uint64_t)0)
+
+#endif
+
+#endif
@@ -31,12 +31,24 @@
 # include <strings.h>
 #endif
 #include <stdio.h>
+#include <limits.h>
 #include <errno.h>
 #ifdef HAVE_FCNTL_H
 #include <fcntl.h>
 #endif
 #include <expat.h>
-#include "expat-dom.h"
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef HAVE_ZSTD
+#include <zstd.h>
+#endif
+#include "expat-dom-private.h"
+#include "expat-dom-probes.h"
+#ifdef DOM_MMAP
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 
 
 //#define DOM_DEBUG(fmt,...) fprintf ( stderr, "%s (%lu): " fmt "\n", __func__, (long unsigned int)pthread_self(), ##__VA_ARGS__)
@@ -45,8 +57,21 @@
 #endif
 
 
-#define DOM_SPACE(a) ((a)==' ' || (a)=='\t' || (a)=='\r' || (a)=='\n')
 #define DOM_BUFFER_LEN 2048
+#define DOM_STREAM_BUFFER_LEN 65536
+#define DOM_MAGIC_LEN 4
+/*
+ * Size of pieces of buffers longer than INT_MAX passed to expat, which takes
+ * int lengths. Expat copies a piece into its own buffer when a token is left
+ * from the previous one, the buffer must not grow past 1 GB then.
+ */
+#define DOM_PARSE_CHUNK (1<<28)
+//data longer than this grows in powers of 2 instead of exactly
+#define DOM_DATA_GROW_MIN 65536
+
+#define DOM_IS_GZIP(b, l) ((l)>=2 && (unsigned char)(b)[0]==0x1f && (unsigned char)(b)[1]==0x8b)
+#define DOM_IS_ZSTD(b, l) ((l)>=4 && (unsigned char)(b)[0]==0x28 && (unsigned char)(b)[1]==0xb5 \
+		&& (unsigned char)(b)[2]==0x2f && (unsigned char)(b)[3]==0xfd)
 
 /*
  * Please see file expat-dom.h for information about functions
@@ -59,6 +84,9 @@ dom_attr_t *dom_attr_free(dom_attr_t *attr){
 			free(attr->var);
 		if(attr->val)
 			free(attr->val);
+		dom_ns_release(attr->ns);
+		dom_ns_release(attr->local_name);
+		dom_ns_release(attr->prefix);
 		temp=attr;
 		attr=attr->next;
 		free(temp);
@@ -66,19 +94,48 @@ dom_attr_t *dom_attr_free(dom_attr_t *attr){
 	return NULL;
 }
 
-dom_t *dom_free(void *dom){
+/*
+ * Frees the node, its next siblings and their children, and adds the number
+ * of freed nodes to count.
+ */
+static void dom_free_nodes(dom_t *d, uint64_t *count){
 	dom_t *temp;
-	dom_t *d=(dom_t *)dom;
+	dom_storage_t *storage;
 	while(d){
-		if(d->name)
+		(*count)++;
+		storage=d->storage;
+		if(d->name && !dom_storage_holds(storage, d->name)){
 			free(d->name);
-		if(d->data)
+			dom_ns_release(d->ns);
+			dom_ns_release(d->local_name);
+			dom_ns_release(d->prefix);
+		}
+		if(d->data && !dom_storage_holds(storage, d->data))
 			free(d->data);
-		dom_attr_free(d->attr);
-		dom_free(d->child);
+		if( !dom_storage_holds(storage, d->attr))
+			dom_attr_free(d->attr);
+		//children of an alias belong to the node it is an alias of
+		if( !d->alias)
+			dom_free_nodes(d->child, count);
+		dom_index_release(d->index);
 		temp=d;
 		d=d->next;
-		free(temp);
+		//nodes of a compacted tree are a part of the block of their storage
+		if( !dom_storage_holds(storage, temp))
+			free(temp);
+		dom_storage_release(storage);
+	}
+}
+
+dom_t *dom_free(void *dom){
+	uint64_t start;
+	uint64_t count=0;
+
+	if(dom){
+		DOM_PROBE1(free__start, dom);
+		start=DOM_PROBE_TIME(free__done);
+		dom_free_nodes((dom_t *)dom, &count);
+		DOM_PROBE3(free__done, dom, count, dom_probe_since(start));
 	}
 	return NULL;
 }
@@ -112,167 +169,551 @@ static dom_attr_t *dom_attributes(const char **atts){
 	return attr_head;
 }
 
-static void XMLCALL start_element(void *user_data, const char *name, const char **atts){
+dom_t *dom_node_new(const char *name, const char **atts){
 	dom_t *dom;
-	dom_t *temp;
 
-	dom=*((dom_t **)user_data);
-	if(dom){
-		if((temp=calloc(1, sizeof(dom_t)))) {
-			temp->closed=0;
-			temp->user_data=NULL;
-			temp->user_data_len=0;
-			temp->name=strdup(name);
-			temp->data=NULL;
-			temp->data_len=0;
-			temp->attr=dom_attributes(atts);
-			*((dom_t **)user_data)=temp;
-			temp->next=NULL;
-			temp->child=NULL;
-			if(dom->closed){
-				dom->next=temp;
-				temp->parent=dom->parent;
+	if((dom=calloc(1, sizeof(dom_t)))) {
+		if(NULL==(dom->name=strdup(name))){
+			free(dom);
+			return NULL;
+		}
+		if(atts){
+			dom->attr=dom_attributes(atts);
+		}
+	}
+	return dom;
+}
+
+/*
+ * Parser context passed to expat handlers as user data.
+ */
+typedef struct dom_parser_s{
+	XML_Parser parser;
+	//the last opened node
+	dom_t *dom;
+	dom_parse_options_t options;
+
+	//node of the open CDATA section and offset of the section in its data
+	dom_t *cdata;
+	size_t cdata_start;
+
+	//node that receives current run of character data, offset of the run in
+	//its data and whether the run is white space only so far
+	dom_t *text;
+	size_t text_start;
+	int text_blank;
+
+	//counters checked against limits of the options
+	int64_t input_bytes;
+	int64_t tree_bytes;
+	int depth;
+	int nodes;
+	//namespace declarations of the element that is about to start and
+	//strings interned by the parser
+	dom_attr_t *ns_decls;
+	dom_ns_cache_t *ns_cache;
+	//DOM_PARSE_DEDUP: subtrees closed so far
+	dom_dedup_t *dedup;
+	//DOM_PARSE_INDEX: the index, number of started and closed elements and
+	//closed elements that wait for the next element as their skip pointer
+	dom_index_t *index;
+	int pre;
+	int post;
+	dom_t *pending;
+	//key index of the options and number of its elements before the parse
+	int key_count;
+	//DOM_PARSE_BORROW: the whole input and the storage that keeps it
+	const char *input;
+	size_t input_len;
+	dom_storage_t *input_storage;
+	//error code the parser was stopped with
+	int status;
+	//time the parser was created at, if probe parse__done is traced
+	uint64_t probe_start;
+}dom_parser_t;
+
+/*
+ * Stops the parser from a handler. Parse functions return status as the
+ * error code.
+ */
+static void dom_parser_stop(dom_parser_t *ctx, int status){
+	if( !ctx->status){
+		ctx->status=status;
+		XML_StopParser(ctx->parser, XML_FALSE);
+	}
+}
+
+/*
+ * Adds len bytes to the size of the tree. Returns 0 or stops the parser and
+ * returns E2BIG if the tree becomes too big.
+ */
+static int dom_parser_alloc(dom_parser_t *ctx, int64_t len){
+	ctx->tree_bytes+=len;
+	if(ctx->options.max_tree_bytes && ctx->tree_bytes>ctx->options.max_tree_bytes){
+		dom_parser_stop(ctx, E2BIG);
+		return E2BIG;
+	}
+	return 0;
+}
+
+/*
+ * Adds interned strings the parser has taken for the first time to the size
+ * of the tree. Returns 0 or E2BIG as dom_parser_alloc().
+ */
+static int dom_parser_alloc_ns(dom_parser_t *ctx){
+	int64_t len=0;
+
+	if(ctx->ns_cache){
+		len=ctx->ns_cache->bytes;
+		ctx->ns_cache->bytes=0;
+	}
+	return len? dom_parser_alloc(ctx, len) : 0;
+}
+
+/*
+ * Returns the element that receives character data: the current node, or its
+ * parent if the current node is already closed.
+ */
+static dom_t *dom_open_node(dom_parser_t *ctx){
+	dom_t *dom=ctx->dom;
+	return (dom && dom->closed)? dom->parent : dom;
+}
+
+/*
+ * Ends the current run of character data. With DOM_PARSE_SKIP_BLANK the run is
+ * removed if it consists of white space only.
+ */
+static void dom_end_text(dom_parser_t *ctx){
+	if(ctx->text){
+		if(ctx->text_blank && (ctx->options.flags & DOM_PARSE_SKIP_BLANK)){
+			ctx->text->data_len=ctx->text_start;
+		}
+		ctx->text=NULL;
+	}
+}
+
+/*
+ * Returns number of bytes allocated for len bytes of data. Large data grows
+ * in powers of 2, so appending to it takes amortized constant time.
+ */
+static size_t dom_data_size(size_t len){
+	size_t size;
+
+	if(len<=DOM_DATA_GROW_MIN){
+		return len;
+	}
+	for(size=DOM_DATA_GROW_MIN; size<len && size<=SIZE_MAX/2; size*=2);
+	return size<len? len : size;
+}
+
+/*
+ * Shrinks data of a closed node according to the parse options and releases
+ * unused memory. Data borrowed from the input is never changed in place.
+ */
+static void dom_shrink_data(dom_parser_t *ctx, dom_t *dom){
+	int borrowed=dom_storage_holds(dom->storage, dom->data);
+	char *temp;
+
+	if(ctx->options.flags & DOM_PARSE_USER_DATA_ONLY){
+		if(dom->user_data && dom->user_data !=dom->data){
+			if(borrowed){
+				dom->data=dom->user_data;
 			}else{
-				temp->parent=dom;
-				dom->child=temp;
+				memmove(dom->data, dom->user_data, dom->user_data_len);
+				dom->user_data=dom->data;
 			}
 		}
-	}else{
-		if((dom=calloc(1, sizeof(dom_t)))) {
-			*((dom_t **)user_data)=dom;
-			dom->name=strdup(name);
-			dom->data=NULL;
-			dom->user_data=NULL;
-			dom->user_data_len=0;
-			dom->data_len=0;
-			dom->attr=dom_attributes(atts);
-			dom->closed=0;
-			dom->next=NULL;
-			dom->child=NULL;
-			dom->parent=NULL;
+		dom->data_len=dom->user_data? dom->user_data_len : 0;
+	}
+	if(dom->data_len==0){
+		if( !borrowed){
+			free(dom->data);
 		}
+		dom->data=dom->user_data=NULL;
+		dom->user_data_len=0;
+	}else if( !borrowed && (temp=realloc(dom->data, dom->data_len))){
+		if(dom->user_data){
+			dom->user_data=temp+(dom->user_data-dom->data);
+		}
+		dom->data=temp;
 	}
 }
 
-static void XMLCALL end_element(void *user_data, const char *name){
+static void XMLCALL start_element(void *user_data, const char *name, const char **atts){
+	dom_parser_t *ctx=(dom_parser_t *)user_data;
 	dom_t *dom;
+	dom_t *temp;
+	long len;
+	int i;
+
+	if(ctx->status){
+		return;
+	}
+	len=sizeof(dom_t)+strlen(name)+1;
+	for(i=0; atts[i]; i+=2){
+		len+=sizeof(dom_attr_t)+strlen(atts[i])+1+(atts[i+1]? strlen(atts[i+1])+1 : 1);
+	}
+	if((ctx->options.max_depth && ctx->depth>=ctx->options.max_depth)
+			|| (ctx->options.max_nodes && ctx->nodes>=ctx->options.max_nodes)
+			|| (ctx->options.max_attrs && i/2>ctx->options.max_attrs)){
+		dom_parser_stop(ctx, E2BIG);
+		return;
+	}
+	if(dom_parser_alloc(ctx, len)){
+		return;
+	}
+	ctx->depth++;
+	ctx->nodes++;
 
-	dom=*((dom_t **)user_data);
+	dom_end_text(ctx);
+	if(ctx->options.flags & DOM_PARSE_NAMESPACES){
+		temp=dom_node_new_ns(name, atts, ctx->ns_decls, ctx->ns_cache);
+		ctx->ns_decls=NULL;
+	}else{
+		temp=dom_node_new(name, atts);
+	}
+	if( !temp){
+		dom_parser_stop(ctx, ENOMEM);
+		return;
+	}
+	if(dom_parser_alloc_ns(ctx)){
+		dom_free(temp);
+		return;
+	}
+	if(ctx->dedup && dom_dedup_open(ctx->dedup)){
+		dom_free(temp);
+		dom_parser_stop(ctx, ENOMEM);
+		return;
+	}
+	if(ctx->index){
+		dom_index_set(temp, ctx->index);
+		temp->pre=++ctx->pre;
+		temp->depth=ctx->depth-1;
+		dom_index_resolve(ctx->pending, temp);
+		ctx->pending=NULL;
+	}
+	dom=ctx->dom;
+	ctx->dom=temp;
 	if(dom){
 		if(dom->closed){
-			//close parent tag
-			if(dom->parent){
-				dom=dom->parent;
-				*((dom_t **)user_data)=dom;
-				end_element(user_data, name);
-			}
+			dom->next=temp;
+			temp->parent=dom->parent;
+		}else{
+			temp->parent=dom;
+			dom->child=temp;
+		}
+		if(temp->parent){
+			temp->parent->last=temp;
+			temp->parent->child_count++;
+		}
+	}
+	//with DOM_PARSE_DEDUP the tree is indexed when it is complete
+	if(ctx->options.key_index && !ctx->dedup && dom_key_index_add_node(ctx->options.key_index, temp)){
+		dom_parser_stop(ctx, ENOMEM);
+	}
+}
+
+static void XMLCALL end_element(void *user_data, const char *name){
+	dom_parser_t *ctx=(dom_parser_t *)user_data;
+	dom_t *dom;
+
+	if(ctx->status){
+		return;
+	}
+	ctx->depth--;
+	dom_end_text(ctx);
+	dom=ctx->dom;
+	if(dom && dom->closed){
+		//close parent tag
+		if(dom->parent){
+			dom=ctx->dom=dom->parent;
+		}
 #ifdef DOM_DEBUG
-			else{
-				DOM_DEBUG("close closed root tag %s?", name);
-			}
+		else{
+			DOM_DEBUG("close closed root tag %s?", name);
+		}
 #endif
-		}else{
+	}
+	if(dom && !dom->closed){
 #ifdef DOM_DEBUG
-			if( !dom->name){
-				DOM_DEBUG("close tag with no name, need to close %s", name);
-			}else if(0 !=strcmp(name, dom->name)){
-				DOM_DEBUG("close tag %s, need to close %s", dom->name, name);
-			}
+		if( !dom->name){
+			DOM_DEBUG("close tag with no name, need to close %s", name);
+		}else if(0 !=strcmp(name, dom->name)){
+			DOM_DEBUG("close tag %s, need to close %s", dom->name, name);
+		}
 #endif
-			dom->closed=1;
-			if(dom->data && dom->data_len){
-				if( !dom->user_data){
-					dom->user_data=dom->data;
-					dom->user_data_len=dom->data_len;
-					while(dom->user_data_len && *dom->user_data && DOM_SPACE(dom->user_data[0])){
-						dom->user_data++;
-						dom->user_data_len--;
-					}
-					while(dom->user_data_len && DOM_SPACE(dom->user_data[dom->user_data_len-1])){
-						dom->user_data_len--;
-					}
+		dom->closed=1;
+		if(dom->data && dom->data_len){
+			if(ctx->options.flags & DOM_PARSE_TRIM){
+				//keep white space that is a part of CDATA section
+				while(dom->data_len && DOM_SPACE(dom->data[dom->data_len-1])
+						&& ( !dom->user_data || dom->user_data+dom->user_data_len<dom->data+dom->data_len)){
+					dom->data_len--;
 				}
 			}
+			if( !dom->user_data){
+				dom->user_data=dom->data;
+				dom->user_data_len=dom->data_len;
+				while(dom->user_data_len && *dom->user_data && DOM_SPACE(dom->user_data[0])){
+					dom->user_data++;
+					dom->user_data_len--;
+				}
+				while(dom->user_data_len && DOM_SPACE(dom->user_data[dom->user_data_len-1])){
+					dom->user_data_len--;
+				}
+			}
+		}
+		if(dom->data && ((ctx->options.flags & (DOM_PARSE_SKIP_BLANK | DOM_PARSE_TRIM | DOM_PARSE_USER_DATA_ONLY))
+				|| dom->data_len>DOM_DATA_GROW_MIN)){
+			dom_shrink_data(ctx, dom);
+		}
+		if(ctx->index){
+			dom->post=++ctx->post;
+			dom->size=ctx->pre-dom->pre;
+			dom->skip=ctx->pending;
+			ctx->pending=dom;
+		}
+		if(ctx->options.flags & DOM_PARSE_HASH){
+			dom_hash(dom, 0);
+		}
+		if(ctx->dedup){
+			dom_dedup_close(ctx->dedup, dom);
+			if(ctx->options.key_index && !dom->parent && dom_key_index_add(ctx->options.key_index, dom)){
+				dom_parser_stop(ctx, ENOMEM);
+			}
 		}
 	}
 #ifdef DOM_DEBUG
-	else{
+	else if( !dom){
 		DOM_DEBUG("close unopened tag %s", name);
 	}
 #endif
 }
 
 static void XMLCALL start_cdata(void *user_data){
+	dom_parser_t *ctx=(dom_parser_t *)user_data;
 	dom_t *dom;
-	dom=*((dom_t **)user_data);
 
-	if(dom){
-		if(dom->closed){
-			if(dom->parent && ( !dom->parent->closed)){
-				start_cdata(&dom->parent);
-			}
-#ifdef DOM_DEBUG
-			else{
-				DOM_DEBUG("user_data outside of root tag?");
-			}
-#endif
-		}else if(dom->data){
-			dom->user_data=dom->data+dom->data_len;
-			dom->user_data_len=0;
-		}
-#ifdef DOM_DEBUG
-		else{
-			DOM_DEBUG("user_data without data?");
+	if(ctx->status){
+		return;
+	}
+	dom_end_text(ctx);
+	if((dom=dom_open_node(ctx))){
+		//adjacent sections are merged into one
+		if(dom->user_data && dom->user_data+dom->user_data_len==dom->data+dom->data_len){
+			ctx->cdata_start=dom->user_data-dom->data;
+		}else{
+			ctx->cdata_start=dom->data_len;
 		}
-#endif
+		ctx->cdata=dom;
 	}
 #ifdef DOM_DEBUG
 	else{
-		DOM_DEBUG("user_data in empty tag");
+		DOM_DEBUG("user_data outside of root tag?");
 	}
 #endif
 }
 
 static void XMLCALL end_cdata(void *user_data){
+	dom_parser_t *ctx=(dom_parser_t *)user_data;
 	dom_t *dom;
-	dom=*((dom_t **)user_data);
 
-	if(dom){
-		if(dom->closed){
-#ifdef DOM_DEBUG
-			DOM_DEBUG("user_data close outside tag");
-#endif
-		}else if(dom->user_data){
-			dom->user_data_len=dom->data+dom->data_len-dom->user_data;
-		}
-#ifdef DOM_DEBUG
-		else{
-			DOM_DEBUG("user_data close without open");
+	if(ctx->status){
+		return;
+	}
+	if((dom=ctx->cdata)){
+		if(dom->data){
+			dom->user_data=dom->data+ctx->cdata_start;
+			dom->user_data_len=dom->data_len-ctx->cdata_start;
 		}
-#endif
+		ctx->cdata=NULL;
 	}
 #ifdef DOM_DEBUG
 	else{
-		DOM_DEBUG("close user_data in empty tag");
+		DOM_DEBUG("user_data close without open");
 	}
 #endif
 }
 
+/*
+ * DOM_PARSE_BORROW: appends the buffer to data of the node by pointing the
+ * data into the input. This is possible if the buffer, which starts skipped
+ * bytes after the current event, is a verbatim copy of the input and either
+ * the node has no data yet or its data is borrowed and ends right before
+ * the buffer. Returns 1 if the data was borrowed.
+ */
+static int dom_borrow_data(dom_parser_t *ctx, dom_t *dom, const char *buffer, size_t buffer_len, size_t skipped){
+	XML_Index index=XML_GetCurrentByteIndex(ctx->parser);
+	const char *src;
+
+	if(index<0 || (size_t)index+skipped>ctx->input_len || buffer_len>ctx->input_len-index-skipped){
+		return 0;
+	}
+	src=ctx->input+index+skipped;
+	if(dom->storage && dom->storage !=ctx->input_storage){
+		return 0;
+	}
+	if(dom->data && ( !dom_storage_holds(ctx->input_storage, dom->data) || dom->data+dom->data_len !=src)){
+		return 0;
+	}
+	//line ends and references are decoded by expat, so the text differs
+	if(memcmp(src, buffer, buffer_len)){
+		return 0;
+	}
+	if( !dom->storage){
+		dom->storage=dom_storage_ref(ctx->input_storage);
+	}
+	if( !dom->data){
+		dom->data=(char *)src;
+	}
+	dom->data_len+=buffer_len;
+	return 1;
+}
+
 static void XMLCALL element_data(void *user_data, const char *buffer, int buffer_len){
+	dom_parser_t *ctx=(dom_parser_t *)user_data;
+	const char *start=buffer;
 	dom_t *dom;
+	char *temp;
+	size_t size;
+	uint64_t probe_start;
+	int borrowed;
+	int i;
 
-	dom=*((dom_t **)user_data);
-	if(dom){
-		if((dom->data=realloc(dom->data, buffer_len+dom->data_len))) {
-			memcpy(dom->data+dom->data_len, buffer, buffer_len);
-			dom->data_len+=buffer_len;
-		}
+	if(ctx->status){
+		return;
 	}
+	if( !(dom=dom_open_node(ctx))){
 #ifdef DOM_DEBUG
-	else{
 		DOM_DEBUG("user data in empty tag");
+#endif
+		return;
+	}
+	if( !ctx->cdata){
+		if((ctx->options.flags & DOM_PARSE_TRIM) && dom->data_len==0){
+			while(buffer_len && DOM_SPACE(*buffer)){
+				buffer++;
+				buffer_len--;
+			}
+		}
+		if(ctx->text !=dom){
+			ctx->text=dom;
+			ctx->text_start=dom->data_len;
+			ctx->text_blank=1;
+		}
+		for(i=0; ctx->text_blank && i<buffer_len; i++){
+			ctx->text_blank=DOM_SPACE(buffer[i]);
+		}
+	}
+	if(buffer_len==0 || (ctx->input_storage && dom_borrow_data(ctx, dom, buffer, buffer_len, buffer-start))){
+		return;
+	}
+	//borrowed data is copied before anything is appended to it
+	borrowed=dom_storage_holds(dom->storage, dom->data);
+	if(dom_parser_alloc(ctx, borrowed? dom->data_len+buffer_len : (size_t)buffer_len)){
+		return;
+	}
+	if(dom->data_len>SIZE_MAX-buffer_len){
+		dom_parser_stop(ctx, E2BIG);
+		return;
+	}
+	size=dom_data_size(dom->data_len+buffer_len);
+	if(borrowed || size>dom_data_size(dom->data_len) || !dom->data){
+		probe_start=size>DOM_DATA_GROW_MIN? DOM_PROBE_TIME(text__realloc) : 0;
+		if(NULL==(temp=borrowed? malloc(size) : realloc(dom->data, size))){
+			dom_parser_stop(ctx, ENOMEM);
+			return;
+		}
+		if(size>DOM_DATA_GROW_MIN){
+			DOM_PROBE3(text__realloc, borrowed? 0 : dom_data_size(dom->data_len), size,
+					dom_probe_since(probe_start));
+		}
+		if(borrowed){
+			memcpy(temp, dom->data, dom->data_len);
+		}
+		if(dom->user_data){
+			dom->user_data=temp+(dom->user_data-dom->data);
+		}
+		dom->data=temp;
+	}
+	memcpy(dom->data+dom->data_len, buffer, buffer_len);
+	dom->data_len+=buffer_len;
+}
+
+
+static void XMLCALL start_namespace(void *user_data, const char *prefix, const char *uri){
+	dom_parser_t *ctx=(dom_parser_t *)user_data;
+	dom_attr_t *temp;
+
+	if(ctx->status){
+		return;
+	}
+	if(dom_parser_alloc(ctx, sizeof(dom_attr_t)+(prefix? strlen(prefix) : 0)+7+(uri? strlen(uri) : 0)+1)){
+		return;
+	}
+	if((temp=dom_ns_decl(ctx->ns_decls, prefix, uri, ctx->ns_cache))){
+		ctx->ns_decls=temp;
+		dom_parser_alloc_ns(ctx);
+	}else{
+		dom_parser_stop(ctx, ENOMEM);
+	}
+}
+
+static void XMLCALL start_doctype(void *user_data, const char *name, const char *sysid, const char *pubid,
+		int has_internal_subset){
+	dom_parser_stop((dom_parser_t *)user_data, EPERM);
+}
+
+static void XMLCALL entity_decl(void *user_data, const char *name, int is_parameter_entity, const char *value,
+		int value_length, const char *base, const char *sysid, const char *pubid, const char *notation){
+	if(sysid){
+		dom_parser_stop((dom_parser_t *)user_data, EPERM);
+	}
+}
+
+static int XMLCALL external_entity_ref(XML_Parser parser, const char *context, const char *base,
+		const char *sysid, const char *pubid){
+	dom_parser_stop((dom_parser_t *)XML_GetUserData(parser), EPERM);
+	return XML_STATUS_ERROR;
+}
+
+/*
+ * Passes input to expat, the same way as XML_Parse() and XML_ParseBuffer() do.
+ * buffer is NULL if the data has been stored in the buffer returned by
+ * XML_GetBuffer(). Returns 0 or error code.
+ */
+static int dom_parser_parse(dom_parser_t *ctx, const char *buffer, size_t buffer_len, int isFinal){
+	enum XML_Status ret;
+	uint64_t start;
+	int piece;
+	int len;
+
+	ctx->input_bytes+=buffer_len;
+	if(ctx->options.max_input_bytes && ctx->input_bytes>ctx->options.max_input_bytes){
+		return E2BIG;
+	}
+	if(buffer){
+		piece=buffer_len>INT_MAX? DOM_PARSE_CHUNK : (int)buffer_len;
+		do{
+			len=buffer_len>(size_t)piece? piece : (int)buffer_len;
+			start=DOM_PROBE_TIME(xml__parse);
+			ret=XML_Parse(ctx->parser, buffer, len, isFinal && (size_t)len==buffer_len);
+			DOM_PROBE3(xml__parse, len, isFinal && (size_t)len==buffer_len, dom_probe_since(start));
+			buffer+=len;
+			buffer_len-=len;
+		}while(ret !=XML_STATUS_ERROR && buffer_len);
+	}else{
+		start=DOM_PROBE_TIME(xml__parse);
+		ret=XML_ParseBuffer(ctx->parser, (int)buffer_len, isFinal);
+		DOM_PROBE3(xml__parse, buffer_len, isFinal, dom_probe_since(start));
 	}
+	if(ret==XML_STATUS_ERROR){
+#ifdef DOM_DEBUG
+		DOM_DEBUG("parse error: %s", XML_ErrorString(XML_GetErrorCode(ctx->parser)));
 #endif
+		return ctx->status? ctx->status : EINVAL;
+	}
+	return 0;
 }
 
 
@@ -321,7 +762,7 @@ void dom_print(FILE *output, dom_t *dom, int use_new_line){
 			if(use_new_line) fprintf( output, "\n");
 			if(dom->user_data && dom->user_data_len){
 				char *buf;
-				int len=escape_xml_r( dom->user_data, dom->user_data_len, NULL, 0);
+				size_t len=escape_xml_r( dom->user_data, dom->user_data_len, NULL, 0);
 				if(( buf=malloc( len+1))){
 					escape_xml_r( dom->user_data, dom->user_data_len, buf, len);
 					fwrite( buf, len, 1, output);
@@ -343,65 +784,406 @@ void dom_print(FILE *output, dom_t *dom, int use_new_line){
 }
 
 
-dom_t *dom_parse_file(int fd){
-	dom_t *dom=NULL;
+/*
+ * Reads input of dom_parse_file(), the same way as read() does.
+ */
+static int dom_read(int fd, void *buffer, int len){
+	uint64_t start=DOM_PROBE_TIME(read);
+	int size_read=read(fd, buffer, len);
+
+	DOM_PROBE3(read, fd, size_read, dom_probe_since(start));
+	return size_read;
+}
+
+
+#ifdef HAVE_ZLIB
+/*
+ * Inflate gzip stream read from fd directly into the parser buffer.
+ * Concatenated gzip members are accepted. The first head_len bytes of
+ * the stream have already been read into head.
+ */
+static int dom_parse_gzip(dom_parser_t *ctx, int fd, const char *head, int head_len){
+	z_stream z;
+	unsigned char *in;
+	void *out;
 	int size_read;
-	char buffer[DOM_BUFFER_LEN];
-	XML_Parser parser;
-	int done;
+	int eof=0;
+	int member_end=0;
+	int ret;
+	int status=0;
+
+	if(NULL==(in=malloc(DOM_STREAM_BUFFER_LEN))){
+		return ENOMEM;
+	}
+	memset(&z, 0, sizeof(z));
+	if(Z_OK !=inflateInit2(&z, 15+16)){
+		free(in);
+		return ENOMEM;
+	}
+	memcpy(in, head, head_len);
+	z.next_in=in;
+	z.avail_in=head_len;
+
+	while(1){
+		if(z.avail_in==0 && !eof){
+			if(-1==(size_read=dom_read(fd, in, DOM_STREAM_BUFFER_LEN))){
+				status=errno;
+				break;
+			}
+			eof=(size_read==0);
+			z.next_in=in;
+			z.avail_in=size_read;
+		}
+		if(member_end){
+			if(z.avail_in==0){
+				status=dom_parser_parse(ctx, NULL, 0, 1);
+				break;
+			}
+			inflateReset(&z);
+			member_end=0;
+		}
+		if(NULL==(out=XML_GetBuffer(ctx->parser, DOM_STREAM_BUFFER_LEN))){
+			status=ENOMEM;
+			break;
+		}
+		z.next_out=out;
+		z.avail_out=DOM_STREAM_BUFFER_LEN;
+		ret=inflate(&z, Z_NO_FLUSH);
+		if(ret==Z_STREAM_END){
+			member_end=1;
+		}else if(ret==Z_BUF_ERROR){
+			if(eof && z.avail_in==0){
+				//truncated stream
+				status=EINVAL;
+				break;
+			}
+		}else if(ret !=Z_OK){
+			status=(ret==Z_MEM_ERROR)? ENOMEM : EINVAL;
+			break;
+		}
+		if((status=dom_parser_parse(ctx, NULL, DOM_STREAM_BUFFER_LEN-z.avail_out, 0))){
+			break;
+		}
+	}
+	inflateEnd(&z);
+	free(in);
+	return status;
+}
+#endif
+
+#ifdef HAVE_ZSTD
+/*
+ * Decompress zstd stream read from fd directly into the parser buffer.
+ * Concatenated frames are accepted. The first head_len bytes of the
+ * stream have already been read into head.
+ */
+static int dom_parse_zstd(dom_parser_t *ctx, int fd, const char *head, int head_len){
+	ZSTD_DStream *zs;
+	ZSTD_inBuffer ib;
+	ZSTD_outBuffer ob;
+	char *in;
+	int size_read;
+	int eof=0;
+	size_t ret=1;
+	int status=0;
+
+	if(NULL==(in=malloc(DOM_STREAM_BUFFER_LEN))){
+		return ENOMEM;
+	}
+	if(NULL==(zs=ZSTD_createDStream())){
+		free(in);
+		return ENOMEM;
+	}
+	ZSTD_initDStream(zs);
+	memcpy(in, head, head_len);
+	ib.src=in;
+	ib.size=head_len;
+	ib.pos=0;
 
-	if(NULL==(parser=XML_ParserCreate(NULL))){
+	while(1){
+		if(ib.pos==ib.size && !eof){
+			if(-1==(size_read=dom_read(fd, in, DOM_STREAM_BUFFER_LEN))){
+				status=errno;
+				break;
+			}
+			eof=(size_read==0);
+			ib.size=size_read;
+			ib.pos=0;
+		}
+		if(ib.pos==ib.size && eof && ret==0){
+			status=dom_parser_parse(ctx, NULL, 0, 1);
+			break;
+		}
+		if(NULL==(ob.dst=XML_GetBuffer(ctx->parser, DOM_STREAM_BUFFER_LEN))){
+			status=ENOMEM;
+			break;
+		}
+		ob.size=DOM_STREAM_BUFFER_LEN;
+		ob.pos=0;
+		ret=ZSTD_decompressStream(zs, &ob, &ib);
+		if(ZSTD_isError(ret)){
+			status=EINVAL;
+			break;
+		}
+		if(ob.pos==0 && ib.pos==ib.size && eof){
+			//truncated stream
+			status=EINVAL;
+			break;
+		}
+		if((status=dom_parser_parse(ctx, NULL, ob.pos, 0))){
+			break;
+		}
+	}
+	ZSTD_freeDStream(zs);
+	free(in);
+	return status;
+}
+#endif
+
+/*
+ * Creates parser context with expat parser and handlers set up. options may
+ * be NULL. Returns NULL if there is not enough memory.
+ */
+static dom_parser_t *dom_parser_new(const dom_parse_options_t *options){
+	dom_parser_t *ctx;
+
+	if(NULL==(ctx=calloc(1, sizeof(dom_parser_t)))){
+		return NULL;
+	}
+	if(options){
+		ctx->options=*options;
+	}
+	if(ctx->options.flags & DOM_PARSE_NAMESPACES){
+		ctx->parser=XML_ParserCreateNS(NULL, DOM_NS_SEP);
+	}else{
+		ctx->parser=XML_ParserCreate(NULL);
+	}
+	if(NULL==ctx->parser){
 #ifdef DOM_DEBUG
 		DOM_DEBUG("xml parser create error");
 #endif
+		free(ctx);
+		return NULL;
+	}
+	XML_SetUserData(ctx->parser, ctx);
+	XML_SetElementHandler(ctx->parser, start_element, end_element);
+	XML_SetCdataSectionHandler(ctx->parser, start_cdata, end_cdata);
+	XML_SetCharacterDataHandler(ctx->parser, element_data);
+	if(ctx->options.flags & DOM_PARSE_NAMESPACES){
+		XML_SetReturnNSTriplet(ctx->parser, XML_TRUE);
+		XML_SetStartNamespaceDeclHandler(ctx->parser, start_namespace);
+		if(NULL==(ctx->ns_cache=dom_ns_cache_new())){
+			XML_ParserFree(ctx->parser);
+			free(ctx);
+			return NULL;
+		}
+	}
+	if((ctx->options.flags & DOM_PARSE_DEDUP) && NULL==(ctx->dedup=dom_dedup_new())){
+		dom_ns_cache_free(ctx->ns_cache);
+		XML_ParserFree(ctx->parser);
+		free(ctx);
+		return NULL;
+	}
+	if((ctx->options.flags & (DOM_PARSE_INDEX | DOM_PARSE_DEDUP))==DOM_PARSE_INDEX
+			&& NULL==(ctx->index=dom_index_new())){
+		dom_ns_cache_free(ctx->ns_cache);
+		XML_ParserFree(ctx->parser);
+		free(ctx);
+		return NULL;
+	}
+	if(ctx->options.key_index){
+		ctx->key_count=dom_key_index_count(ctx->options.key_index);
+	}
+	if(ctx->options.flags & DOM_PARSE_NO_DTD){
+		XML_SetStartDoctypeDeclHandler(ctx->parser, start_doctype);
+	}
+	if(ctx->options.flags & DOM_PARSE_NO_EXTERNAL_ENTITIES){
+		XML_SetEntityDeclHandler(ctx->parser, entity_decl);
+		XML_SetExternalEntityRefHandler(ctx->parser, external_entity_ref);
+	}
+	DOM_PROBE1(parse__start, ctx->options.flags);
+	ctx->probe_start=DOM_PROBE_TIME(parse__done);
+	return ctx;
+}
+
+/*
+ * Frees parser context. If status is not zero, the tree built so far is freed
+ * as well. Returns the tree or NULL.
+ */
+static dom_t *dom_parser_free(dom_parser_t *ctx, int status){
+	dom_t *dom=ctx->dom;
+
+	DOM_PROBE4(parse__done, ctx->input_bytes, ctx->tree_bytes, status, dom_probe_since(ctx->probe_start));
+	//the last closed elements have nothing after them
+	dom_index_resolve(ctx->pending, NULL);
+	if(status){
+		if( dom) while( dom->parent) dom=dom->parent;
+		dom=dom_free(dom);
+		if(ctx->options.key_index){
+			dom_key_index_truncate(ctx->options.key_index, ctx->key_count);
+		}
+	}
+	dom_index_release(ctx->index);
+	dom_attr_free(ctx->ns_decls);
+	dom_ns_cache_free(ctx->ns_cache);
+	dom_dedup_free(ctx->dedup);
+	dom_storage_release(ctx->input_storage);
+	XML_ParserFree(ctx->parser);
+	free(ctx);
+	return dom;
+}
+
+/*
+ * DOM_PARSE_BORROW: makes the input that starts offset bytes into the block
+ * available for borrowing. The storage takes over the block, DOM_STORAGE_MMAP
+ * block is unmapped when the storage is released. Returns 0 or ENOMEM.
+ */
+static int dom_parser_input(dom_parser_t *ctx, int type, const char *block, size_t block_len, size_t offset){
+	if(NULL==(ctx->input_storage=calloc(1, sizeof(dom_storage_t)))){
+		return ENOMEM;
+	}
+	//the parser keeps one reference while it runs
+	ctx->input_storage->refs=1;
+	ctx->input_storage->type=type;
+	ctx->input_storage->block=(char *)block;
+	ctx->input_storage->block_len=block_len;
+	ctx->input=block+offset;
+	ctx->input_len=block_len-offset;
+	return 0;
+}
+
+#ifdef DOM_MMAP
+/*
+ * DOM_PARSE_BORROW: maps the rest of a regular uncompressed file into memory
+ * and parses it, so the tree may borrow data from the mapping. Returns -1 if
+ * the file can not be mapped and has to be read, otherwise 0 or error code.
+ */
+static int dom_parse_mmap(dom_parser_t *ctx, int fd){
+	struct stat st;
+	off_t pos;
+	char *map;
+
+	if(-1==fstat(fd, &st) || !S_ISREG(st.st_mode) || -1==(pos=lseek(fd, 0, SEEK_CUR))
+			|| st.st_size-pos<DOM_MAGIC_LEN || (uint64_t)st.st_size>SIZE_MAX){
+		return -1;
+	}
+	if(MAP_FAILED==(map=mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0))){
+		return -1;
+	}
+	if(DOM_IS_GZIP(map+pos, st.st_size-pos) || DOM_IS_ZSTD(map+pos, st.st_size-pos)
+			|| dom_parser_input(ctx, DOM_STORAGE_MMAP, map, st.st_size, pos)){
+		munmap(map, st.st_size);
+		return -1;
+	}
+	//the file is consumed as if it was read
+	lseek(fd, st.st_size, SEEK_SET);
+	return dom_parser_parse(ctx, ctx->input, ctx->input_len, 1);
+}
+#endif
+
+dom_t *dom_parse_file_ex(int fd, const dom_parse_options_t *options){
+	dom_parser_t *ctx;
+	dom_t *dom;
+	int size_read;
+	int head_len;
+	char buffer[DOM_BUFFER_LEN];
+	int status;
+	int done;
+
+	if(NULL==(ctx=dom_parser_new(options))){
 		errno=ENOMEM;
 		return NULL;
 	}
 	done=0;
-	XML_SetUserData(parser, &dom);
-	XML_SetElementHandler(parser, start_element, end_element);
-	XML_SetCdataSectionHandler(parser, start_cdata, end_cdata);
-	XML_SetCharacterDataHandler(parser, element_data);
+	status=0;
+#ifdef DOM_MMAP
+	if((ctx->options.flags & DOM_PARSE_BORROW) && -1 !=(status=dom_parse_mmap(ctx, fd))){
+		dom=dom_parser_free(ctx, status);
+		if(status){
+			errno=status;
+		}
+		return dom;
+	}
+	status=0;
+#endif
 
+	//read enough bytes to recognize compressed input by its magic number
+	head_len=0;
+	do{
+		if(-1==(size_read=dom_read(fd, buffer+head_len, DOM_BUFFER_LEN-head_len))){
+			status=errno;
+			break;
+		}
+		head_len+=size_read;
+	}while(size_read && head_len<DOM_MAGIC_LEN);
 
-	while( !done){
+	if(status){
 #ifdef DOM_DEBUG
-		DOM_DEBUG("Reading");
+		DOM_DEBUG("file read error: %s", strerror(status));
+#endif
+		done=1;
+
+	}else if(DOM_IS_GZIP(buffer, head_len)){
+#ifdef HAVE_ZLIB
+		status=dom_parse_gzip(ctx, fd, buffer, head_len);
+#else
+		status=ENOTSUP;
 #endif
-		if(-1==(size_read=read(fd, buffer, DOM_BUFFER_LEN))){
+		done=1;
+
+	}else if(DOM_IS_ZSTD(buffer, head_len)){
+#ifdef HAVE_ZSTD
+		status=dom_parse_zstd(ctx, fd, buffer, head_len);
+#else
+		status=ENOTSUP;
+#endif
+		done=1;
+
+	}else{
+		size_read=head_len;
+	}
+
+	while( !done){
+		done=(size_read==0);
 #ifdef DOM_DEBUG
-			DOM_DEBUG("file read error: %s", strerror(errno));
+			DOM_DEBUG("file read: %d bytes", size_read);
 #endif
-			if( dom) while( dom->parent) dom=dom->parent;
-			dom=dom_free(dom);
-			//errno is set in "read"
+		if((status=dom_parser_parse(ctx, buffer, size_read, done))){
+			break;
+		}
+		if(done){
 			break;
 		}
-		done=(size_read==0);
 #ifdef DOM_DEBUG
-			DOM_DEBUG("file read: %d bytes", size_read);
+		DOM_DEBUG("Reading");
 #endif
-		if (XML_Parse(parser, buffer, size_read, done) == XML_STATUS_ERROR) {
+		if(-1==(size_read=dom_read(fd, buffer, DOM_BUFFER_LEN))){
 #ifdef DOM_DEBUG
-			DOM_DEBUG("parse error: %s", XML_ErrorString(XML_GetErrorCode(parser)));
+			DOM_DEBUG("file read error: %s", strerror(errno));
 #endif
-			if( dom) while( dom->parent) dom=dom->parent;
-			dom=dom_free(dom);
-			errno=EINVAL;
+			//errno is set in "read"
+			status=errno;
 			break;
 		}
 	}
-	XML_ParserFree(parser);
+	dom=dom_parser_free(ctx, status);
+	if(status){
+		errno=status;
+	}
 	return dom;
 }
 
-dom_t *dom_parse_file_name(char *name){
+dom_t *dom_parse_file(int fd){
+	return dom_parse_file_ex(fd, NULL);
+}
+
+dom_t *dom_parse_file_name_ex(char *name, const dom_parse_options_t *options){
 	int fd;
 	dom_t *dom=NULL;
 
 
 	if(-1 !=(fd=open(name, O_RDONLY))){
-		dom=dom_parse_file(fd);
+		dom=dom_parse_file_ex(fd, options);
 		close(fd);
 		//dom_print(stdout, dom);
 		//dom=dom_free(dom);
@@ -416,71 +1198,63 @@ dom_t *dom_parse_file_name(char *name){
 	return dom;
 }
 
-dom_t *dom_parse_buffer(const char *buffer, int buffer_len){
-	dom_t *dom=NULL;
-	XML_Parser parser;
+dom_t *dom_parse_file_name(char *name){
+	return dom_parse_file_name_ex(name, NULL);
+}
 
-	if(NULL==(parser=XML_ParserCreate(NULL))){
-#ifdef DOM_DEBUG
-		DOM_DEBUG("xml parser create error");
-#endif
+dom_t *dom_parse_buffer_ex(const char *buffer, size_t buffer_len, const dom_parse_options_t *options){
+	dom_parser_t *ctx;
+	int status;
+
+	if(NULL==(ctx=dom_parser_new(options))){
 		errno=ENOMEM;
 		return NULL;
 	}
-	XML_SetUserData(parser, &dom);
-	XML_SetElementHandler(parser, start_element, end_element);
-	XML_SetCdataSectionHandler(parser, start_cdata, end_cdata);
-	XML_SetCharacterDataHandler(parser, element_data);
-
-
-
-	if (XML_Parse(parser, buffer, buffer_len, 1) == XML_STATUS_ERROR) {
-#ifdef DOM_DEBUG
-		DOM_DEBUG("parse error: %s", XML_ErrorString(XML_GetErrorCode(parser)));
-#endif
-		if( dom) while( dom->parent) dom=dom->parent;
-		dom=dom_free(dom);
-		XML_ParserFree(parser);
-		errno=EINVAL;
+	//without the storage the data is copied as usual
+	if(ctx->options.flags & DOM_PARSE_BORROW){
+		dom_parser_input(ctx, DOM_STORAGE_INPUT, buffer, buffer_len, 0);
+	}
+	if((status=dom_parser_parse(ctx, buffer, buffer_len, 1))){
+		dom_parser_free(ctx, status);
+		errno=status;
 		return NULL;
 	}
-	XML_ParserFree(parser);
-	return dom;
+	return dom_parser_free(ctx, 0);
 }
 
+dom_t *dom_parse_buffer(const char *buffer, size_t buffer_len){
+	return dom_parse_buffer_ex(buffer, buffer_len, NULL);
+}
 
-int dom_parse_chunked_data( void **parser, dom_t **dom, const char *buffer, int buffer_len, int isFinal){
-	XML_Parser p=*parser;
 
-	if( NULL==p){
-		if(NULL==(p=XML_ParserCreate(NULL))){
-#ifdef DOM_DEBUG
-			DOM_DEBUG("xml parser create error");
-#endif
+int dom_parse_chunked_data_ex( void **parser, dom_t **dom, const char *buffer, size_t buffer_len, int isFinal,
+		const dom_parse_options_t *options){
+	dom_parser_t *ctx=*parser;
+	int status;
+
+	if( NULL==ctx){
+		if(NULL==(ctx=dom_parser_new(options))){
 			return ENOMEM;
 		}
-		XML_SetUserData(p, dom);
-		XML_SetElementHandler(p, start_element, end_element);
-		XML_SetCdataSectionHandler(p, start_cdata, end_cdata);
-		XML_SetCharacterDataHandler(p, element_data);
-		*parser=p;
+		ctx->dom=*dom;
+		*parser=ctx;
 	}
 
-	if (XML_Parse(p, buffer, buffer_len, isFinal) == XML_STATUS_ERROR) {
-#ifdef DOM_DEBUG
-		DOM_DEBUG("parse error: %s", XML_ErrorString(XML_GetErrorCode(p)));
-#endif
-		if( *dom) while( (*dom)->parent) *dom=(*dom)->parent;
-		dom_free(*dom);
+	if((status=dom_parser_parse(ctx, buffer, buffer_len, isFinal))){
+		dom_parser_free(ctx, status);
 		*dom=NULL;
-		XML_ParserFree(p);
 		*parser=NULL;
-		return EINVAL;
+		return status;
 	}
 
+	*dom=ctx->dom;
 	if(isFinal){
-		XML_ParserFree(p);
+		dom_parser_free(ctx, 0);
 		*parser=NULL;
 	}
 	return 0;
 }
+
+int dom_parse_chunked_data( void **parser, dom_t **dom, const char *buffer, size_t buffer_len, int isFinal){
+	return dom_parse_chunked_data_ex(parser, dom, buffer, buffer_len, isFinal, NULL);
+}
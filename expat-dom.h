@@ -8,6 +8,18 @@
 #define __EXPAT_DOM_INCLUDED
 
 #include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Major version of the interface.
+ *
+ * Version 2 uses @c size_t for lengths of buffers and data of nodes and
+ * @c int64_t for byte limits of the parser, so documents and text nodes may
+ * be larger than 2 GB. Code that must build with both versions can test
+ * this macro, it is not defined by version 1.
+ */
+#define EXPAT_DOM_VERSION_MAJOR 2
 
 
 /**
@@ -105,8 +117,52 @@ struct dom_attr_s{
 	 * @brief Pointer to the next attribute.
 	 */
 	dom_attr_t *next;
+	/**
+	 * @brief Interned namespace URI of the attribute or NULL.
+	 *
+	 * This field and fields @c local_name and @c prefix are set only if
+	 * the document is parsed with @c DOM_PARSE_NAMESPACES flag.
+	 * @see dom_ns_intern().
+	 */
+	const char *ns;
+	/**
+	 * @brief Interned local part of the attribute name.
+	 */
+	const char *local_name;
+	/**
+	 * @brief Interned namespace prefix of the attribute or NULL.
+	 */
+	const char *prefix;
 };
 
+/**
+ * @brief Memory shared between DOM trees.
+ *
+ * This is an opaque structure used internally by the library to keep track
+ * of names, attributes and data that are shared by several trees.
+ *
+ * @see dom_clone().
+ */
+typedef struct dom_storage_s dom_storage_t;
+
+/**
+ * @brief Structural index of a tree.
+ *
+ * This is an opaque structure shared by the nodes numbered by
+ * dom_build_structure_index().
+ */
+typedef struct dom_index_s dom_index_t;
+
+/**
+ * @brief Key index of a tree.
+ *
+ * This is an opaque structure that maps values of an attribute to the
+ * elements that have them.
+ *
+ * @see dom_build_key_index().
+ */
+typedef struct dom_key_index_s dom_key_index_t;
+
 /**
  * @brief This structure contains information about an XML node.
  *
@@ -137,7 +193,7 @@ struct dom_s{
 	/**
 	 * @brief Length of the data in field @c data.
 	 */
-	int data_len;
+	size_t data_len;
 	/**
 	 * @brief Pointer to user data that is wrapped in CDATA tag.
 	 */
@@ -145,7 +201,7 @@ struct dom_s{
 	/**
 	 * @brief Length of the data in field @c user_data.
 	 */
-	int user_data_len;
+	size_t user_data_len;
 
 	/**
 	 * @brief Always 1 for well-formed XML files.
@@ -163,6 +219,96 @@ struct dom_s{
 	 * @brief Pointer to the next sibling.
 	 */
 	dom_t *next;
+	/**
+	 * @brief Pointer to the last child node.
+	 *
+	 * This field and field @c child_count are maintained by the parser and
+	 * by the functions that change the tree, such as dom_append_child().
+	 * If you link nodes into the tree manually, update them as well.
+	 */
+	dom_t *last;
+	/**
+	 * @brief Number of child nodes.
+	 */
+	int child_count;
+	/**
+	 * @brief Internal: storage of the fields this node shares with other
+	 * trees, or NULL. Do not modify.
+	 *
+	 * The fields @c name, @c attr and @c data of a node that was cloned with
+	 * dom_clone() are shared with the clone, and @c data of a node parsed
+	 * with @c DOM_PARSE_BORROW may point into the input. Shared memory is freed by
+	 * dom_free() when the last tree using it is freed. To change a shared
+	 * field, assign it a newly allocated value, never free or modify the
+	 * old one in place.
+	 */
+	dom_storage_t *storage;
+	/**
+	 * @brief Interned namespace URI of the node or NULL.
+	 *
+	 * This field and fields @c local_name and @c prefix are set only if
+	 * the document is parsed with @c DOM_PARSE_NAMESPACES flag. Interned
+	 * URIs are equal if and only if the pointers are equal.
+	 * @see dom_ns_intern().
+	 */
+	const char *ns;
+	/**
+	 * @brief Interned local part of the node name.
+	 */
+	const char *local_name;
+	/**
+	 * @brief Interned namespace prefix of the node or NULL.
+	 */
+	const char *prefix;
+	/**
+	 * @brief Earlier node with the identical subtree, or NULL.
+	 *
+	 * Set only if the document is parsed with @c DOM_PARSE_DEDUP flag. The
+	 * node shares name, attributes, data and children with that node, so
+	 * field @c parent of the children points to that node rather than to
+	 * this one. Keep track of the path when walking up from such children.
+	 */
+	dom_t *alias;
+	/**
+	 * @brief Internal: cached value of dom_hash() with no flags, 0 if it is
+	 * not computed yet. Do not modify.
+	 */
+	uint64_t hash;
+
+	/**
+	 * @brief Preorder number of the node, starting with 1 at the root.
+	 *
+	 * This field and fields @c post, @c depth, @c size and @c skip are
+	 * set by dom_build_structure_index() or by the parser with
+	 * @c DOM_PARSE_INDEX. They describe the tree as it was when they were
+	 * set; after the tree is changed they are stale.
+	 */
+	int pre;
+	/**
+	 * @brief Postorder number of the node, starting with 1.
+	 */
+	int post;
+	/**
+	 * @brief Depth of the node, 0 at the root.
+	 */
+	int depth;
+	/**
+	 * @brief Number of descendants of the node.
+	 */
+	int size;
+	/**
+	 * @brief The first node after the subtree of this node in document
+	 * order, or NULL.
+	 *
+	 * A scan of the tree in document order moves from a node to its first
+	 * child or, to jump over the subtree, to @c skip.
+	 */
+	dom_t *skip;
+	/**
+	 * @brief Internal: structural index the numbers belong to. Do not
+	 * modify.
+	 */
+	dom_index_t *index;
 };
 
 
@@ -223,159 +369,348 @@ dom_attr_t *dom_attr_free(dom_attr_t *attr);
 dom_t *dom_free(void *dom);
 
 /**
- * @brief Read DOM tree from previously opened XML file.
+ * @brief Create a copy of a DOM tree.
  *
- * The function reads and parses opened XML file.
- * The file must be opened with @c O_RDONLY or @c O_RDWR permission.
- * The function reads all the data from the file determined by file descriptor
- * and tries to parse it as XML data. If this operation succeeds, the function
- * returns a pointer to the newly created @c dom_t structure. Otherwise NULL is
- * returned and errno is set.
+ * The function creates a copy of the node @c dom and all its children. Next
+ * siblings of @c dom are not copied, the copy has no parent and no siblings.
+ *
+ * Only the @c dom_t structures are allocated for the copy. Node names,
+ * attributes and data are not copied, they are shared with the source tree
+ * and freed when both trees are freed, in any order. This makes cloning of a
+ * template tree much cheaper than parsing the template again.
+ *
+ * Shared names, attributes and data must be treated as read-only. To change
+ * them in one of the trees, assign a new value to the field, see the field
+ * @c storage of @c dom_t.
+ *
+ * Several threads may clone the same tree at the same time provided that the
+ * tree is not changed or freed while it is being cloned.
  *
  * @par Example:
- * See dom_parse_file_name() for examples.
+ * @code
+dom_t *template=dom_parse_file_name( "response.xml");
+dom_t *response;
+
+while( next_request()){
+	if(( response=dom_clone( template))){
+		//fill in the response and send it
+		dom_free( response);
+	}
+}
+dom_free( template);
+ * @endcode
  *
- * @param fd Previously opened file descriptor of the file to be read
- * @return Pointer to newly allocated dom_t structure is returned if no
- * 	error occurred. The user must free the allocated data when it is not used by
- * 	means of function dom_free(). If error occurs, the function returns NULL
- * 	and sets errno to the following values:
+ * @param dom Pointer to the node to copy.
+ * @return Pointer to the copy of the tree. The user must free the copy with
+ * 	dom_free(). If an error occurs, the function returns NULL and sets errno
+ * 	to the following values:
  * 		@li @c ENOMEM Not enough memory.
- * 		@li @c EINVAL Parse error. The opened file does not contain valid XML file or
- * 		        the XML file is not well-formed.
+ * 		@li @c EINVAL @c dom is NULL.
  */
-dom_t *dom_parse_file(int fd);
+dom_t *dom_clone(dom_t *dom);
 
 /**
- * @brief Read DOM tree from a file specified by name.
+ * @brief Move a tree into one contiguous block of memory.
  *
- * The function opens and parses XML file. If this operation succeeds,
- * the function returns a pointer to the newly created @c dom_t structure.
- * Otherwise NULL is returned and errno is set.
+ * The function copies the tree into a single block in preorder: first the
+ * nodes, then the attributes, then the names, values and data. Field
+ * @c data of every node is cut down to its @c user_data range, so white
+ * space around the data is not kept and @c data is equal to @c user_data.
+ * The source tree is freed. Use the function for trees that are kept in
+ * memory for a long time, such as configuration.
+ *
+ * The returned tree is used and freed as any other tree. It may be changed
+ * with the functions like dom_set_attr() and dom_append_child(), but the
+ * memory of the block is released only when all its nodes are freed.
  *
  * @par Example:
  * @code
-#include <stdio.h>
-#include <stdlib.h>
-#include <errno.h>
-#include <string.h>
-#include "expat-dom.h"
-
-int main( int argc, char *argv[]){
-	dom_t *dom, *node;
-	dom_attr_t *attr;
-
-	if( NULL ==(dom=dom_parse_file_name( "movies.xml"))){
-		fprintf( stderr, "Parse XML error: %s\n", strerror( errno));
-		return 1;
+long before, after;
 
-	}else{
-		if(( node=dom_find_node( dom, "movie"))){
-			attr=node->attr;
+config=dom_compact( config, &before, &after);
+printf( "configuration uses %ld bytes instead of %ld\n", after, before);
+ * @endcode
+ *
+ * @param dom Pointer to the root of the tree.
+ * @param bytes_before If not NULL, receives approximate size of the tree
+ * 	before compaction, including typical overhead of malloc().
+ * @param bytes_after If not NULL, receives size of the compacted tree
+ * 	estimated the same way.
+ * @return Pointer to the root of the compacted tree. Pointers to the nodes
+ * 	of the source tree are not valid anymore. If error occurs, the function
+ * 	returns NULL, sets errno and leaves the source tree intact:
+ * 		@li @c EINVAL @c dom is NULL or is not a root.
+ * 		@li @c ENOMEM Not enough memory.
+ */
+dom_t *dom_compact(dom_t *dom, long *bytes_before, long *bytes_after);
 
-			printf("Node attributes:\n");
-			while( attr){
-				printf(" %s='%s'%c", attr->var, attr->val, attr->next? ',' : '\n');
-				attr=attr->next;
-			}
+/**
+ * @brief Read-only tree shared by threads and replaced while it is read.
+ *
+ * A snapshot keeps the current version of a tree, for example rules that
+ * are reloaded from time to time. Readers get the current tree without
+ * locks and without blocking, while another thread publishes a new version.
+ * A replaced tree is freed when no reader holds it. Readers must not
+ * change the trees.
+ *
+ * @par Example:
+ * @code
+dom_snapshot_t *rules;
 
-			printf("Node children:\n");
-			node=node->child;
-			while( node){
-				printf(" %s%c", node->name, node->next? ',' : '\n');
-				node=node->next;
-			}
+//reload thread
+dom_snapshot_publish( rules, dom_parse_file_name( "rules.xml"));
 
-		}else{
-			fprintf( stderr, "Could not find root node\n");
-		}
-		dom_free( dom);
-		return 0;
-	}
+//every reader thread
+dom_snapshot_reader_t *reader=dom_snapshot_reader( rules);
+while( next_request()){
+	dom_t *dom=dom_snapshot_acquire( reader);
+	route( dom_find_node( dom, "route"));
+	dom_snapshot_release( reader);
 }
+dom_snapshot_reader_free( reader);
  * @endcode
+ */
+typedef struct dom_snapshot_s dom_snapshot_t;
+
+/**
+ * @brief Reader of a snapshot.
  *
- * @par
- * In order to successfully build and run this code you will have to
- * copy the following code into a file @e movies.xml.
+ * A reader is used by one thread at a time. It holds at most one tree, the
+ * one returned by the last call to dom_snapshot_acquire().
+ */
+typedef struct dom_snapshot_reader_s dom_snapshot_reader_t;
+
+/**
+ * @brief Create a snapshot.
  *
- * @par
- * @verbatim
-<?xml version='1.0'?>
-<movies>
-	<movie title="The Shawshank Redemption" year="1994" length="142" rating="9.2">
-		<characters>
-			<character>
-				<name>Andy Dufresne</name>
-				<actor>Tim Robbins</actor>
-			</character>
-			<character>
-				<name>Ellis Boyd Redding</name>
-				<actor>Morgan Freeman</actor>
-			</character>
-		</characters>
-		<plot>
-			Two imprisoned men bond over a number of years, finding solace and
-			eventual redemption through acts of common decency.
-		</plot>
-		<quotes>
-			<quote>
-				District Attorney: Mr. Dufresne, describe the confrontation you
-				had with your wife the night that she was murdered.
-			</quote>
-		</quotes>
-	</movie>
-</movies>
-@endverbatim
+ * @param dom Initial tree, may be NULL. The snapshot takes ownership of the
+ * 	tree.
+ * @return Pointer to the snapshot, or NULL with errno set to @c ENOMEM.
+ */
+dom_snapshot_t *dom_snapshot_new(dom_t *dom);
+
+/**
+ * @brief Free a snapshot with all its trees.
  *
+ * The function must not be called while readers hold trees.
  *
- * @param name Full or relative path to the XML file.
- * @return Pointer to newly allocated @c dom_t structure is returned if no
- * 	error occurred. The user must free the allocated data when it is not used
- * 	with dom_free(). If error occurs, the function returns NULL and sets
- * 	errno to the following values:
- * 		@li @c ENOMEM Not enough memory.
- * 		@li @c EINVAL Parse error. The opened file does not contain valid XML
- * 		        file or the XML file is not well-formed.
- * 		@li Other codes may be returned.
+ * @param s Pointer to the snapshot, may be NULL.
+ * @return The function always returns NULL.
  */
-dom_t *dom_parse_file_name(char *name);
+dom_snapshot_t *dom_snapshot_free(dom_snapshot_t *s);
 
 /**
- * @brief Read DOM tree from a buffer.
+ * @brief Replace the current tree of a snapshot.
  *
- * The function parses passed buffer as XML. If this operation succeeds, the
- * function returns a pointer to the newly created @c dom_t structure. Otherwise
- * NULL is returned and errno is set.
+ * Readers that call dom_snapshot_acquire() after the function returns get
+ * the new tree. The old tree is freed by this or by a later call to
+ * dom_snapshot_publish() or dom_snapshot_reclaim(), when no reader holds
+ * it. Publishers are serialized, readers are never blocked.
+ *
+ * @param s Pointer to the snapshot.
+ * @param dom New tree, may be NULL. The snapshot takes ownership of the tree.
+ * @return 0, or error code @c EINVAL or @c ENOMEM. If an error occurs, the
+ * 	current tree is not changed.
+ */
+int dom_snapshot_publish(dom_snapshot_t *s, dom_t *dom);
+
+/**
+ * @brief Free replaced trees that are not held by readers.
+ *
+ * @param s Pointer to the snapshot.
+ * @return Number of replaced trees that are still held by readers.
+ */
+int dom_snapshot_reclaim(dom_snapshot_t *s);
+
+/**
+ * @brief Get a reader of a snapshot.
+ *
+ * Readers are cheap to use but not to get: get a reader once per thread.
+ * Memory of readers is kept until the snapshot is freed and is reused by
+ * new readers.
+ *
+ * @param s Pointer to the snapshot.
+ * @return Pointer to the reader, or NULL with errno set to @c EINVAL or
+ * 	@c ENOMEM.
+ */
+dom_snapshot_reader_t *dom_snapshot_reader(dom_snapshot_t *s);
+
+/**
+ * @brief Return a reader to the snapshot.
+ *
+ * The tree held by the reader is released.
+ *
+ * @param r Pointer to the reader, may be NULL.
+ */
+void dom_snapshot_reader_free(dom_snapshot_reader_t *r);
+
+/**
+ * @brief Get the current tree of a snapshot.
+ *
+ * The tree stays valid until dom_snapshot_release() or the next call to
+ * dom_snapshot_acquire() with the same reader. The function does not block
+ * and does not write to memory shared with other readers.
+ *
+ * @param r Pointer to the reader.
+ * @return The current tree, may be NULL if NULL was published.
+ */
+dom_t *dom_snapshot_acquire(dom_snapshot_reader_t *r);
+
+/**
+ * @brief Release the tree held by a reader.
+ *
+ * @param r Pointer to the reader.
+ */
+void dom_snapshot_release(dom_snapshot_reader_t *r);
+
+/**
+ * @brief Create a new element.
+ *
+ * The function allocates a new node with the specified name and no
+ * attributes, data or children. The node may be added to a tree with
+ * dom_append_child() or dom_insert_before().
  *
  * @par Example:
- * See example.c.
+ * @code
+dom_t *root, *item;
+int i;
+
+root=dom_new_element( "items");
+for( i=0; i<1000000; i++){
+	if(( item=dom_new_element( "item"))){
+		dom_set_attr( item, "id", "1");
+		dom_set_text( item, "Hello", 5);
+		dom_append_child( root, item);
+	}
+}
+dom_print( stdout, root, 1);
+dom_free( root);
+ * @endcode
  *
- * @param buffer Pointer to a buffer containing well-formed XML data.
- * @param buffer_len Length of the data stored in buffer.
- * @return Pointer to newly allocated @c dom_t structure is returned if no
- * 	error occurred. User must free the allocated data with dom_free() when it is
- * 	not used. If error occurs, the function returns NULL and sets
- * 	errno to the following values:
+ * @param name Pointer to a NULL-terminated string with the name of the node.
+ * @return Pointer to the new node. The user must free it with dom_free()
+ * 	unless it is added to a tree that is freed. If an error occurs, the
+ * 	function returns NULL and sets errno to the following values:
  * 		@li @c ENOMEM Not enough memory.
- * 		@li @c EINVAL Parse error. The buffer does not contain valid XML data or
- * 		        the XML data is not well-formed.
+ * 		@li @c EINVAL @c name is NULL.
  */
-dom_t *dom_parse_buffer(const char *buffer, int buffer_len);
+dom_t *dom_new_element(const char *name);
 
 /**
- * @brief Parse XML data in chunks.
+ * @brief Append a node to the list of children.
+ *
+ * The function adds @c child after the last child of @c parent. This takes
+ * constant time regardless of the number of children.
+ *
+ * @param parent Pointer to the parent node.
+ * @param child Pointer to a node to append. The node must not be a part of
+ * 	any tree, remove it with dom_remove() first if it is.
+ * @return The function returns 0 when succeeds. If an error occurs, the
+ * 	function returns error code:
+ * 		@li @c EINVAL @c parent or @c child is NULL, or @c child is a part of
+ * 		        a tree.
+ */
+int dom_append_child(dom_t *parent, dom_t *child);
+
+/**
+ * @brief Insert a node before another child node.
+ *
+ * The function adds @c child to the children of @c parent immediately
+ * before the node @c ref. If @c ref is NULL, the node is appended as
+ * dom_append_child() does.
+ *
+ * @param parent Pointer to the parent node.
+ * @param child Pointer to a node to insert. The node must not be a part of
+ * 	any tree, remove it with dom_remove() first if it is.
+ * @param ref Pointer to a child of @c parent or NULL.
+ * @return The function returns 0 when succeeds. If an error occurs, the
+ * 	function returns error code:
+ * 		@li @c EINVAL @c parent or @c child is NULL, @c child is a part of
+ * 		        a tree or @c ref is not a child of @c parent.
+ */
+int dom_insert_before(dom_t *parent, dom_t *child, dom_t *ref);
+
+/**
+ * @brief Remove a node from its tree.
  *
- * The function parses part of the XML data.
- * The function should be used in cases when not all XML data is available
- * immediately. The function allows user to parse data partially. If this
- * operation succeeds, the function returns 0 and sets parser and DOM variables.
- * Otherwise error is returned.
+ * The function unlinks the node from its parent and siblings. The node
+ * keeps its attributes, data and children. The removed node must be freed
+ * with dom_free() or added to a tree again.
  *
- * This function is used when the length of the buffer with XML data is not
- * known when the first part of the buffer is available. This function may be
- * used in loops when data is received from network or other source in chunks.
- * See example below.
+ * @param node Pointer to the node to remove.
+ * @return Pointer to the removed node. If @c node is not among the children
+ * 	of its parent, the tree is not changed, the function returns NULL and
+ * 	sets errno to @c EINVAL.
+ */
+dom_t *dom_remove(dom_t *node);
+
+/**
+ * @brief Set value of an attribute.
+ *
+ * The function sets value of the attribute @c var of the node. If the node
+ * has no such attribute, the attribute is appended to the end of the list.
+ * If @c val is NULL, the attribute is removed. Attribute names are compared
+ * case-insensitively as dom_find_attr() does.
+ *
+ * @param node Pointer to the node.
+ * @param var Pointer to a NULL-terminated string with the attribute name.
+ * @param val Pointer to a NULL-terminated string with the attribute value,
+ * 	or NULL.
+ * @return The function returns 0 when succeeds. If an error occurs, the
+ * 	function returns error code:
+ * 		@li @c ENOMEM Not enough memory.
+ * 		@li @c EINVAL @c node or @c var is NULL.
+ */
+int dom_set_attr(dom_t *node, const char *var, const char *val);
+
+/**
+ * @brief Set data of a node.
+ *
+ * The function replaces data of the node with a copy of @c text. Both
+ * @c data and @c user_data of the node point to the new value.
+ *
+ * @param node Pointer to the node.
+ * @param text Pointer to a buffer with the new data. The data is not
+ * 	required to be NULL-terminated. If @c text is NULL, data of the node is
+ * 	removed.
+ * @param text_len Length of the data stored in @c text.
+ * @return The function returns 0 when succeeds. If an error occurs, the
+ * 	function returns error code:
+ * 		@li @c ENOMEM Not enough memory.
+ * 		@li @c EINVAL @c node is NULL.
+ */
+int dom_set_text(dom_t *node, const char *text, size_t text_len);
+
+/**
+ * @brief Streaming XML writer.
+ *
+ * This is an opaque structure that holds the state of the writer. The writer
+ * produces XML data into its output buffer without building DOM tree. When
+ * the buffer is full, it is passed to the output callback or written to a
+ * file. The memory used by the writer is limited by the size of its buffer
+ * and the names of currently open elements.
+ *
+ * @see dom_writer_new().
+ */
+typedef struct dom_writer_s dom_writer_t;
+
+/**
+ * @brief Output callback of the streaming XML writer.
+ *
+ * @param ctx Pointer passed to dom_writer_new().
+ * @param buffer Pointer to the data to write.
+ * @param buffer_len Length of the data in @c buffer.
+ * @return The callback must return 0 when succeeds. Otherwise it must return
+ * 	an error code, the code is returned by all the following writer calls.
+ */
+typedef int (*dom_write_cb)(void *ctx, const char *buffer, size_t buffer_len);
+
+/**
+ * @brief Create streaming XML writer with output callback.
+ *
+ * The function creates a writer that passes produced XML data to the
+ * callback @c write each time its buffer is full and when dom_writer_flush()
+ * is called.
  *
  * @par Example:
  * @code
@@ -386,7 +721,513 @@ dom_t *dom_parse_buffer(const char *buffer, int buffer_len);
 #include "expat-dom.h"
 
 int main( int argc, char *argv[]){
-	int count;
+	dom_writer_t *w;
+	char id[32];
+	int i;
+	int ret;
+
+	if( NULL==(w=dom_writer_new_fd( 1, 0))){
+		fprintf( stderr, "Writer error: %s\n", strerror( errno));
+		return 1;
+	}
+	dom_writer_start_element( w, "items");
+	for( i=0; i<1000000; i++){
+		snprintf( id, sizeof( id), "%d", i);
+		dom_writer_start_element( w, "item");
+		dom_writer_attr( w, "id", id);
+		dom_writer_text( w, "Fish & Chips", 12);
+		dom_writer_end_element( w);
+	}
+	dom_writer_end_element( w);
+	ret=dom_writer_flush( w);
+	dom_writer_free( w);
+	if( ret){
+		fprintf( stderr, "Write error: %s\n", strerror( ret));
+		return 1;
+	}
+	return 0;
+}
+ * @endcode
+ *
+ * @param write Output callback.
+ * @param ctx Pointer passed to the callback.
+ * @param buffer_size Size of the output buffer, or 0 for default size of
+ * 	64 KB.
+ * @return Pointer to the new writer. The user must free it with
+ * 	dom_writer_free(). If an error occurs, the function returns NULL and sets
+ * 	errno to the following values:
+ * 		@li @c ENOMEM Not enough memory.
+ * 		@li @c EINVAL @c write is NULL or @c buffer_size is negative.
+ */
+dom_writer_t *dom_writer_new(dom_write_cb write, void *ctx, int buffer_size);
+
+/**
+ * @brief Create streaming XML writer that writes to a file.
+ *
+ * The function creates a writer that writes produced XML data to the file
+ * descriptor @c fd. The file descriptor is not closed by the writer.
+ *
+ * @par Example:
+ * See dom_writer_new() for examples.
+ *
+ * @param fd File descriptor opened for writing.
+ * @param buffer_size Size of the output buffer, or 0 for default size of
+ * 	64 KB.
+ * @return Pointer to the new writer, see dom_writer_new().
+ */
+dom_writer_t *dom_writer_new_fd(int fd, int buffer_size);
+
+/**
+ * @brief Free streaming XML writer.
+ *
+ * The function frees the writer. Data that was not flushed with
+ * dom_writer_flush() is discarded.
+ *
+ * @param w Pointer to the writer.
+ * @return Returns NULL always.
+ */
+dom_writer_t *dom_writer_free(dom_writer_t *w);
+
+/**
+ * @brief Write start tag of an element.
+ *
+ * The start tag is left open, so attributes may be added with
+ * dom_writer_attr(). If the element has no content, it is written as an
+ * empty element tag, for example @c &lt;item/&gt;.
+ *
+ * @param w Pointer to the writer.
+ * @param name Pointer to a NULL-terminated string with the element name.
+ * @return The function returns 0 when succeeds. If an error occurs, the
+ * 	function returns error code:
+ * 		@li @c ENOMEM Not enough memory.
+ * 		@li @c EINVAL @c w or @c name is NULL or @c name is empty.
+ * 		@li Error returned by the output callback or by write().
+ */
+int dom_writer_start_element(dom_writer_t *w, const char *name);
+
+/**
+ * @brief Write attribute of an element.
+ *
+ * The function must be called right after dom_writer_start_element() or
+ * another dom_writer_attr(). Special XML characters in the value are
+ * escaped with escape_xml_r().
+ *
+ * @param w Pointer to the writer.
+ * @param var Pointer to a NULL-terminated string with the attribute name.
+ * @param val Pointer to a NULL-terminated string with the attribute value.
+ * @return The function returns 0 when succeeds. If an error occurs, the
+ * 	function returns error code:
+ * 		@li @c EINVAL Invalid argument or the start tag is already closed.
+ * 		@li Error returned by the output callback or by write().
+ */
+int dom_writer_attr(dom_writer_t *w, const char *var, const char *val);
+
+/**
+ * @brief Write data of an element.
+ *
+ * Special XML characters in the data are escaped with escape_xml_r().
+ *
+ * @param w Pointer to the writer.
+ * @param text Pointer to the data, not required to be NULL-terminated.
+ * @param text_len Length of the data in @c text.
+ * @return The function returns 0 when succeeds. If an error occurs, the
+ * 	function returns error code:
+ * 		@li @c EINVAL Invalid argument or no element is open.
+ * 		@li Error returned by the output callback or by write().
+ */
+int dom_writer_text(dom_writer_t *w, const char *text, size_t text_len);
+
+/**
+ * @brief Write data of an element as CDATA section.
+ *
+ * The data is written as is. If the data contains @c ]]&gt;, the section is
+ * split in two.
+ *
+ * @param w Pointer to the writer.
+ * @param text Pointer to the data, not required to be NULL-terminated.
+ * @param text_len Length of the data in @c text.
+ * @return The function returns 0 when succeeds. If an error occurs, the
+ * 	function returns error code:
+ * 		@li @c EINVAL Invalid argument or no element is open.
+ * 		@li Error returned by the output callback or by write().
+ */
+int dom_writer_cdata(dom_writer_t *w, const char *text, size_t text_len);
+
+/**
+ * @brief Write end tag of the innermost open element.
+ *
+ * @param w Pointer to the writer.
+ * @return The function returns 0 when succeeds. If an error occurs, the
+ * 	function returns error code:
+ * 		@li @c EINVAL @c w is NULL or no element is open.
+ * 		@li Error returned by the output callback or by write().
+ */
+int dom_writer_end_element(dom_writer_t *w);
+
+/**
+ * @brief Pass buffered data to the output.
+ *
+ * Call this function when the document is complete, before
+ * dom_writer_free(). Once an output error occurs, the writer stops writing
+ * and all its functions return the error.
+ *
+ * @param w Pointer to the writer.
+ * @return The function returns 0 when succeeds. If an error occurs, the
+ * 	function returns error code:
+ * 		@li @c EINVAL @c w is NULL.
+ * 		@li Error returned by the output callback or by write().
+ */
+int dom_writer_flush(dom_writer_t *w);
+
+/**
+ * @brief Drop text that consists of white space only.
+ *
+ * Character data between two tags, such as new lines and indentation of
+ * pretty-printed XML, is not stored if it contains nothing but white space.
+ * Data of elements like @c <a>   </a> is dropped as well.
+ */
+#define DOM_PARSE_SKIP_BLANK 0x1
+/**
+ * @brief Trim data of elements at parse time.
+ *
+ * Leading and trailing white space of field @c data is not stored. White
+ * space that is a part of CDATA section is kept.
+ */
+#define DOM_PARSE_TRIM 0x2
+/**
+ * @brief Keep only the @c user_data part of the data.
+ *
+ * Field @c data of every node contains the same bytes as field
+ * @c user_data, the rest of the data is freed when the element is closed.
+ */
+#define DOM_PARSE_USER_DATA_ONLY 0x4
+/**
+ * @brief Refuse documents with document type declaration.
+ *
+ * Parsing fails with @c EPERM if the document contains @c <!DOCTYPE>. Use
+ * this flag for input from untrusted sources, since entities declared in a
+ * DTD can expand to large amounts of data.
+ */
+#define DOM_PARSE_NO_DTD 0x8
+/**
+ * @brief Refuse external entities.
+ *
+ * Parsing fails with @c EPERM if the document declares or references an
+ * external entity. The library never loads external entities, but without
+ * this flag references to them are silently skipped.
+ */
+#define DOM_PARSE_NO_EXTERNAL_ENTITIES 0x10
+/**
+ * @brief Parse the document with namespace processing.
+ *
+ * Fields @c ns, @c local_name and @c prefix of nodes and attributes are set.
+ * Field @c name keeps the qualified name, such as @c soap:Envelope, and the
+ * namespace declarations are kept as @c xmlns attributes, so the tree is
+ * printed as it was read. Use dom_find_node_ns() and dom_find_attr_ns()
+ * to find nodes and attributes regardless of the prefixes used in the
+ * document.
+ */
+#define DOM_PARSE_NAMESPACES 0x20
+/**
+ * @brief Share identical subtrees.
+ *
+ * Every element is compared with the elements closed before it. If its
+ * subtree, including names, attributes and data, is identical to one seen
+ * earlier, its own copy is freed and the node becomes an alias that
+ * shares name, attributes, data and children with the earlier node, see
+ * field @c alias. Documents that repeat the same fragments many times take
+ * several times less memory.
+ *
+ * The tree is read-only: do not change it with dom_append_child() and
+ * the other editing functions, and free it only as a whole. dom_clone()
+ * and dom_compact() make a tree without shared subtrees.
+ */
+#define DOM_PARSE_DEDUP 0x40
+/**
+ * @brief Compute dom_hash() of every element when it is closed.
+ *
+ * The hash of an element is computed from the cached hashes of its
+ * children, so hashing the whole tree costs one pass over names,
+ * attributes and data while the tree is still in the cache.
+ */
+#define DOM_PARSE_HASH 0x80
+/**
+ * @brief Let data of nodes point into the input instead of copying it.
+ *
+ * Text that appears in the input verbatim is not copied: fields @c data
+ * and @c user_data of the node point into the input. Only text that expat
+ * had to decode, such as text with references, with CR LF line ends or in
+ * another encoding than UTF-8, is copied. A tree of a text-heavy document
+ * then takes little memory besides the input itself. Names and attribute
+ * values are always copied, since they are NULL-terminated strings.
+ *
+ * With dom_parse_buffer_ex() the buffer must stay valid and unchanged until
+ * the tree and all its clones are freed. dom_parse_file_ex() and
+ * dom_parse_file_name_ex() map a regular uncompressed file into memory and
+ * unmap it when the last tree using it is freed; the file must not be
+ * truncated meanwhile. Other files and dom_parse_chunked_data_ex() ignore
+ * the flag. Never change borrowed data in place, use dom_set_text().
+ */
+#define DOM_PARSE_BORROW 0x100
+/**
+ * @brief Build the structural index while parsing.
+ *
+ * Same as calling dom_build_structure_index() for the parsed tree, but
+ * without another pass over it. Ignored with @c DOM_PARSE_DEDUP.
+ */
+#define DOM_PARSE_INDEX 0x200
+
+/**
+ * @brief Options of the parser.
+ *
+ * The structure is passed to dom_parse_file_ex(), dom_parse_file_name_ex(),
+ * dom_parse_buffer_ex() and dom_parse_chunked_data_ex(). Initialize it with
+ * zeros and set the fields you need: zero value of a field means default
+ * behaviour. The functions without @c _ex suffix use default options.
+ *
+ * The limits are checked while the document is parsed, so parsing of
+ * hostile input stops as soon as a limit is exceeded. In that case the
+ * functions fail with error code @c E2BIG.
+ *
+ * @par Example:
+ * @code
+dom_parse_options_t options;
+
+memset( &options, 0, sizeof( options));
+options.flags=DOM_PARSE_SKIP_BLANK | DOM_PARSE_TRIM | DOM_PARSE_NO_DTD;
+options.max_input_bytes=1024*1024;
+options.max_depth=64;
+dom=dom_parse_file_name_ex( "feed.xml", &options);
+ * @endcode
+ */
+typedef struct dom_parse_options_s dom_parse_options_t;
+struct dom_parse_options_s{
+	/**
+	 * @brief Combination of @c DOM_PARSE_* flags.
+	 *
+	 * Nodes whose data becomes empty have both @c data and @c user_data set
+	 * to NULL. With any of @c DOM_PARSE_SKIP_BLANK, @c DOM_PARSE_TRIM and
+	 * @c DOM_PARSE_USER_DATA_ONLY set, data of closed elements is
+	 * reallocated to its exact length.
+	 */
+	int flags;
+	/**
+	 * @brief Maximum number of bytes of XML input, 0 for no limit.
+	 *
+	 * For compressed files the limit applies to the decompressed data.
+	 */
+	int64_t max_input_bytes;
+	/**
+	 * @brief Maximum nesting level of elements, 0 for no limit.
+	 *
+	 * The root element is at level 1.
+	 */
+	int max_depth;
+	/**
+	 * @brief Maximum number of elements in the tree, 0 for no limit.
+	 */
+	int max_nodes;
+	/**
+	 * @brief Maximum number of attributes of an element, 0 for no limit.
+	 */
+	int max_attrs;
+	/**
+	 * @brief Maximum approximate size of the tree in bytes, 0 for no limit.
+	 *
+	 * The size includes the nodes, names, attributes and data, including
+	 * data produced by expansion of entities, and namespace declarations and
+	 * interned strings with @c DOM_PARSE_NAMESPACES.
+	 */
+	int64_t max_tree_bytes;
+	/**
+	 * @brief Key index the parsed elements are added to, or NULL.
+	 *
+	 * Elements are added as they start, so the tree is indexed without
+	 * another pass over it; with @c DOM_PARSE_DEDUP they are added when the
+	 * root element is closed. If the parse fails, the elements added by it
+	 * are removed from the index again.
+	 *
+	 * @see dom_key_index_new().
+	 */
+	dom_key_index_t *key_index;
+};
+
+/**
+ * @brief Read DOM tree from previously opened XML file.
+ *
+ * The function reads and parses opened XML file.
+ * The file must be opened with @c O_RDONLY or @c O_RDWR permission.
+ * The function reads all the data from the file determined by file descriptor
+ * and tries to parse it as XML data. If this operation succeeds, the function
+ * returns a pointer to the newly created @c dom_t structure. Otherwise NULL is
+ * returned and errno is set.
+ *
+ * Compressed input is recognized by its magic bytes. If the library is
+ * configured with @c --with-zlib or @c --with-zstd, gzip and zstd streams are
+ * decompressed block by block straight into the parser buffer, so no
+ * decompressed copy of the whole file is ever kept in memory.
+ *
+ * @par Example:
+ * See dom_parse_file_name() for examples.
+ *
+ * @param fd Previously opened file descriptor of the file to be read
+ * @return Pointer to newly allocated dom_t structure is returned if no
+ * 	error occurred. The user must free the allocated data when it is not used by
+ * 	means of function dom_free(). If error occurs, the function returns NULL
+ * 	and sets errno to the following values:
+ * 		@li @c ENOMEM Not enough memory.
+ * 		@li @c EINVAL Parse error. The opened file does not contain valid XML file or
+ * 		        the XML file is not well-formed, or compressed data is corrupt.
+ * 		@li @c ENOTSUP The file is compressed and the library was built without
+ * 		        support for this compression format.
+ */
+dom_t *dom_parse_file(int fd);
+
+/**
+ * @brief Read DOM tree from a file specified by name.
+ *
+ * The function opens and parses XML file. If this operation succeeds,
+ * the function returns a pointer to the newly created @c dom_t structure.
+ * Otherwise NULL is returned and errno is set. Compressed files, such as
+ * @e feed.xml.gz or @e feed.xml.zst, are handled as described in
+ * dom_parse_file().
+ *
+ * @par Example:
+ * @code
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include "expat-dom.h"
+
+int main( int argc, char *argv[]){
+	dom_t *dom, *node;
+	dom_attr_t *attr;
+
+	if( NULL ==(dom=dom_parse_file_name( "movies.xml"))){
+		fprintf( stderr, "Parse XML error: %s\n", strerror( errno));
+		return 1;
+
+	}else{
+		if(( node=dom_find_node( dom, "movie"))){
+			attr=node->attr;
+
+			printf("Node attributes:\n");
+			while( attr){
+				printf(" %s='%s'%c", attr->var, attr->val, attr->next? ',' : '\n');
+				attr=attr->next;
+			}
+
+			printf("Node children:\n");
+			node=node->child;
+			while( node){
+				printf(" %s%c", node->name, node->next? ',' : '\n');
+				node=node->next;
+			}
+
+		}else{
+			fprintf( stderr, "Could not find root node\n");
+		}
+		dom_free( dom);
+		return 0;
+	}
+}
+ * @endcode
+ *
+ * @par
+ * In order to successfully build and run this code you will have to
+ * copy the following code into a file @e movies.xml.
+ *
+ * @par
+ * @verbatim
+<?xml version='1.0'?>
+<movies>
+	<movie title="The Shawshank Redemption" year="1994" length="142" rating="9.2">
+		<characters>
+			<character>
+				<name>Andy Dufresne</name>
+				<actor>Tim Robbins</actor>
+			</character>
+			<character>
+				<name>Ellis Boyd Redding</name>
+				<actor>Morgan Freeman</actor>
+			</character>
+		</characters>
+		<plot>
+			Two imprisoned men bond over a number of years, finding solace and
+			eventual redemption through acts of common decency.
+		</plot>
+		<quotes>
+			<quote>
+				District Attorney: Mr. Dufresne, describe the confrontation you
+				had with your wife the night that she was murdered.
+			</quote>
+		</quotes>
+	</movie>
+</movies>
+@endverbatim
+ *
+ *
+ * @param name Full or relative path to the XML file.
+ * @return Pointer to newly allocated @c dom_t structure is returned if no
+ * 	error occurred. The user must free the allocated data when it is not used
+ * 	with dom_free(). If error occurs, the function returns NULL and sets
+ * 	errno to the following values:
+ * 		@li @c ENOMEM Not enough memory.
+ * 		@li @c EINVAL Parse error. The opened file does not contain valid XML
+ * 		        file or the XML file is not well-formed.
+ * 		@li @c ENOTSUP The file is compressed and the library was built without
+ * 		        support for this compression format.
+ * 		@li Other codes may be returned.
+ */
+dom_t *dom_parse_file_name(char *name);
+
+/**
+ * @brief Read DOM tree from a buffer.
+ *
+ * The function parses passed buffer as XML. If this operation succeeds, the
+ * function returns a pointer to the newly created @c dom_t structure. Otherwise
+ * NULL is returned and errno is set.
+ *
+ * @par Example:
+ * See example.c.
+ *
+ * @param buffer Pointer to a buffer containing well-formed XML data.
+ * @param buffer_len Length of the data stored in buffer.
+ * @return Pointer to newly allocated @c dom_t structure is returned if no
+ * 	error occurred. User must free the allocated data with dom_free() when it is
+ * 	not used. If error occurs, the function returns NULL and sets
+ * 	errno to the following values:
+ * 		@li @c ENOMEM Not enough memory.
+ * 		@li @c EINVAL Parse error. The buffer does not contain valid XML data or
+ * 		        the XML data is not well-formed.
+ */
+dom_t *dom_parse_buffer(const char *buffer, size_t buffer_len);
+
+/**
+ * @brief Parse XML data in chunks.
+ *
+ * The function parses part of the XML data.
+ * The function should be used in cases when not all XML data is available
+ * immediately. The function allows user to parse data partially. If this
+ * operation succeeds, the function returns 0 and sets parser and DOM variables.
+ * Otherwise error is returned.
+ *
+ * This function is used when the length of the buffer with XML data is not
+ * known when the first part of the buffer is available. This function may be
+ * used in loops when data is received from network or other source in chunks.
+ * See example below.
+ *
+ * @par Example:
+ * @code
+#include <stdio.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <string.h>
+#include "expat-dom.h"
+
+int main( int argc, char *argv[]){
+	int count;
 	char buffer[28];
 	dom_t *dom;
 	void *parser;
@@ -433,10 +1274,393 @@ int main( int argc, char *argv[]){
  * @return The function returns 0 when succeeds. If an error occurs, the function
  * 	returns error code:
  * 		@li @c ENOMEM Not enough memory.
- * 		@li @c EINVAL Parse error. The buffer does not contain valid XML data or
- * 		        the data is not well-formed XML data.
+ * 		@li @c EINVAL Parse error. The buffer does not contain valid XML data or
+ * 		        the data is not well-formed XML data.
+ */
+int dom_parse_chunked_data( void **parser, dom_t **dom, const char *buffer, size_t buffer_len, int isFinal);
+
+/**
+ * @brief Read DOM tree from previously opened XML file with options.
+ *
+ * Same as dom_parse_file(), but the document is parsed as specified by
+ * @c options.
+ *
+ * @param fd Previously opened file descriptor of the file to be read
+ * @param options Parser options, NULL for default.
+ * @return See dom_parse_file(). In addition the following error codes are
+ * 	used:
+ * 		@li @c E2BIG A limit set in @c options is exceeded.
+ * 		@li @c EPERM The document contains DTD or external entity refused
+ * 		        by @c options.
+ */
+dom_t *dom_parse_file_ex(int fd, const dom_parse_options_t *options);
+
+/**
+ * @brief Read DOM tree from a file specified by name with options.
+ *
+ * Same as dom_parse_file_name(), but the document is parsed as specified by
+ * @c options.
+ *
+ * @param name Name of the file to be parsed.
+ * @param options Parser options, NULL for default.
+ * @return See dom_parse_file_name(). In addition the following error codes are
+ * 	used:
+ * 		@li @c E2BIG A limit set in @c options is exceeded.
+ * 		@li @c EPERM The document contains DTD or external entity refused
+ * 		        by @c options.
+ */
+dom_t *dom_parse_file_name_ex(char *name, const dom_parse_options_t *options);
+
+/**
+ * @brief Read DOM tree from a buffer with options.
+ *
+ * Same as dom_parse_buffer(), but the document is parsed as specified by
+ * @c options.
+ *
+ * @param buffer Pointer to a buffer containing well-formed XML data.
+ * @param buffer_len Length of the data stored in buffer.
+ * @param options Parser options, NULL for default.
+ * @return See dom_parse_buffer(). In addition the following error codes are
+ * 	used:
+ * 		@li @c E2BIG A limit set in @c options is exceeded.
+ * 		@li @c EPERM The document contains DTD or external entity refused
+ * 		        by @c options.
+ */
+dom_t *dom_parse_buffer_ex(const char *buffer, size_t buffer_len, const dom_parse_options_t *options);
+
+/**
+ * @brief Parse XML data in chunks with options.
+ *
+ * Same as dom_parse_chunked_data(). The options are copied when the first
+ * chunk is parsed, later calls ignore them.
+ *
+ * @param parser Pointer to internal structure.
+ * @param dom Pointer to DOM structure that is created by the function.
+ * @param buffer Pointer to a buffer containing next part of XML data.
+ * @param buffer_len Length of the data stored in @c buffer.
+ * @param isFinal 1 for the last chunk, 0 otherwise.
+ * @param options Parser options, NULL for default.
+ * @return See dom_parse_chunked_data(). In addition the following error codes are
+ * 	used:
+ * 		@li @c E2BIG A limit set in @c options is exceeded.
+ * 		@li @c EPERM The document contains DTD or external entity refused
+ * 		        by @c options.
+ */
+int dom_parse_chunked_data_ex( void **parser, dom_t **dom, const char *buffer, size_t buffer_len, int isFinal,
+		const dom_parse_options_t *options);
+
+/**
+ * @brief Pull reader of XML data.
+ *
+ * This is an opaque structure that reads a document event by event without
+ * building a tree.
+ *
+ * @see dom_reader_next().
+ */
+typedef struct dom_reader_s dom_reader_t;
+
+/**
+ * @brief Event returned by dom_reader_next() at the end of the document.
+ */
+#define DOM_READER_EOF 0
+/**
+ * @brief Start of an element, with its name and attributes.
+ */
+#define DOM_READER_START 1
+/**
+ * @brief Character data between tags, CDATA sections included.
+ *
+ * All character data between two tags is returned as one event, with
+ * entities replaced.
+ */
+#define DOM_READER_TEXT 2
+/**
+ * @brief End of an element, with its name.
+ */
+#define DOM_READER_END 3
+
+/**
+ * @brief Event read by dom_reader_next().
+ *
+ * Strings of the event belong to the reader and stay valid until the next
+ * call of dom_reader_next() or dom_reader_free().
+ */
+typedef struct dom_reader_event_s dom_reader_event_t;
+struct dom_reader_event_s{
+	/**
+	 * @brief One of @c DOM_READER_* constants.
+	 */
+	int type;
+	/**
+	 * @brief Number of elements that enclose the event.
+	 *
+	 * The root element starts and ends at depth 0, its text is at depth 1.
+	 */
+	int depth;
+	/**
+	 * @brief Name of the element of @c DOM_READER_START and
+	 * @c DOM_READER_END events, otherwise NULL.
+	 */
+	const char *name;
+	/**
+	 * @brief Attributes of @c DOM_READER_START events, otherwise NULL.
+	 *
+	 * Names and values alternate and the array is terminated by NULL, as
+	 * expat passes them. See dom_reader_attr().
+	 */
+	const char **attrs;
+	/**
+	 * @brief Data of @c DOM_READER_TEXT events, not NULL-terminated,
+	 * otherwise NULL.
+	 */
+	const char *text;
+	/**
+	 * @brief Length of @c text.
+	 */
+	size_t text_len;
+};
+
+/**
+ * @brief Create pull reader that is given input by dom_reader_push().
+ *
+ * Of the options, flags @c DOM_PARSE_SKIP_BLANK, @c DOM_PARSE_NO_DTD and
+ * @c DOM_PARSE_NO_EXTERNAL_ENTITIES and limits @c max_input_bytes,
+ * @c max_depth, @c max_nodes and @c max_attrs are used. With
+ * @c DOM_PARSE_SKIP_BLANK text that consists of white space only is not
+ * returned.
+ *
+ * @param options Parser options, NULL for default.
+ * @return Pointer to the newly allocated reader, which must be freed by
+ * 	dom_reader_free(), or NULL and errno is set to @c ENOMEM.
+ */
+dom_reader_t *dom_reader_new(const dom_parse_options_t *options);
+
+/**
+ * @brief Create pull reader of an opened file.
+ *
+ * The file is read in blocks as the events are requested. It is not closed
+ * by the reader. Compressed files are not recognized.
+ *
+ * @param fd File descriptor opened for reading.
+ * @param options Parser options, NULL for default, see dom_reader_new().
+ * @return Pointer to the newly allocated reader or NULL and errno is set to
+ * 	@c EINVAL if @c fd is negative or to @c ENOMEM.
+ */
+dom_reader_t *dom_reader_new_fd(int fd, const dom_parse_options_t *options);
+
+/**
+ * @brief Create pull reader of a buffer.
+ *
+ * The buffer must stay valid until the reader is freed.
+ *
+ * @param buffer Pointer to XML data.
+ * @param buffer_len Length of the data.
+ * @param options Parser options, NULL for default, see dom_reader_new().
+ * @return Pointer to the newly allocated reader or NULL and errno is set to
+ * 	@c EINVAL if @c buffer is NULL or to @c ENOMEM.
+ */
+dom_reader_t *dom_reader_new_buffer(const char *buffer, size_t buffer_len, const dom_parse_options_t *options);
+
+/**
+ * @brief Give the next chunk of XML data to a reader.
+ *
+ * The reader must be created by dom_reader_new(). A chunk is given when
+ * dom_reader_next() fails with @c EAGAIN, and the buffer must stay valid
+ * until that happens again or the reader returns the last event.
+ *
+ * @par Example:
+ * @code
+reader=dom_reader_new( NULL);
+while( (len=recv( sock, buffer, sizeof( buffer), 0))>=0){
+	dom_reader_push( reader, buffer, len, len==0);
+	while( (type=dom_reader_next( reader, &event))>0){
+		process( &event);
+	}
+	if( type==DOM_READER_EOF || errno !=EAGAIN){
+		break;
+	}
+}
+dom_reader_free( reader);
+ * @endcode
+ *
+ * @param r Pointer to the reader.
+ * @param buffer Pointer to the chunk.
+ * @param buffer_len Length of the chunk.
+ * @param is_final 1 for the last chunk, 0 otherwise.
+ * @return 0 on success, otherwise error code:
+ * 		@li @c EINVAL The reader does not take chunks or the last chunk has
+ * 		        been given.
+ * 		@li @c EBUSY The previous chunk has not been read yet.
+ */
+int dom_reader_push(dom_reader_t *r, const char *buffer, size_t buffer_len, int is_final);
+
+/**
+ * @brief Read the next event.
+ *
+ * Expat is resumed until it reports the next element and suspended again,
+ * so memory is allocated only when an event is larger than any before.
+ *
+ * @par Example:
+ * Items of a feed are processed without building a tree.
+ * @code
+reader=dom_reader_new_buffer( xml, xml_len, NULL);
+while( (type=dom_reader_next( reader, &event))>0){
+	if( type==DOM_READER_START && event.depth==1 && 0==strcmp( event.name, "item")){
+		process( dom_reader_attr( &event, "id"));
+	}
+}
+if( type<0){
+	perror( "dom_reader_next");
+}
+dom_reader_free( reader);
+ * @endcode
+ *
+ * @param r Pointer to the reader.
+ * @param event Pointer to the event that is filled in.
+ * @return Type of the event, @c DOM_READER_EOF after the end of the root
+ * 	element, or -1 if an error occurs and errno is set to the following
+ * 	values:
+ * 		@li @c EAGAIN The reader needs a chunk of data, see dom_reader_push().
+ * 		@li @c EINVAL Parse error, or an argument is NULL.
+ * 		@li @c ENOMEM Not enough memory.
+ * 		@li @c E2BIG A limit set in the options is exceeded.
+ * 		@li @c EPERM The document contains DTD or external entity refused
+ * 		        by the options.
+ * 		@li Error code of read() for a file.
+ *
+ * 	The reader returns the same error again on later calls, except
+ * 	@c EAGAIN.
+ */
+int dom_reader_next(dom_reader_t *r, dom_reader_event_t *event);
+
+/**
+ * @brief Find attribute of a start event by its name.
+ *
+ * @param event Pointer to the event.
+ * @param var Name of the attribute, compared ignoring case.
+ * @return Value of the attribute or NULL.
+ */
+const char *dom_reader_attr(const dom_reader_event_t *event, const char *var);
+
+/**
+ * @brief Free pull reader.
+ *
+ * @param r Pointer to the reader, may be NULL.
+ * @return NULL.
+ */
+dom_reader_t *dom_reader_free(dom_reader_t *r);
+
+/**
+ * @brief Write every child element into an array.
+ *
+ * Without the flag only runs of two or more siblings with the same name,
+ * and elements listed in @c arrays of the options, are written as arrays.
+ */
+#define DOM_JSON_ARRAYS 0x1
+
+/**
+ * @brief Default number of bytes of output held back to see whether an
+ * element is followed by a sibling with the same name.
+ */
+#define DOM_JSON_LOOKAHEAD 65536
+
+/**
+ * @brief Options of dom_xml_to_json().
+ *
+ * Set the structure to zeros and change the fields you need.
+ */
+typedef struct dom_json_options_s dom_json_options_t;
+struct dom_json_options_s{
+	/**
+	 * @brief Combination of @c DOM_JSON_* flags.
+	 */
+	int flags;
+	/**
+	 * @brief String put before names of attributes, NULL for "@".
+	 *
+	 * An empty string writes attributes as members named like the
+	 * attributes.
+	 */
+	const char *attr_prefix;
+	/**
+	 * @brief Name of the member that holds text of an element that has
+	 * attributes or child elements, NULL for "#text".
+	 */
+	const char *text_key;
+	/**
+	 * @brief NULL-terminated list of names of elements that are always
+	 * written as arrays, or NULL.
+	 *
+	 * Names are compared exactly. Listing the repeated elements of a
+	 * document avoids holding them back in the lookahead.
+	 */
+	const char * const *arrays;
+	/**
+	 * @brief Maximum number of bytes of output held back to see whether an
+	 * element is followed by a sibling with the same name, 0 for
+	 * @c DOM_JSON_LOOKAHEAD.
+	 *
+	 * An element whose output is longer is written as a single value, and
+	 * if a sibling with the same name follows, the conversion fails with
+	 * @c E2BIG.
+	 */
+	size_t lookahead;
+	/**
+	 * @brief Parser options, NULL for default.
+	 *
+	 * Of the options, flags @c DOM_PARSE_TRIM, @c DOM_PARSE_NO_DTD and
+	 * @c DOM_PARSE_NO_EXTERNAL_ENTITIES and limits @c max_input_bytes and
+	 * @c max_depth are used.
+	 */
+	const dom_parse_options_t *parse;
+};
+
+/**
+ * @brief Convert XML to JSON without building a tree.
+ *
+ * The function writes JSON from expat events, so memory does not depend on
+ * the size of the document but on its depth, the length of text of open
+ * elements and the lookahead.
+ *
+ * The document becomes an object with the root element as its only member.
+ * An element with attributes or child elements becomes an object: attributes
+ * are members with names prefixed by @c attr_prefix, child elements are
+ * members named like them, and the text, if any is left after white space
+ * between elements is removed, is the last member named @c text_key. An
+ * element with text only becomes a string, and an empty element becomes
+ * @c null. Siblings with the same name that follow each other become an
+ * array. Siblings with the same name that are separated by other elements
+ * become members with the same name.
+ *
+ * @par Example:
+ * @code
+static int write_cb( void *ctx, const char *buffer, size_t buffer_len){
+	return fwrite( buffer, 1, buffer_len, ( FILE *)ctx)==buffer_len? 0 : EIO;
+}
+
+const char *xml="<items><item id=\"1\">Fish</item><item id=\"2\"/></items>";
+dom_xml_to_json( xml, strlen( xml), write_cb, stdout, NULL);
+//{"items":{"item":[{"@id":"1","#text":"Fish"},{"@id":"2"}]}}
+ * @endcode
+ *
+ * @param buffer Pointer to XML data.
+ * @param buffer_len Length of the data.
+ * @param write Callback that receives the output in blocks, see
+ * 	dom_write_cb.
+ * @param ctx Pointer passed to the callback.
+ * @param options Options, NULL for default.
+ * @return 0 on success, otherwise error code. The output passed to the
+ * 	callback before an error is incomplete.
+ * 		@li @c EINVAL Parse error, or @c buffer or @c write is NULL.
+ * 		@li @c ENOMEM Not enough memory.
+ * 		@li @c E2BIG A limit set in the parser options or the lookahead
+ * 		        is exceeded.
+ * 		@li @c EPERM The document contains DTD or external entity refused
+ * 		        by the parser options.
+ * 		@li Error code returned by the callback.
  */
-int dom_parse_chunked_data( void **parser, dom_t **dom, const char *buffer, int buffer_len, int isFinal);
+int dom_xml_to_json(const char *buffer, size_t buffer_len, dom_write_cb write, void *ctx,
+		const dom_json_options_t *options);
 
 /**
  * @brief Find attribute in a linked list by its name.
@@ -482,6 +1706,645 @@ char *dom_find_attr(dom_attr_t *attr, const char *var);
  */
 dom_t *dom_find_node(dom_t *root, const char *node);
 
+/**
+ * @brief Intern a namespace URI.
+ *
+ * The function returns a pointer to a copy of the string that is unique for
+ * the process: interned strings are equal if and only if the pointers are
+ * equal. Fields @c ns, @c local_name and @c prefix of nodes and attributes
+ * parsed with @c DOM_PARSE_NAMESPACES are interned, so they may be compared
+ * with the returned pointer directly. Strings interned by the parser are
+ * freed with the last tree that uses them and count toward
+ * @c max_tree_bytes; strings returned by this function stay valid until the
+ * process exits.
+ *
+ * @par Example:
+ * @code
+const char *soap=dom_ns_intern( "http://schemas.xmlsoap.org/soap/envelope/");
+
+for( node=body->child; node; node=node->next){
+	if( node->ns==soap && 0==strcmp( node->local_name, "Fault")){
+		...
+	}
+}
+ * @endcode
+ *
+ * @param str Pointer to a NULL-terminated string.
+ * @return Pointer to the interned string. If an error occurs, NULL is
+ * 	returned and errno is set to @c EINVAL or @c ENOMEM.
+ */
+const char *dom_ns_intern(const char *str);
+
+/**
+ * @brief Find attribute in a linked list by its namespace and local name.
+ *
+ * Same as dom_find_attr(), but the attribute is matched by namespace URI
+ * and local name, so the prefix used in the document does not matter. The
+ * names are compared case-sensitively.
+ *
+ * @param attr Pointer to a linked list with attributes.
+ * @param ns Namespace URI, or NULL for attributes without namespace.
+ * @param local_name Local name of the attribute.
+ * @return Attribute value or NULL if the attribute is not found.
+ */
+char *dom_find_attr_ns(dom_attr_t *attr, const char *ns, const char *local_name);
+
+/**
+ * @brief Find a node in DOM tree by its namespace and local name.
+ *
+ * Same as dom_find_node(), but the node is matched by namespace URI and
+ * local name, so the prefix used in the document does not matter. The
+ * namespace is looked up once, after that the nodes are matched by
+ * comparing pointers to interned URIs. The names are compared
+ * case-sensitively.
+ *
+ * @par Example:
+ * @code
+dom_parse_options_t options;
+
+memset( &options, 0, sizeof( options));
+options.flags=DOM_PARSE_NAMESPACES;
+dom=dom_parse_buffer_ex( buffer, buffer_len, &options);
+body=dom_find_node_ns( dom, "http://schemas.xmlsoap.org/soap/envelope/", "Body");
+ * @endcode
+ *
+ * @param root Pointer to @c dom_t structure where the node is searched for.
+ * @param ns Namespace URI, or NULL for nodes without namespace.
+ * @param local_name Local name of the node.
+ * @return Pointer to the first matching node or NULL.
+ */
+dom_t *dom_find_node_ns(dom_t *root, const char *ns, const char *local_name);
+
+/**
+ * @brief Get value of an attribute as a 64-bit integer.
+ *
+ * The attribute is found as dom_find_attr() does and its value is converted
+ * in place, without copying. White space around the number is ignored. The
+ * number is decimal with optional sign.
+ *
+ * @par Example:
+ * @code
+int64_t id;
+
+if( 0==dom_attr_int64( node->attr, "id", &id)){
+	printf( "id=%lld\n", (long long)id);
+}
+ * @endcode
+ *
+ * @param attr Pointer to a linked list with attributes.
+ * @param var Name of the attribute.
+ * @param value Pointer to a variable that receives the value. The variable
+ * 	is not changed if an error occurs.
+ * @return The function returns 0 when succeeds. If an error occurs, the function
+ * 	returns error code:
+ * 		@li @c ENOENT The attribute is not found.
+ * 		@li @c EINVAL The value is not a number.
+ * 		@li @c ERANGE The number does not fit into 64 bits.
+ */
+int dom_attr_int64(dom_attr_t *attr, const char *var, int64_t *value);
+
+/**
+ * @brief Get value of an attribute as a double.
+ *
+ * Same as dom_attr_int64(), but the value is converted to double. Decimal
+ * numbers with up to 19 significant digits and exponent within 22 are
+ * converted exactly without calling strtod(). Other numbers, including
+ * @c INF and @c NaN, are converted with strtod(), which depends on the
+ * current locale.
+ *
+ * @param attr Pointer to a linked list with attributes.
+ * @param var Name of the attribute.
+ * @param value Pointer to a variable that receives the value.
+ * @return 0, or error code as dom_attr_int64() does. @c ERANGE is returned
+ * 	if the number overflows or underflows, in this case @c value is set to
+ * 	the value returned by strtod().
+ */
+int dom_attr_double(dom_attr_t *attr, const char *var, double *value);
+
+/**
+ * @brief Get data of a node as a 64-bit integer.
+ *
+ * The data is converted as dom_attr_int64() does. Field @c user_data is
+ * used if it is set, otherwise field @c data. The data is not required to
+ * be terminated with NULL character.
+ *
+ * @param node Pointer to the node.
+ * @param value Pointer to a variable that receives the value.
+ * @return 0, or error code as dom_attr_int64() does. @c ENOENT is returned
+ * 	if the node has no data.
+ */
+int dom_text_int64(const dom_t *node, int64_t *value);
+
+/**
+ * @brief Get data of a node as a double.
+ *
+ * The data is converted as dom_attr_double() does.
+ *
+ * @param node Pointer to the node.
+ * @param value Pointer to a variable that receives the value.
+ * @return 0, or error code as dom_attr_double() does. @c ENOENT is returned
+ * 	if the node has no data.
+ */
+int dom_text_double(const dom_t *node, double *value);
+
+/**
+ * @brief Get data of a node as a boolean.
+ *
+ * Values @c true and @c 1 are converted to 1, values @c false and @c 0 are
+ * converted to 0, as defined for @c xs:boolean.
+ *
+ * @param node Pointer to the node.
+ * @param value Pointer to a variable that receives the value.
+ * @return 0, or error code: @c ENOENT if the node has no data, @c EINVAL if
+ * 	the data is not a boolean.
+ */
+int dom_text_bool(const dom_t *node, int *value);
+
+/**
+ * @brief Column of 64-bit integers, see dom_column_spec_t.
+ */
+#define DOM_COLUMN_INT64 1
+/**
+ * @brief Column of doubles, see dom_column_spec_t.
+ */
+#define DOM_COLUMN_DOUBLE 2
+/**
+ * @brief Column of strings, see dom_column_spec_t.
+ */
+#define DOM_COLUMN_STRING 3
+
+/**
+ * @brief Description of a column extracted with dom_extract_columns().
+ *
+ * The value of the column is taken from attribute @c attr of the record, or
+ * from data of the first child element of the record named @c child, or, if
+ * both fields are NULL, from data of the record itself. Names are compared
+ * case-insensitively.
+ */
+typedef struct dom_column_spec_s dom_column_spec_t;
+struct dom_column_spec_s{
+	/**
+	 * @brief Name of the attribute or NULL.
+	 */
+	const char *attr;
+	/**
+	 * @brief Name of the child element or NULL.
+	 */
+	const char *child;
+	/**
+	 * @brief Type of the column: @c DOM_COLUMN_INT64, @c DOM_COLUMN_DOUBLE
+	 * or @c DOM_COLUMN_STRING.
+	 */
+	int type;
+};
+
+/**
+ * @brief Column filled by dom_extract_columns().
+ *
+ * The layout of the arrays follows Apache Arrow format for primitive and
+ * UTF-8 string arrays, so the arrays can be passed to vectorized code or
+ * wrapped into Arrow arrays without copying.
+ */
+typedef struct dom_column_s dom_column_t;
+struct dom_column_s{
+	/**
+	 * @brief Type of the column, copied from the spec.
+	 */
+	int type;
+	/**
+	 * @brief Number of rows.
+	 */
+	int length;
+	/**
+	 * @brief Number of rows that have no value.
+	 */
+	int null_count;
+	/**
+	 * @brief Validity bitmap: bit @c i%8 of byte @c i/8 is set if row @c i
+	 * has a value.
+	 *
+	 * A row has no value if the attribute or the child element is missing,
+	 * or if the value can not be converted to the type of the column. The
+	 * value of such row is 0 or empty string.
+	 */
+	unsigned char *validity;
+	/**
+	 * @brief Values of @c DOM_COLUMN_INT64 (@c int64_t) or
+	 * @c DOM_COLUMN_DOUBLE (@c double) column.
+	 */
+	void *values;
+	/**
+	 * @brief Offsets of strings of @c DOM_COLUMN_STRING column in @c data,
+	 * @c length+1 items.
+	 *
+	 * String of row @c i starts at @c data+offsets[i] and is
+	 * @c offsets[i+1]-offsets[i] bytes long. It is not terminated with
+	 * NULL character.
+	 */
+	int32_t *offsets;
+	/**
+	 * @brief Bytes of all strings of @c DOM_COLUMN_STRING column.
+	 */
+	char *data;
+};
+
+/**
+ * @brief Extract repeated records into column arrays.
+ *
+ * The function walks the tree once and, for every record, appends one row
+ * to every column. Records are the elements that match @c record_path: a
+ * list of element names separated with slashes, relative to @c root. For
+ * example, path @c row matches children of @c root named @c row, path
+ * @c rows/row matches their grandchildren. Numbers are converted as
+ * dom_attr_int64() and dom_attr_double() do, strings are copied.
+ *
+ * @par Example:
+ * @code
+dom_column_spec_t specs[]={
+	{ "id", NULL, DOM_COLUMN_INT64},
+	{ NULL, "price", DOM_COLUMN_DOUBLE},
+	{ NULL, "name", DOM_COLUMN_STRING},
+};
+dom_column_t columns[3];
+double sum=0;
+int i;
+
+if( 0==dom_extract_columns( dom, "items/item", specs, 3, columns)){
+	for( i=0; i<columns[1].length; i++){
+		sum+=((double *)columns[1].values)[i];
+	}
+	dom_columns_free( columns, 3);
+}
+ * @endcode
+ *
+ * @param root Pointer to the node records are searched in.
+ * @param record_path Path of the records relative to @c root.
+ * @param specs Array of @c count column descriptions.
+ * @param count Number of columns.
+ * @param columns Array of @c count columns that receive the data. The
+ * 	arrays must be freed with dom_columns_free().
+ * @return The function returns 0 when succeeds. If an error occurs, the
+ * 	function frees the arrays and returns error code:
+ * 		@li @c EINVAL Invalid arguments.
+ * 		@li @c ENOMEM Not enough memory.
+ * 		@li @c E2BIG Strings of a column are longer than 2 GB in total.
+ */
+int dom_extract_columns(dom_t *root, const char *record_path, const dom_column_spec_t *specs, int count,
+		dom_column_t *columns);
+
+/**
+ * @brief Free arrays of columns filled by dom_extract_columns().
+ *
+ * @param columns Array of columns.
+ * @param count Number of columns.
+ */
+void dom_columns_free(dom_column_t *columns, int count);
+
+/**
+ * @brief Make attribute order significant for dom_hash().
+ */
+#define DOM_HASH_ATTR_ORDER 0x1
+
+/**
+ * @brief Get fingerprint of a subtree.
+ *
+ * The hash covers names of the node and its descendants, their attributes
+ * and their data with leading and trailing white space removed, so the
+ * same document formatted in a different way has the same hash. Text of
+ * CDATA sections (@c user_data) counts as a part of data and separately. By default
+ * the order of attributes does not matter. The hash is not cryptographic;
+ * it is the same on all platforms and between versions of the library.
+ *
+ * Hashes computed with no flags are cached in the nodes, a subtree is
+ * hashed again only if it was changed with dom_append_child(),
+ * dom_insert_before(), dom_remove(), dom_set_attr() or dom_set_text(). If
+ * you change fields of a node manually, call dom_hash_invalidate(). Use
+ * @c DOM_PARSE_HASH to compute the hashes while parsing.
+ *
+ * @par Example:
+ * Only the records that changed since the previous version of the feed are
+ * processed. Unchanged records are skipped without looking into them.
+ * @code
+for( item=feed->child, old=old_feed->child; item; item=item->next){
+	if( !old || dom_hash( item, 0) !=dom_hash( old, 0)){
+		process( item);
+	}
+	old=old? old->next : NULL;
+}
+ * @endcode
+ *
+ * @param node Pointer to the node.
+ * @param flags 0 or @c DOM_HASH_ATTR_ORDER.
+ * @return The hash, never 0 unless @c node is NULL.
+ */
+uint64_t dom_hash(dom_t *node, int flags);
+
+/**
+ * @brief Drop cached hash of a node and its ancestors.
+ *
+ * @param node Pointer to the changed node.
+ */
+void dom_hash_invalidate(dom_t *node);
+
+/**
+ * @brief Node that is present only in the new tree, see dom_reparse().
+ */
+#define DOM_CHANGE_ADDED 1
+/**
+ * @brief Node that is present only in the old tree.
+ */
+#define DOM_CHANGE_REMOVED 2
+/**
+ * @brief Node whose attributes or text changed.
+ */
+#define DOM_CHANGE_MODIFIED 3
+
+/**
+ * @brief Change found by dom_reparse().
+ *
+ * Only the top node of an added or removed subtree is reported.
+ */
+typedef struct dom_change_s dom_change_t;
+struct dom_change_s{
+	/**
+	 * @brief One of @c DOM_CHANGE_* values.
+	 */
+	int type;
+	/**
+	 * @brief The node in the new tree, NULL for removed nodes.
+	 */
+	dom_t *node;
+	/**
+	 * @brief The node in the old tree, NULL for added nodes.
+	 *
+	 * The node stays valid until dom_changes_free() is called.
+	 */
+	dom_t *old;
+};
+
+/**
+ * @brief List of changes filled by dom_reparse().
+ */
+typedef struct dom_changes_s dom_changes_t;
+struct dom_changes_s{
+	/**
+	 * @brief Array of changes.
+	 */
+	dom_change_t *list;
+	/**
+	 * @brief Number of changes in the array.
+	 */
+	int count;
+	/**
+	 * @brief Internal: allocated size of the array.
+	 */
+	int size;
+	/**
+	 * @brief Set if there was not enough memory to record all changes.
+	 *
+	 * The new tree is still correct, but treat all of it as changed.
+	 */
+	int incomplete;
+	/**
+	 * @brief Internal: what is left of the old tree.
+	 */
+	dom_t *old;
+};
+
+/**
+ * @brief Build structural index of a tree.
+ *
+ * Every node gets its preorder and postorder numbers, depth, number of
+ * descendants and skip pointer, see fields @c pre, @c post, @c depth,
+ * @c size and @c skip of dom_t. Then dom_is_ancestor(),
+ * dom_compare_order() and dom_descendant_count() take constant time
+ * instead of walking the tree.
+ *
+ * dom_append_child(), dom_insert_before() and dom_remove() drop the index
+ * of the tree they change, and the functions walk the tree again until the
+ * index is rebuilt. If you link nodes manually, rebuild the index.
+ *
+ * @par Example:
+ * Elements named @c script are skipped together with their subtrees.
+ * @code
+dom_build_structure_index( root);
+for( node=root; node; ){
+	if( 0==strcasecmp( node->name, "script")){
+		node=node->skip;
+		continue;
+	}
+	process( node);
+	node=node->child? node->child : node->skip;
+}
+ * @endcode
+ *
+ * @param root Root of the tree.
+ * @return The function returns 0 when succeeds. If an error occurs, the
+ * 	function returns error code:
+ * 		@li @c EINVAL @c root is NULL, has a parent or the tree has
+ * 		aliases made by @c DOM_PARSE_DEDUP.
+ * 		@li @c ENOMEM Not enough memory.
+ */
+int dom_build_structure_index(dom_t *root);
+
+/**
+ * @brief Check if a node is an ancestor of another node.
+ *
+ * @param ancestor Pointer to the supposed ancestor.
+ * @param node Pointer to the node.
+ * @return 1 if @c ancestor is a parent, grandparent and so on of @c node,
+ * 	otherwise 0.
+ */
+int dom_is_ancestor(const dom_t *ancestor, const dom_t *node);
+
+/**
+ * @brief Compare positions of two nodes in document order.
+ *
+ * A node comes after its ancestors and before its following siblings.
+ *
+ * @param a Pointer to the first node.
+ * @param b Pointer to the second node.
+ * @return -1 if @c a comes before @c b, 1 if it comes after @c b and 0 if
+ * 	the nodes are the same or belong to different trees.
+ */
+int dom_compare_order(const dom_t *a, const dom_t *b);
+
+/**
+ * @brief Count descendants of a node.
+ *
+ * @param node Pointer to the node.
+ * @return Number of children, grandchildren and so on of the node.
+ */
+int dom_descendant_count(const dom_t *node);
+
+/**
+ * @brief Build key index of a tree.
+ *
+ * The index maps values of attribute @c attr to the elements named
+ * @c name that have the attribute, so a reference is resolved in constant
+ * time instead of searching the tree. Element and attribute names are
+ * compared ignoring case as in dom_find_node() and dom_find_attr(), values
+ * are compared exactly.
+ *
+ * The index keeps pointers to the elements and reads their values when
+ * it is searched. It is not updated when the tree changes: free it before
+ * the tree, and build it again after moving, removing or editing indexed
+ * elements.
+ *
+ * @par Example:
+ * References of @c ref elements are resolved to the elements with the
+ * same @c id.
+ * @code
+index=dom_build_key_index( root, NULL, "id");
+for( node=dom_find_node( root, "ref"); node; node=next_ref( node)){
+	target=dom_key_lookup( index, dom_find_attr( node->attr, "target"));
+	...
+}
+dom_key_index_free( index);
+ * @endcode
+ *
+ * @param root Root of the subtree to index.
+ * @param name Name of the indexed elements, NULL or @c "*" for any element.
+ * @param attr Name of the attribute.
+ * @return Pointer to the newly allocated index, which must be freed by
+ * 	dom_key_index_free(). If an error occurs, the function returns NULL and
+ * 	sets errno to the following values:
+ * 		@li @c EINVAL @c root or @c attr is NULL.
+ * 		@li @c ENOMEM Not enough memory.
+ */
+dom_key_index_t *dom_build_key_index(dom_t *root, const char *name, const char *attr);
+
+/**
+ * @brief Create empty key index.
+ *
+ * Elements are added to the index by dom_key_index_add() or by the parser,
+ * see field @c key_index of dom_parse_options_t.
+ *
+ * @param name Name of the indexed elements, NULL or @c "*" for any element.
+ * @param attr Name of the attribute.
+ * @return Pointer to the newly allocated index or NULL and errno is set to
+ * 	@c EINVAL if @c attr is NULL or to @c ENOMEM.
+ */
+dom_key_index_t *dom_key_index_new(const char *name, const char *attr);
+
+/**
+ * @brief Add elements of a subtree to key index.
+ *
+ * @param index Pointer to the index.
+ * @param root Root of the subtree. Its siblings are not added.
+ * @return 0 on success, @c EINVAL if an argument is NULL or @c ENOMEM, in
+ * 	which case no element of the subtree is added.
+ */
+int dom_key_index_add(dom_key_index_t *index, dom_t *root);
+
+/**
+ * @brief Free key index.
+ *
+ * The indexed tree is not changed.
+ *
+ * @param index Pointer to the index, may be NULL.
+ */
+void dom_key_index_free(dom_key_index_t *index);
+
+/**
+ * @brief Find element by value of the indexed attribute.
+ *
+ * @param index Pointer to the index.
+ * @param value Value of the attribute.
+ * @return The first element added to the index with the value, which is
+ * 	the first one in document order if the index is built by
+ * 	dom_build_key_index() or by the parser, or NULL if there is none.
+ */
+dom_t *dom_key_lookup(const dom_key_index_t *index, const char *value);
+
+/**
+ * @brief Find the next element with the same value of the indexed attribute.
+ *
+ * Duplicates are visited in the order they were added to the index.
+ *
+ * @par Example:
+ * @code
+for( node=dom_key_lookup( index, "42"); node; node=dom_key_lookup_next( index, node)){
+	...
+}
+ * @endcode
+ *
+ * @param index Pointer to the index.
+ * @param node Element returned by dom_key_lookup() or by this function.
+ * @return The next element with the same value or NULL.
+ */
+dom_t *dom_key_lookup_next(const dom_key_index_t *index, const dom_t *node);
+
+/**
+ * @brief Parse a new version of a document reusing the old tree.
+ *
+ * The function parses the buffer and compares the result with the old
+ * tree. Subtrees that did not change are moved from the old tree into the
+ * new one, so pointers to them stay valid, and the new copies are freed.
+ * Candidates are found by dom_hash() and then compared node by node, so a
+ * collision of hashes never reuses a different subtree. Every reused
+ * subtree, and the whole tree if nothing changed, is walked once to verify
+ * it, so besides parsing the work is proportional to the size of the edit
+ * plus the size of the reused subtrees, which is the size of the document
+ * when little changed. The children of changed nodes are paired by name in
+ * document order.
+ *
+ * Subtrees are equal if their names, attributes and text with leading and
+ * trailing white space removed are equal, so their formatting and the order
+ * of attributes are taken from the old tree.
+ *
+ * If @c options has a @c key_index, the elements of the returned tree are
+ * added to it after the old subtrees are moved in. If there is not enough
+ * memory for that, none of them is added and field @c incomplete of the
+ * changes is set.
+ *
+ * The old tree is consumed: do not use it after the call, except for the
+ * nodes in field @c old of the changes, and do not free it. If the whole
+ * document did not change, the old tree is returned as it is and the list
+ * is empty. The old tree must not be parsed with @c DOM_PARSE_DEDUP and must
+ * not be read by other threads during the call.
+ *
+ * @par Example:
+ * @code
+dom_changes_t changes;
+dom_t *dom;
+int i;
+
+if(( dom=dom_reparse( config, buffer, buffer_len, NULL, &changes))){
+	config=dom;
+	for( i=0; i<changes.count; i++){
+		if( changes.list[i].old){
+			index_remove( changes.list[i].old);
+		}
+		if( changes.list[i].node){
+			index_add( changes.list[i].node);
+		}
+	}
+	dom_changes_free( &changes);
+}
+ * @endcode
+ *
+ * @param old Root of the old tree.
+ * @param buffer Pointer to the new version of the document.
+ * @param buffer_len Length of the document.
+ * @param options Options of the parser or NULL, see dom_parse_buffer_ex().
+ * @param changes Pointer to a structure that receives the list of changes.
+ * 	Free it with dom_changes_free() when the changes are processed.
+ * @return Pointer to the root of the new tree. If an error occurs, the
+ * 	function returns NULL, sets errno as dom_parse_buffer_ex() does and
+ * 	the old tree is not changed. @c EINVAL is set if @c old is not a root,
+ * 	@c changes is NULL or @c options has @c DOM_PARSE_DEDUP flag.
+ */
+dom_t *dom_reparse(dom_t *old, const char *buffer, size_t buffer_len, const dom_parse_options_t *options,
+		dom_changes_t *changes);
+
+/**
+ * @brief Free list of changes and the rest of the old tree.
+ *
+ * @param changes Pointer to the list filled by dom_reparse().
+ */
+void dom_changes_free(dom_changes_t *changes);
+
 /**
  * @brief Convert special XML characters into XML entities.
  *
@@ -541,7 +2404,7 @@ char *escape_xml( const char *input);
  * @see escape_xml(), escaped_length().
  *
  */
-int escape_xml_r( const char *input, int input_len, char *output, int output_max_len);
+size_t escape_xml_r( const char *input, size_t input_len, char *output, size_t output_max_len);
 
 /**
  * @brief Determine length of a string with converted special XML chars.
@@ -608,7 +2471,7 @@ char *unescape_xml( const char *input);
  * @see unescape_xml().
  *
  */
-int unescape_xml_r( const char *input, int input_len, char *output);
+size_t unescape_xml_r( const char *input, size_t input_len, char *output);
 
 /**
  * @brief Test if a character is a special character and needs to be escaped.
@@ -0,0 +1,418 @@
+/*
+ * Copyright (c) 2011 Sergey Kolotsey.
+ * This file if part of expat-dom library.
+ * See the file COPYING for copying permission.
+ */
+
+#ifndef __EXPAT_DOM_HPP_INCLUDED
+#define __EXPAT_DOM_HPP_INCLUDED
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory_resource>
+#include <optional>
+#include <string_view>
+#include <system_error>
+#include <vector>
+#include <strings.h>
+
+extern "C" {
+#include "expat-dom.h"
+}
+
+/**
+ * @file expat-dom.hpp
+ * Header-only C++17 wrapper of expat-dom library
+ * @ingroup expat-dom
+ * @{
+ */
+
+/**
+ * @brief C++ interface of the library.
+ *
+ * The classes are thin views of the C structures: a @c node or an @c attr
+ * is a single pointer, names, data and values are returned as
+ * @c std::string_view pointing into the tree, so nothing is copied. The
+ * only owning class is @c document that frees the tree in its destructor.
+ *
+ * @par Example:
+ * @code
+#include "expat-dom.hpp"
+
+expat_dom::document doc=expat_dom::document::parse( xml);
+for( expat_dom::node item : doc.root().children()){
+	std::cout << item.attr( "id").value_or( "") << ": " << item.text() << "\n";
+}
+ * @endcode
+ */
+namespace expat_dom{
+
+/**
+ * @brief Exception thrown when a C function of the library fails.
+ */
+class error : public std::system_error{
+public:
+	explicit error(int code, const char *what) : std::system_error(code, std::generic_category(), what){}
+};
+
+/**
+ * @brief View of an attribute.
+ */
+class attr{
+public:
+	attr() noexcept : a_(nullptr){}
+	explicit attr(dom_attr_t *a) noexcept : a_(a){}
+
+	explicit operator bool() const noexcept{ return a_ !=nullptr; }
+	dom_attr_t *get() const noexcept{ return a_; }
+
+	std::string_view name() const noexcept{ return a_->var; }
+	std::string_view value() const noexcept{ return a_->val; }
+	/** Namespace URI, empty if the attribute has no namespace. */
+	std::string_view ns() const noexcept{ return a_->ns? a_->ns : std::string_view(); }
+	std::string_view local_name() const noexcept{ return a_->local_name? a_->local_name : a_->var; }
+
+	attr next() const noexcept{ return attr(a_->next); }
+
+	bool operator==(const attr &o) const noexcept{ return a_==o.a_; }
+	bool operator!=(const attr &o) const noexcept{ return a_ !=o.a_; }
+
+private:
+	dom_attr_t *a_;
+};
+
+/**
+ * @brief Forward iterator over a linked list, used for attributes and
+ * children.
+ */
+template<class T> class list_iterator{
+public:
+	using iterator_category=std::forward_iterator_tag;
+	using value_type=T;
+	using difference_type=std::ptrdiff_t;
+	using pointer=const T *;
+	using reference=const T &;
+
+	list_iterator() noexcept{}
+	explicit list_iterator(T item) noexcept : item_(item){}
+
+	reference operator*() const noexcept{ return item_; }
+	pointer operator->() const noexcept{ return &item_; }
+	list_iterator &operator++() noexcept{ item_=item_.next(); return *this; }
+	list_iterator operator++(int) noexcept{ list_iterator temp=*this; ++*this; return temp; }
+	bool operator==(const list_iterator &o) const noexcept{ return item_==o.item_; }
+	bool operator!=(const list_iterator &o) const noexcept{ return item_ !=o.item_; }
+
+private:
+	T item_;
+};
+
+/**
+ * @brief Range of items of a linked list, usable in range-based for.
+ */
+template<class T> class list_range{
+public:
+	using iterator=list_iterator<T>;
+
+	explicit list_range(T first) noexcept : first_(first){}
+	iterator begin() const noexcept{ return iterator(first_); }
+	iterator end() const noexcept{ return iterator(); }
+	bool empty() const noexcept{ return !first_; }
+
+private:
+	T first_;
+};
+
+class node;
+using attr_range=list_range<attr>;
+using child_range=list_range<node>;
+class descendant_range;
+
+/**
+ * @brief View of a node.
+ */
+class node{
+public:
+	node() noexcept : n_(nullptr){}
+	explicit node(dom_t *n) noexcept : n_(n){}
+
+	explicit operator bool() const noexcept{ return n_ !=nullptr; }
+	dom_t *get() const noexcept{ return n_; }
+
+	std::string_view name() const noexcept{ return n_->name; }
+	/** Namespace URI, empty if the node has no namespace. */
+	std::string_view ns() const noexcept{ return n_->ns? n_->ns : std::string_view(); }
+	std::string_view local_name() const noexcept{ return n_->local_name? n_->local_name : n_->name; }
+
+	/** Trimmed text or CDATA of the node, field @c user_data. */
+	std::string_view text() const noexcept{
+		return n_->user_data? std::string_view(n_->user_data, n_->user_data_len) : std::string_view();
+	}
+	/** All character data of the node, field @c data. */
+	std::string_view data() const noexcept{
+		return n_->data? std::string_view(n_->data, n_->data_len) : std::string_view();
+	}
+
+	node parent() const noexcept{ return node(n_->parent); }
+	node first_child() const noexcept{ return node(n_->child); }
+	node last_child() const noexcept{ return node(n_->last); }
+	node next() const noexcept{ return node(n_->next); }
+	int child_count() const noexcept{ return n_->child_count; }
+
+	child_range children() const noexcept{ return child_range(node(n_->child)); }
+	attr_range attrs() const noexcept{ return attr_range(expat_dom::attr(n_->attr)); }
+	/** Descendants of the node in document order, the node excluded. */
+	descendant_range descendants() const noexcept;
+
+	/** Value of an attribute found as dom_find_attr() does. */
+	std::optional<std::string_view> attr(const char *name) const noexcept{
+		const char *val=dom_find_attr(n_->attr, name);
+		return val? std::optional<std::string_view>(val) : std::nullopt;
+	}
+	std::optional<std::string_view> attr_ns(const char *ns, const char *local_name) const noexcept{
+		const char *val=dom_find_attr_ns(n_->attr, ns, local_name);
+		return val? std::optional<std::string_view>(val) : std::nullopt;
+	}
+
+	/** The first node with the name in the subtree, see dom_find_node(). */
+	node find(const char *name) const noexcept{ return node(dom_find_node(n_, name)); }
+	node find_ns(const char *ns, const char *local_name) const noexcept{
+		return node(dom_find_node_ns(n_, ns, local_name));
+	}
+	/** The first child with the name, compared case-insensitively. */
+	node child(std::string_view name) const noexcept{
+		for(dom_t *c=n_->child; c; c=c->next){
+			if(std::strlen(c->name)==name.size() && 0==strncasecmp(c->name, name.data(), name.size())){
+				return node(c);
+			}
+		}
+		return node();
+	}
+
+	/** Text converted with dom_text_int64(), empty if it is not a number. */
+	std::optional<int64_t> as_int64() const noexcept{
+		int64_t v;
+		return 0==dom_text_int64(n_, &v)? std::optional<int64_t>(v) : std::nullopt;
+	}
+	std::optional<double> as_double() const noexcept{
+		double v;
+		return 0==dom_text_double(n_, &v)? std::optional<double>(v) : std::nullopt;
+	}
+	std::optional<bool> as_bool() const noexcept{
+		int v;
+		return 0==dom_text_bool(n_, &v)? std::optional<bool>(v !=0) : std::nullopt;
+	}
+
+	/** Fingerprint of the subtree, see dom_hash(). */
+	uint64_t hash(int flags=0) const noexcept{ return dom_hash(n_, flags); }
+
+	/** Position in the tree, constant time with dom_build_structure_index(). */
+	bool is_ancestor_of(node other) const noexcept{ return dom_is_ancestor(n_, other.n_) !=0; }
+	int compare_order(node other) const noexcept{ return dom_compare_order(n_, other.n_); }
+	int descendant_count() const noexcept{ return dom_descendant_count(n_); }
+
+	/**
+	 * Children with the name collected into a vector allocated from the
+	 * memory resource, for example a @c std::pmr::monotonic_buffer_resource
+	 * living on the stack.
+	 */
+	std::pmr::vector<node> children_named(std::string_view name,
+			std::pmr::memory_resource *mr=std::pmr::get_default_resource()) const{
+		std::pmr::vector<node> ret(mr);
+		for(dom_t *c=n_->child; c; c=c->next){
+			if(std::strlen(c->name)==name.size() && 0==strncasecmp(c->name, name.data(), name.size())){
+				ret.push_back(node(c));
+			}
+		}
+		return ret;
+	}
+
+	bool operator==(const node &o) const noexcept{ return n_==o.n_; }
+	bool operator!=(const node &o) const noexcept{ return n_ !=o.n_; }
+
+private:
+	dom_t *n_;
+};
+
+/**
+ * @brief Forward iterator over descendants of a node in document order.
+ *
+ * The iterator walks back up with parent pointers. Only in trees parsed
+ * with @c DOM_PARSE_DEDUP it remembers the aliases it went through, since
+ * parent of a shared child is not the alias.
+ */
+class descendant_iterator{
+public:
+	using iterator_category=std::forward_iterator_tag;
+	using value_type=node;
+	using difference_type=std::ptrdiff_t;
+	using pointer=const node *;
+	using reference=const node &;
+
+	descendant_iterator() noexcept{}
+	descendant_iterator(node root, node current) : root_(root), current_(current){
+		if(current && root.get()->alias){
+			aliases_.push_back(root.get());
+		}
+	}
+
+	reference operator*() const noexcept{ return current_; }
+	pointer operator->() const noexcept{ return &current_; }
+	descendant_iterator &operator++(){
+		dom_t *n=current_.get();
+		if(n->child){
+			if(n->alias){
+				aliases_.push_back(n);
+			}
+			n=n->child;
+		}else{
+			while(n && n !=root_.get() && !n->next){
+				n=up(n);
+			}
+			n=(n && n !=root_.get())? n->next : nullptr;
+		}
+		current_=node(n);
+		return *this;
+	}
+	descendant_iterator operator++(int){ descendant_iterator temp=*this; ++*this; return temp; }
+	bool operator==(const descendant_iterator &o) const noexcept{ return current_==o.current_; }
+	bool operator!=(const descendant_iterator &o) const noexcept{ return current_ !=o.current_; }
+
+private:
+	dom_t *up(dom_t *n){
+		if( !aliases_.empty() && aliases_.back()->alias==n->parent){
+			n=aliases_.back();
+			aliases_.pop_back();
+			return n;
+		}
+		return n->parent;
+	}
+
+	node root_;
+	node current_;
+	std::vector<dom_t *> aliases_;
+};
+
+/**
+ * @brief Range of descendants of a node, usable in range-based for.
+ */
+class descendant_range{
+public:
+	using iterator=descendant_iterator;
+
+	explicit descendant_range(node root) noexcept : root_(root){}
+	iterator begin() const{ return iterator(root_, root_.first_child()); }
+	iterator end() const{ return iterator(root_, node()); }
+
+private:
+	node root_;
+};
+
+inline descendant_range node::descendants() const noexcept{
+	return descendant_range(*this);
+}
+
+/**
+ * @brief Owner of a tree.
+ *
+ * The document frees the tree with dom_free() when it is destroyed. It can
+ * be moved but not copied, use clone() to copy the tree.
+ */
+class document{
+public:
+	document() noexcept : dom_(nullptr){}
+	/** Takes ownership of the tree. */
+	explicit document(dom_t *dom) noexcept : dom_(dom){}
+	document(document &&o) noexcept : dom_(o.dom_){ o.dom_=nullptr; }
+	document &operator=(document &&o) noexcept{
+		if(this !=&o){
+			dom_free(dom_);
+			dom_=o.dom_;
+			o.dom_=nullptr;
+		}
+		return *this;
+	}
+	document(const document &)=delete;
+	document &operator=(const document &)=delete;
+	~document(){ dom_free(dom_); }
+
+	/** Parses the buffer, throws @c error if the buffer can not be parsed. */
+	static document parse(std::string_view xml, const dom_parse_options_t *options=nullptr){
+		dom_t *dom=dom_parse_buffer_ex(xml.data(), xml.size(), options);
+		if( !dom){
+			throw error(errno, "dom_parse_buffer_ex");
+		}
+		return document(dom);
+	}
+	/** Parses the file, throws @c error if the file can not be parsed. */
+	static document parse_file(const char *name, const dom_parse_options_t *options=nullptr){
+		dom_t *dom=dom_parse_file_name_ex(const_cast<char *>(name), options);
+		if( !dom){
+			throw error(errno, "dom_parse_file_name_ex");
+		}
+		return document(dom);
+	}
+
+	/** Copy of the tree sharing names, attributes and data, see dom_clone(). */
+	document clone() const{
+		dom_t *dom=dom_clone(dom_);
+		if( !dom){
+			throw error(errno, "dom_clone");
+		}
+		return document(dom);
+	}
+
+	explicit operator bool() const noexcept{ return dom_ !=nullptr; }
+	node root() const noexcept{ return node(dom_); }
+	dom_t *get() const noexcept{ return dom_; }
+	/** Gives up ownership of the tree. */
+	dom_t *release() noexcept{ dom_t *dom=dom_; dom_=nullptr; return dom; }
+
+private:
+	dom_t *dom_;
+};
+
+/**
+ * @brief Owner of a key index, see dom_build_key_index().
+ *
+ * The index must be destroyed before the tree it points to.
+ */
+class key_index{
+public:
+	key_index() noexcept : index_(nullptr){}
+	/** Indexes elements named @c name, nullptr for any, by attribute @c attr. */
+	key_index(node root, const char *name, const char *attr) : index_(dom_build_key_index(root.get(), name, attr)){
+		if( !index_){
+			throw error(errno, "dom_build_key_index");
+		}
+	}
+	key_index(key_index &&o) noexcept : index_(o.index_){ o.index_=nullptr; }
+	key_index &operator=(key_index &&o) noexcept{
+		if(this !=&o){
+			dom_key_index_free(index_);
+			index_=o.index_;
+			o.index_=nullptr;
+		}
+		return *this;
+	}
+	key_index(const key_index &)=delete;
+	key_index &operator=(const key_index &)=delete;
+	~key_index(){ dom_key_index_free(index_); }
+
+	/** The first element with the value or a null node. */
+	node find(const char *value) const noexcept{ return node(dom_key_lookup(index_, value)); }
+	/** The next element with the same value as @c n or a null node. */
+	node find_next(node n) const noexcept{ return node(dom_key_lookup_next(index_, n.get())); }
+	dom_key_index_t *get() const noexcept{ return index_; }
+
+private:
+	dom_key_index_t *index_;
+};
+
+} //namespace expat_dom
+
+/** @} */
+
+#endif //__EXPAT_DOM_HPP_INCLUDED
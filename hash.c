@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2011 Sergey Kolotsey.
+ * This file if part of expat-dom library.
+ * See the file COPYING for copying permission.
+ *
+ * This file defines dom_hash(), a fingerprint of a subtree that does not
+ * depend on formatting of the document.
+ */
+
+#include "expat-config.h"
+
+#ifdef STDC_HEADERS
+# include <stdlib.h>
+# include <stddef.h>
+#else
+# ifdef HAVE_STDLIB_H
+#  include <stdlib.h>
+# endif
+#endif
+#ifdef HAVE_STRING_H
+# if !defined STDC_HEADERS && defined HAVE_MEMORY_H
+#  include <memory.h>
+# endif
+# include <string.h>
+#endif
+#include "expat-dom-private.h"
+
+
+
+#define DOM_HASH_M 0xc6a4a7935bd1e995ULL
+#define DOM_HASH_GOLDEN 0x9e3779b97f4a7c15ULL
+
+//seeds keep names, attributes and text apart
+#define DOM_HASH_SEED_NAME 0x6e616d65ULL
+#define DOM_HASH_SEED_ATTR 0x61747472ULL
+#define DOM_HASH_SEED_TEXT 0x74657874ULL
+#define DOM_HASH_SEED_USER 0x75736572ULL
+
+
+
+/*
+ * Reads 8 bytes as a little-endian number, so the hash is the same on all
+ * platforms.
+ */
+static uint64_t dom_hash_load(const unsigned char *p, size_t len){
+	uint64_t k=0;
+
+	while(len--){
+		k=(k<<8)|p[len];
+	}
+	return k;
+}
+
+static uint64_t dom_hash_mix(uint64_t h){
+	h^=h>>33;
+	h*=0xff51afd7ed558ccdULL;
+	h^=h>>33;
+	h*=0xc4ceb9fe1a85ec53ULL;
+	h^=h>>33;
+	return h;
+}
+
+/*
+ * Hashes len bytes 8 at a time, as MurmurHash64A does.
+ */
+static uint64_t dom_hash_bytes(uint64_t seed, const char *data, size_t len){
+	const unsigned char *p=(const unsigned char *)data;
+	uint64_t h=seed^(len*DOM_HASH_M);
+	uint64_t k;
+
+	for(; len>=8; p+=8, len-=8){
+		k=dom_hash_load(p, 8)*DOM_HASH_M;
+		k^=k>>47;
+		h=(h^(k*DOM_HASH_M))*DOM_HASH_M;
+	}
+	if(len){
+		h=(h^dom_hash_load(p, len))*DOM_HASH_M;
+	}
+	return dom_hash_mix(h);
+}
+
+static uint64_t dom_hash_combine(uint64_t h, uint64_t v){
+	return dom_hash_mix(h^(v+DOM_HASH_GOLDEN+(h<<6)+(h>>2)));
+}
+
+/*
+ * Hashes text with leading and trailing white space removed.
+ */
+static uint64_t dom_hash_text(uint64_t seed, const char *text, size_t len){
+	while(len && DOM_SPACE(*text)){
+		text++;
+		len--;
+	}
+	while(len && DOM_SPACE(text[len-1])){
+		len--;
+	}
+	return dom_hash_bytes(seed, text, len);
+}
+
+static uint64_t dom_hash_node(dom_t *node, int flags){
+	const dom_attr_t *attr;
+	uint64_t h;
+	uint64_t attrs;
+	uint64_t a;
+	dom_t *child;
+
+	h=dom_hash_bytes(DOM_HASH_SEED_NAME, node->name, strlen(node->name));
+	attrs=0;
+	for(attr=node->attr; attr; attr=attr->next){
+		a=dom_hash_bytes(DOM_HASH_SEED_ATTR, attr->var, strlen(attr->var));
+		a=dom_hash_bytes(a, attr->val, strlen(attr->val));
+		//a sum does not depend on the order of the attributes
+		attrs=(flags & DOM_HASH_ATTR_ORDER)? dom_hash_combine(attrs, a) : attrs+a;
+	}
+	h=dom_hash_combine(h, attrs);
+
+	h=dom_hash_combine(h, dom_hash_text(DOM_HASH_SEED_TEXT, node->data, node->data_len));
+	//text of CDATA sections is a part of data and counts separately as well
+	h=dom_hash_combine(h, dom_hash_text(DOM_HASH_SEED_USER, node->user_data, node->user_data_len));
+
+	for(child=node->child; child; child=child->next){
+		h=dom_hash_combine(h, dom_hash(child, flags));
+	}
+	//0 means that the hash is not cached
+	return h? h : 1;
+}
+
+uint64_t dom_hash(dom_t *node, int flags){
+	uint64_t h;
+
+	if( !node){
+		return 0;
+	}
+	if(flags){
+		return dom_hash_node(node, flags);
+	}
+	if( !(h=__atomic_load_n(&node->hash, __ATOMIC_RELAXED))){
+		h=dom_hash_node(node, 0);
+		__atomic_store_n(&node->hash, h, __ATOMIC_RELAXED);
+	}
+	return h;
+}
+
+void dom_hash_invalidate(dom_t *node){
+	//a node is hashed only together with all its descendants
+	while(node && __atomic_load_n(&node->hash, __ATOMIC_RELAXED)){
+		__atomic_store_n(&node->hash, 0, __ATOMIC_RELAXED);
+		node=node->parent;
+	}
+}
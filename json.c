@@ -0,0 +1,549 @@
+/*
+ * Copyright (c) 2011 Sergey Kolotsey.
+ * This file if part of expat-dom library.
+ * See the file COPYING for copying permission.
+ *
+ * This file defines dom_xml_to_json() that writes JSON from expat events
+ * without building a tree. Only the open elements and the output that waits
+ * for the next sibling of an element are kept in memory.
+ */
+
+#include "expat-config.h"
+
+#ifdef STDC_HEADERS
+# include <stdlib.h>
+# include <stddef.h>
+#else
+# ifdef HAVE_STDLIB_H
+#  include <stdlib.h>
+# endif
+#endif
+#ifdef HAVE_STRING_H
+# if !defined STDC_HEADERS && defined HAVE_MEMORY_H
+#  include <memory.h>
+# endif
+# include <string.h>
+#endif
+#include <limits.h>
+#include <errno.h>
+#include <expat.h>
+#include "expat-dom-private.h"
+
+
+
+//output is passed to the callback in blocks of about this size
+#define DOM_JSON_BUFFER 65536
+//initial size of the buffers
+#define DOM_JSON_INITIAL 256
+//size of pieces of input passed to expat, which takes int lengths
+#define DOM_JSON_CHUNK (1<<28)
+#define DOM_JSON_NONE ((size_t)-1)
+
+/*
+ * Open element. Its children with the same name that follow each other make
+ * a run, which is written as one member of the object. The first element of
+ * a run is written after a space that is replaced by '[' if a sibling with
+ * the same name follows and removed otherwise, until then the output from
+ * the space on is not passed to the callback.
+ */
+typedef struct{
+	//length of names when the element started, the name of its run follows
+	size_t top;
+	//length of text when the element started
+	size_t text;
+	//offset of the space before the first element of the run in out, or
+	//DOM_JSON_NONE if the run is known to be an array or a single value
+	size_t mark;
+	int run;
+	int array;
+	//1 if '{' has been written
+	int object;
+	int members;
+	//offset of the text since the last child in text and 1 if it is white
+	//space only; such text is dropped when the next child starts
+	size_t segment;
+	int blank;
+}dom_json_frame_t;
+
+typedef struct{
+	XML_Parser parser;
+	dom_write_cb write;
+	void *ctx;
+	dom_json_options_t options;
+	dom_parse_options_t parse;
+	size_t prefix_len;
+	size_t text_key_len;
+
+	char *out;
+	size_t out_len;
+	size_t out_size;
+	size_t flush_at;
+	char *names;
+	size_t names_len;
+	size_t names_size;
+	char *text;
+	size_t text_len;
+	size_t text_size;
+
+	//frames[0] stands for the document, the object the root is a member of
+	dom_json_frame_t *frames;
+	int depth;
+	int frames_size;
+	int status;
+}dom_json_t;
+
+
+
+static void dom_json_stop(dom_json_t *j, int status){
+	if( !j->status){
+		j->status=status;
+		XML_StopParser(j->parser, XML_FALSE);
+	}
+}
+
+/*
+ * Makes the buffer hold at least need bytes. Returns 0 or stops the parser.
+ */
+static int dom_json_grow(dom_json_t *j, char **buffer, size_t *size, size_t need){
+	size_t n;
+	char *temp;
+
+	if(need<=*size){
+		return 0;
+	}
+	for(n=*size? *size : DOM_JSON_INITIAL; n<need; n*=2){
+		if(n>SIZE_MAX/2){
+			dom_json_stop(j, E2BIG);
+			return E2BIG;
+		}
+	}
+	if(NULL==(temp=realloc(*buffer, n))){
+		dom_json_stop(j, ENOMEM);
+		return ENOMEM;
+	}
+	*buffer=temp;
+	*size=n;
+	return 0;
+}
+
+static void dom_json_put(dom_json_t *j, const char *s, size_t len){
+	if( !dom_json_grow(j, &j->out, &j->out_size, j->out_len+len)){
+		memcpy(j->out+j->out_len, s, len);
+		j->out_len+=len;
+	}
+}
+
+static void dom_json_putc(dom_json_t *j, char c){
+	if(j->out_len<j->out_size || !dom_json_grow(j, &j->out, &j->out_size, j->out_len+1)){
+		j->out[j->out_len++]=c;
+	}
+}
+
+static char *dom_json_escape(char *o, const char *s, size_t len){
+	static const char hex[]="0123456789abcdef";
+	const unsigned char *p=(const unsigned char *)s;
+	const unsigned char *end=p+len;
+
+	for(; p<end; p++){
+		if(*p>=0x20 && *p !='"' && *p !='\\'){
+			*o++=*p;
+			continue;
+		}
+		*o++='\\';
+		switch(*p){
+		case '"':
+		case '\\':
+			*o++=*p;
+			break;
+		case '\b':
+			*o++='b';
+			break;
+		case '\f':
+			*o++='f';
+			break;
+		case '\n':
+			*o++='n';
+			break;
+		case '\r':
+			*o++='r';
+			break;
+		case '\t':
+			*o++='t';
+			break;
+		default:
+			*o++='u';
+			*o++='0';
+			*o++='0';
+			*o++=hex[*p>>4];
+			*o++=hex[*p & 0xf];
+		}
+	}
+	return o;
+}
+
+/*
+ * Writes a JSON string of prefix and s.
+ */
+static void dom_json_string(dom_json_t *j, const char *prefix, size_t prefix_len, const char *s, size_t len){
+	char *o;
+
+	//every byte takes at most 6 bytes escaped
+	if(len>SIZE_MAX/12 || prefix_len>SIZE_MAX/12){
+		dom_json_stop(j, E2BIG);
+		return;
+	}
+	if(dom_json_grow(j, &j->out, &j->out_size, j->out_len+6*(prefix_len+len)+2)){
+		return;
+	}
+	o=j->out+j->out_len;
+	*o++='"';
+	o=dom_json_escape(o, prefix, prefix_len);
+	o=dom_json_escape(o, s, len);
+	*o++='"';
+	j->out_len=o-j->out;
+}
+
+/*
+ * Removes the space before the first element of the run of frame i, which
+ * turned out to be a single value, from the held back output.
+ */
+static void dom_json_unmark(dom_json_t *j, int i){
+	size_t mark=j->frames[i].mark;
+
+	memmove(j->out+mark, j->out+mark+1, j->out_len-mark-1);
+	j->out_len--;
+	j->frames[i].mark=DOM_JSON_NONE;
+	for(i++; i<=j->depth; i++){
+		if(j->frames[i].mark !=DOM_JSON_NONE){
+			j->frames[i].mark--;
+		}
+	}
+}
+
+/*
+ * Passes the output to the callback up to the first run that may still turn
+ * out to be an array. A run that holds back more than the lookahead is
+ * written as a single value.
+ */
+static void dom_json_flush(dom_json_t *j){
+	size_t len=j->out_len;
+	int ret;
+	int i;
+
+	for(i=0; i<=j->depth; i++){
+		if(j->frames[i].mark==DOM_JSON_NONE){
+			continue;
+		}
+		if(j->out_len-j->frames[i].mark<=j->options.lookahead){
+			len=j->frames[i].mark;
+			break;
+		}
+		dom_json_unmark(j, i);
+		len=j->out_len;
+	}
+	if(len && (ret=j->write(j->ctx, j->out, len))){
+		dom_json_stop(j, ret);
+		return;
+	}
+	memmove(j->out, j->out+len, j->out_len-len);
+	j->out_len-=len;
+	for(; i<=j->depth; i++){
+		if(j->frames[i].mark !=DOM_JSON_NONE){
+			j->frames[i].mark-=len;
+		}
+	}
+	j->flush_at=j->out_len+DOM_JSON_BUFFER;
+}
+
+static int dom_json_hinted(const dom_json_t *j, const char *name){
+	const char * const *p;
+
+	for(p=j->options.arrays; p && *p; p++){
+		if(0==strcmp(*p, name)){
+			return 1;
+		}
+	}
+	return 0;
+}
+
+static void XMLCALL dom_json_start(void *user_data, const char *name, const char **atts){
+	dom_json_t *j=(dom_json_t *)user_data;
+	dom_json_frame_t *parent;
+	dom_json_frame_t *f;
+	dom_json_frame_t *temp;
+	size_t name_len;
+	int size;
+	int i;
+
+	if(j->status){
+		return;
+	}
+	if(j->parse.max_depth && j->depth>=j->parse.max_depth){
+		dom_json_stop(j, E2BIG);
+		return;
+	}
+	if(j->depth+1==j->frames_size){
+		if(j->frames_size>INT_MAX/2){
+			dom_json_stop(j, E2BIG);
+			return;
+		}
+		size=j->frames_size*2;
+		if(NULL==(temp=realloc(j->frames, size*sizeof(dom_json_frame_t)))){
+			dom_json_stop(j, ENOMEM);
+			return;
+		}
+		j->frames=temp;
+		j->frames_size=size;
+	}
+	parent=&j->frames[j->depth];
+	//white space between elements is not text, it is not kept
+	if(parent->blank){
+		j->text_len=parent->segment;
+	}
+	if( !parent->object){
+		dom_json_putc(j, '{');
+		parent->object=1;
+	}
+	name_len=strlen(name);
+	if(parent->run && 0==strcmp(j->names+parent->top, name)){
+		if(parent->mark !=DOM_JSON_NONE){
+			j->out[parent->mark]='[';
+			parent->mark=DOM_JSON_NONE;
+			parent->array=1;
+		}else if( !parent->array){
+			//the first element has been written as a single value
+			dom_json_stop(j, E2BIG);
+			return;
+		}
+		dom_json_putc(j, ',');
+	}else{
+		if(parent->array){
+			dom_json_putc(j, ']');
+		}
+		if(parent->mark !=DOM_JSON_NONE){
+			dom_json_unmark(j, j->depth);
+		}
+		parent->array=0;
+		if(parent->members++){
+			dom_json_putc(j, ',');
+		}
+		j->names_len=parent->top;
+		if(dom_json_grow(j, &j->names, &j->names_size, j->names_len+name_len+1)){
+			return;
+		}
+		memcpy(j->names+j->names_len, name, name_len+1);
+		j->names_len+=name_len+1;
+		parent->run=1;
+		dom_json_string(j, NULL, 0, name, name_len);
+		dom_json_putc(j, ':');
+		if(j->depth && ((j->options.flags & DOM_JSON_ARRAYS) || dom_json_hinted(j, name))){
+			dom_json_putc(j, '[');
+			parent->array=1;
+		}else if(j->depth){
+			parent->mark=j->out_len;
+			dom_json_putc(j, ' ');
+		}
+	}
+
+	f=&j->frames[++j->depth];
+	f->top=j->names_len;
+	f->text=j->text_len;
+	f->mark=DOM_JSON_NONE;
+	f->run=0;
+	f->array=0;
+	f->object=0;
+	f->members=0;
+	f->segment=j->text_len;
+	f->blank=1;
+	if(atts[0]){
+		dom_json_putc(j, '{');
+		f->object=1;
+		for(i=0; atts[i]; i+=2){
+			if(f->members++){
+				dom_json_putc(j, ',');
+			}
+			dom_json_string(j, j->options.attr_prefix, j->prefix_len, atts[i], strlen(atts[i]));
+			dom_json_putc(j, ':');
+			dom_json_string(j, NULL, 0, atts[i+1], strlen(atts[i+1]));
+		}
+	}
+	if(j->out_len>=j->flush_at){
+		dom_json_flush(j);
+	}
+}
+
+static void XMLCALL dom_json_end(void *user_data, const char *name){
+	dom_json_t *j=(dom_json_t *)user_data;
+	dom_json_frame_t *f=&j->frames[j->depth];
+	const char *text;
+	size_t len;
+	size_t i;
+
+	if(j->status){
+		return;
+	}
+	if(f->object && f->blank){
+		j->text_len=f->segment;
+	}
+	text=j->text+f->text;
+	len=j->text_len-f->text;
+	if(f->array){
+		dom_json_putc(j, ']');
+	}
+	if(f->mark !=DOM_JSON_NONE){
+		dom_json_unmark(j, j->depth);
+	}
+	if(j->parse.flags & DOM_PARSE_TRIM){
+		while(len && DOM_SPACE(*text)){
+			text++;
+			len--;
+		}
+		while(len && DOM_SPACE(text[len-1])){
+			len--;
+		}
+	}
+	if(f->object){
+		//white space between elements is not text
+		for(i=0; i<len && DOM_SPACE(text[i]); i++);
+		if(i<len){
+			if(f->members){
+				dom_json_putc(j, ',');
+			}
+			dom_json_string(j, NULL, 0, j->options.text_key, j->text_key_len);
+			dom_json_putc(j, ':');
+			dom_json_string(j, NULL, 0, text, len);
+		}
+		dom_json_putc(j, '}');
+	}else if(j->text_len>f->text){
+		dom_json_string(j, NULL, 0, text, len);
+	}else{
+		dom_json_put(j, "null", 4);
+	}
+	j->text_len=f->text;
+	j->names_len=f->top;
+	j->depth--;
+	j->frames[j->depth].segment=j->text_len;
+	j->frames[j->depth].blank=1;
+	if(j->out_len>=j->flush_at){
+		dom_json_flush(j);
+	}
+}
+
+static void XMLCALL dom_json_data(void *user_data, const char *s, int len){
+	dom_json_t *j=(dom_json_t *)user_data;
+	dom_json_frame_t *f=&j->frames[j->depth];
+	int i;
+
+	if( !j->status && !dom_json_grow(j, &j->text, &j->text_size, j->text_len+len)){
+		memcpy(j->text+j->text_len, s, len);
+		j->text_len+=len;
+		for(i=0; f->blank && i<len; i++){
+			if( !DOM_SPACE(s[i])){
+				f->blank=0;
+			}
+		}
+	}
+}
+
+static void XMLCALL dom_json_doctype(void *user_data, const char *name, const char *sysid, const char *pubid,
+		int has_internal_subset){
+	dom_json_stop((dom_json_t *)user_data, EPERM);
+}
+
+static void XMLCALL dom_json_entity(void *user_data, const char *name, int is_parameter_entity,
+		const char *value, int value_length, const char *base, const char *sysid, const char *pubid,
+		const char *notation){
+	if(sysid){
+		dom_json_stop((dom_json_t *)user_data, EPERM);
+	}
+}
+
+static int XMLCALL dom_json_external_entity(XML_Parser parser, const char *context, const char *base,
+		const char *sysid, const char *pubid){
+	dom_json_stop((dom_json_t *)XML_GetUserData(parser), EPERM);
+	return XML_STATUS_ERROR;
+}
+
+/*
+ * Parses the whole buffer and writes the rest of the output. Returns 0 or
+ * error code.
+ */
+static int dom_json_parse(dom_json_t *j, const char *buffer, size_t buffer_len){
+	enum XML_Status ret;
+	int len;
+
+	do{
+		len=buffer_len>DOM_JSON_CHUNK? DOM_JSON_CHUNK : (int)buffer_len;
+		ret=XML_Parse(j->parser, buffer, len, (size_t)len==buffer_len);
+		buffer+=len;
+		buffer_len-=len;
+	}while(ret !=XML_STATUS_ERROR && buffer_len);
+	if(ret==XML_STATUS_ERROR){
+		return j->status? j->status : EINVAL;
+	}
+	dom_json_putc(j, '}');
+	dom_json_flush(j);
+	return j->status;
+}
+
+int dom_xml_to_json(const char *buffer, size_t buffer_len, dom_write_cb write, void *ctx,
+		const dom_json_options_t *options){
+	dom_json_t j;
+	int ret;
+
+	if( !buffer || !write){
+		return EINVAL;
+	}
+	memset(&j, 0, sizeof(j));
+	if(options){
+		j.options=*options;
+		if(options->parse){
+			j.parse=*options->parse;
+		}
+	}
+	if( !j.options.attr_prefix){
+		j.options.attr_prefix="@";
+	}
+	if( !j.options.text_key){
+		j.options.text_key="#text";
+	}
+	if( !j.options.lookahead){
+		j.options.lookahead=DOM_JSON_LOOKAHEAD;
+	}
+	if(j.parse.max_input_bytes && buffer_len>(uint64_t)j.parse.max_input_bytes){
+		return E2BIG;
+	}
+	j.prefix_len=strlen(j.options.attr_prefix);
+	j.text_key_len=strlen(j.options.text_key);
+	j.write=write;
+	j.ctx=ctx;
+	j.flush_at=DOM_JSON_BUFFER;
+	j.frames_size=16;
+	j.out_size=j.names_size=j.text_size=DOM_JSON_INITIAL;
+	j.frames=calloc(j.frames_size, sizeof(dom_json_frame_t));
+	j.out=malloc(j.out_size);
+	j.names=malloc(j.names_size);
+	j.text=malloc(j.text_size);
+	if(j.frames && j.out && j.names && j.text && (j.parser=XML_ParserCreate(NULL))){
+		j.frames[0].mark=DOM_JSON_NONE;
+		XML_SetUserData(j.parser, &j);
+		XML_SetElementHandler(j.parser, dom_json_start, dom_json_end);
+		XML_SetCharacterDataHandler(j.parser, dom_json_data);
+		if(j.parse.flags & DOM_PARSE_NO_DTD){
+			XML_SetStartDoctypeDeclHandler(j.parser, dom_json_doctype);
+		}
+		if(j.parse.flags & DOM_PARSE_NO_EXTERNAL_ENTITIES){
+			XML_SetEntityDeclHandler(j.parser, dom_json_entity);
+			XML_SetExternalEntityRefHandler(j.parser, dom_json_external_entity);
+		}
+		ret=dom_json_parse(&j, buffer, buffer_len);
+		XML_ParserFree(j.parser);
+	}else{
+		ret=ENOMEM;
+	}
+	free(j.frames);
+	free(j.out);
+	free(j.names);
+	free(j.text);
+	return ret;
+}
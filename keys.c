@@ -0,0 +1,299 @@
+/*
+ * Copyright (c) 2011 Sergey Kolotsey.
+ * This file if part of expat-dom library.
+ * See the file COPYING for copying permission.
+ *
+ * This file defines the key index: a hash table from a value of an attribute
+ * to the elements that have the attribute with that value, so references by
+ * id are resolved without searching the tree.
+ */
+
+#include "expat-config.h"
+
+#ifdef STDC_HEADERS
+# include <stdlib.h>
+# include <stddef.h>
+#else
+# ifdef HAVE_STDLIB_H
+#  include <stdlib.h>
+# endif
+#endif
+#ifdef HAVE_STRING_H
+# if !defined STDC_HEADERS && defined HAVE_MEMORY_H
+#  include <memory.h>
+# endif
+# include <string.h>
+#endif
+#ifdef HAVE_STRINGS_H
+# include <strings.h>
+#endif
+#include <errno.h>
+#include <limits.h>
+#include "expat-dom-private.h"
+
+
+
+//initial number of slots of the table, always a power of 2
+#define DOM_KEY_SLOTS 256
+
+//one distinct value: its hash and the first and the last of its elements
+typedef struct{
+	uint64_t hash;
+	int head;
+	int tail;
+}dom_key_slot_t;
+
+//one indexed element and the next element with the same value
+typedef struct{
+	dom_t *node;
+	int dup;
+}dom_key_entry_t;
+
+struct dom_key_index_s{
+	//element name or NULL for any element, and attribute name
+	char *name;
+	char *attr;
+
+	//open addressing table of distinct values, head is -1 in free slots
+	dom_key_slot_t *slots;
+	size_t size;
+	size_t count;
+
+	//elements in the order they were added
+	dom_key_entry_t *entries;
+	int entry_count;
+	int entry_size;
+};
+
+
+
+static uint64_t dom_key_hash(const char *value){
+	const unsigned char *p=(const unsigned char *)value;
+	uint64_t hash=DOM_FNV_OFFSET;
+
+	while(*p){
+		hash=(hash^*p++)*DOM_FNV_PRIME;
+	}
+	return hash;
+}
+
+/*
+ * Returns the value the element is indexed by. Values are not copied, they
+ * are looked up in the element every time, so an element that has become an
+ * alias with DOM_PARSE_DEDUP still finds its value.
+ */
+static const char *dom_key_value(const dom_key_index_t *index, const dom_t *node){
+	return dom_find_attr(node->attr, index->attr);
+}
+
+/*
+ * Returns the slot of the value, or the free slot where it belongs.
+ */
+static dom_key_slot_t *dom_key_slot(const dom_key_index_t *index, const char *value, uint64_t hash){
+	dom_key_slot_t *slot;
+	size_t i;
+
+	for(i=hash&(index->size-1); ; i=(i+1)&(index->size-1)){
+		slot=&index->slots[i];
+		if(slot->head<0 || (slot->hash==hash
+				&& 0==strcmp(dom_key_value(index, index->entries[slot->head].node), value))){
+			return slot;
+		}
+	}
+}
+
+static dom_key_slot_t *dom_key_slots_new(size_t size){
+	dom_key_slot_t *slots;
+	size_t i;
+
+	if((slots=malloc(size*sizeof(dom_key_slot_t)))){
+		for(i=0; i<size; i++){
+			slots[i].head=-1;
+		}
+	}
+	return slots;
+}
+
+/*
+ * Links entry i into the table, which must have a free slot.
+ */
+static void dom_key_link(dom_key_index_t *index, int i){
+	const char *value=dom_key_value(index, index->entries[i].node);
+	uint64_t hash=dom_key_hash(value);
+	dom_key_slot_t *slot=dom_key_slot(index, value, hash);
+
+	index->entries[i].dup=-1;
+	if(slot->head<0){
+		slot->hash=hash;
+		slot->head=slot->tail=i;
+		index->count++;
+	}else{
+		index->entries[slot->tail].dup=i;
+		slot->tail=i;
+	}
+}
+
+/*
+ * Links all the entries into the emptied table.
+ */
+static void dom_key_relink(dom_key_index_t *index){
+	size_t i;
+	int j;
+
+	for(i=0; i<index->size; i++){
+		index->slots[i].head=-1;
+	}
+	index->count=0;
+	for(j=0; j<index->entry_count; j++){
+		dom_key_link(index, j);
+	}
+}
+
+dom_key_index_t *dom_key_index_new(const char *name, const char *attr){
+	dom_key_index_t *index;
+
+	if( !attr){
+		errno=EINVAL;
+		return NULL;
+	}
+	if(NULL==(index=calloc(1, sizeof(dom_key_index_t)))){
+		return NULL;
+	}
+	if((name && strcmp(name, "*") && NULL==(index->name=strdup(name)))
+			|| NULL==(index->attr=strdup(attr))
+			|| NULL==(index->slots=dom_key_slots_new(DOM_KEY_SLOTS))){
+		dom_key_index_free(index);
+		errno=ENOMEM;
+		return NULL;
+	}
+	index->size=DOM_KEY_SLOTS;
+	return index;
+}
+
+void dom_key_index_free(dom_key_index_t *index){
+	if(index){
+		free(index->name);
+		free(index->attr);
+		free(index->slots);
+		free(index->entries);
+		free(index);
+	}
+}
+
+int dom_key_index_add_node(dom_key_index_t *index, dom_t *node){
+	dom_key_slot_t *slots;
+	dom_key_entry_t *temp;
+	int size;
+
+	if( !dom_key_value(index, node) || (index->name && strcasecmp(node->name, index->name))){
+		return 0;
+	}
+	if(index->entry_count==index->entry_size){
+		if(index->entry_size>INT_MAX/2){
+			return ENOMEM;
+		}
+		size=index->entry_size? index->entry_size*2 : DOM_KEY_SLOTS;
+		if(NULL==(temp=realloc(index->entries, size*sizeof(dom_key_entry_t)))){
+			return ENOMEM;
+		}
+		index->entries=temp;
+		index->entry_size=size;
+	}
+	//the table is kept at most half full
+	if(2*(index->count+1)>index->size){
+		if(NULL==(slots=dom_key_slots_new(index->size*2))){
+			return ENOMEM;
+		}
+		free(index->slots);
+		index->slots=slots;
+		index->size*=2;
+		dom_key_relink(index);
+	}
+	index->entries[index->entry_count].node=node;
+	dom_key_link(index, index->entry_count++);
+	return 0;
+}
+
+int dom_key_index_count(const dom_key_index_t *index){
+	return index->entry_count;
+}
+
+void dom_key_index_truncate(dom_key_index_t *index, int count){
+	if(count<index->entry_count){
+		index->entry_count=count;
+		dom_key_relink(index);
+	}
+}
+
+int dom_key_index_add(dom_key_index_t *index, dom_t *root){
+	dom_t *node;
+	int count;
+
+	if( !index || !root){
+		return EINVAL;
+	}
+	count=index->entry_count;
+	for(node=root; node; ){
+		if(dom_key_index_add_node(index, node)){
+			dom_key_index_truncate(index, count);
+			return ENOMEM;
+		}
+		//children of an alias are indexed with the subtree it shares them with
+		if(node->child && !node->alias){
+			node=node->child;
+			continue;
+		}
+		while(node !=root && !node->next){
+			node=node->parent;
+		}
+		node=(node==root)? NULL : node->next;
+	}
+	return 0;
+}
+
+dom_key_index_t *dom_build_key_index(dom_t *root, const char *name, const char *attr){
+	dom_key_index_t *index;
+	int ret;
+
+	if( !root){
+		errno=EINVAL;
+		return NULL;
+	}
+	if(NULL==(index=dom_key_index_new(name, attr))){
+		return NULL;
+	}
+	if((ret=dom_key_index_add(index, root))){
+		dom_key_index_free(index);
+		errno=ret;
+		return NULL;
+	}
+	return index;
+}
+
+dom_t *dom_key_lookup(const dom_key_index_t *index, const char *value){
+	dom_key_slot_t *slot;
+
+	if( !index || !value){
+		return NULL;
+	}
+	slot=dom_key_slot(index, value, dom_key_hash(value));
+	return slot->head<0? NULL : index->entries[slot->head].node;
+}
+
+dom_t *dom_key_lookup_next(const dom_key_index_t *index, const dom_t *node){
+	const char *value;
+	dom_key_slot_t *slot;
+	int i;
+
+	if( !index || !node || NULL==(value=dom_key_value(index, node))){
+		return NULL;
+	}
+	slot=dom_key_slot(index, value, dom_key_hash(value));
+	for(i=slot->head; i>=0; i=index->entries[i].dup){
+		if(index->entries[i].node==node){
+			i=index->entries[i].dup;
+			return i<0? NULL : index->entries[i].node;
+		}
+	}
+	return NULL;
+}
@@ -0,0 +1,358 @@
+/*
+ * Copyright (c) 2011 Sergey Kolotsey.
+ * This file if part of expat-dom library.
+ * See the file COPYING for copying permission.
+ *
+ * This file defines support of XML namespaces: the reference counted table of
+ * interned namespace URIs, local names and prefixes, construction of nodes
+ * from names reported by namespace-aware expat parser and lookups by
+ * namespace.
+ */
+
+#include "expat-config.h"
+
+#ifdef STDC_HEADERS
+# include <stdlib.h>
+# include <stddef.h>
+#else
+# ifdef HAVE_STDLIB_H
+#  include <stdlib.h>
+# endif
+#endif
+#ifdef HAVE_STRING_H
+# if !defined STDC_HEADERS && defined HAVE_MEMORY_H
+#  include <memory.h>
+# endif
+# include <string.h>
+#endif
+#include <errno.h>
+#include "expat-dom-private.h"
+
+
+
+#define DOM_NS_BUCKETS 1024
+
+#define DOM_XMLNS_URI "http://www.w3.org/2000/xmlns/"
+
+/*
+ * Interned strings are reference counted, an entry is freed when the last
+ * node, attribute or parser cache using it is freed. Buckets are changed and
+ * searched under a spin lock, so that a lookup never finds an entry being
+ * freed. References of a string already held are taken without the lock.
+ */
+typedef struct dom_ns_entry_s dom_ns_entry_t;
+struct dom_ns_entry_s{
+	dom_ns_entry_t *next;
+	unsigned int hash;
+	int refs;
+	char str[];
+};
+
+#define DOM_NS_ENTRY(s) ((dom_ns_entry_t *)((char *)(s)-offsetof(dom_ns_entry_t, str)))
+
+static dom_ns_entry_t *dom_ns_table[DOM_NS_BUCKETS];
+static int dom_ns_lock;
+
+static unsigned int dom_ns_hash(const char *str, int len){
+	unsigned int hash=2166136261u;
+
+	while(len--){
+		hash=(hash ^ (unsigned char)*str++)*16777619u;
+	}
+	return hash;
+}
+
+/*
+ * Returns interned copy of first len bytes of str with one reference taken
+ * for the caller. If insert is 0 and the string has not been interned yet,
+ * returns NULL.
+ */
+static const char *dom_ns_get(const char *str, int len, unsigned int hash, int insert){
+	dom_ns_entry_t **bucket=&dom_ns_table[hash%DOM_NS_BUCKETS];
+	dom_ns_entry_t *entry;
+
+	while(__atomic_exchange_n(&dom_ns_lock, 1, __ATOMIC_ACQUIRE));
+	for(entry=*bucket; entry; entry=entry->next){
+		if(entry->hash==hash && 0==strncmp(entry->str, str, len) && !entry->str[len]){
+			break;
+		}
+	}
+	if(entry){
+		__atomic_add_fetch(&entry->refs, 1, __ATOMIC_RELAXED);
+	}else if(insert && (entry=malloc(sizeof(dom_ns_entry_t)+len+1))){
+		memcpy(entry->str, str, len);
+		entry->str[len]=0;
+		entry->hash=hash;
+		entry->refs=1;
+		entry->next=*bucket;
+		*bucket=entry;
+	}
+	__atomic_store_n(&dom_ns_lock, 0, __ATOMIC_RELEASE);
+	return entry? entry->str : NULL;
+}
+
+const char *dom_ns_ref(const char *str){
+	if(str){
+		__atomic_add_fetch(&DOM_NS_ENTRY(str)->refs, 1, __ATOMIC_RELAXED);
+	}
+	return str;
+}
+
+void dom_ns_release(const char *str){
+	dom_ns_entry_t *entry;
+	dom_ns_entry_t **prev;
+	int refs;
+
+	if( !str){
+		return;
+	}
+	entry=DOM_NS_ENTRY(str);
+	refs=__atomic_load_n(&entry->refs, __ATOMIC_RELAXED);
+	//the last reference is only dropped under the lock
+	while(refs>1){
+		if(__atomic_compare_exchange_n(&entry->refs, &refs, refs-1, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED)){
+			return;
+		}
+	}
+	while(__atomic_exchange_n(&dom_ns_lock, 1, __ATOMIC_ACQUIRE));
+	if(0==__atomic_sub_fetch(&entry->refs, 1, __ATOMIC_ACQ_REL)){
+		for(prev=&dom_ns_table[entry->hash%DOM_NS_BUCKETS]; *prev !=entry; prev=&(*prev)->next);
+		*prev=entry->next;
+		free(entry);
+	}
+	__atomic_store_n(&dom_ns_lock, 0, __ATOMIC_RELEASE);
+}
+
+dom_ns_cache_t *dom_ns_cache_new(void){
+	return calloc(1, sizeof(dom_ns_cache_t));
+}
+
+void dom_ns_cache_free(dom_ns_cache_t *cache){
+	int i;
+
+	if(cache){
+		for(i=0; i<DOM_NS_CACHE; i++){
+			dom_ns_release(cache->str[i]);
+		}
+		free(cache);
+	}
+}
+
+/*
+ * Same as dom_ns_get() with insert 1, but the strings recently used by the
+ * parser are found in its cache without taking the lock. Strings that were
+ * not in the cache are charged to cache->bytes. cache may be NULL.
+ */
+static const char *dom_ns_cached(dom_ns_cache_t *cache, const char *str, int len){
+	unsigned int hash=dom_ns_hash(str, len);
+	const char **slot;
+	const char *ret;
+
+	if( !cache){
+		return dom_ns_get(str, len, hash, 1);
+	}
+	slot=&cache->str[hash%DOM_NS_CACHE];
+	if(*slot && DOM_NS_ENTRY(*slot)->hash==hash && 0==strncmp(*slot, str, len) && !(*slot)[len]){
+		return dom_ns_ref(*slot);
+	}
+	if((ret=dom_ns_get(str, len, hash, 1))){
+		cache->bytes+=sizeof(dom_ns_entry_t)+len+1;
+		dom_ns_release(*slot);
+		*slot=dom_ns_ref(ret);
+	}
+	return ret;
+}
+
+/*
+ * Returns interned str with a reference taken, or NULL if it has never been
+ * interned, in which case no node can have it.
+ */
+static const char *dom_ns_lookup(const char *str){
+	return dom_ns_get(str, strlen(str), dom_ns_hash(str, strlen(str)), 0);
+}
+
+const char *dom_ns_intern(const char *str){
+	if( !str){
+		errno=EINVAL;
+		return NULL;
+	}
+	//the reference is never released, the string stays valid until exit
+	if( !(str=dom_ns_get(str, strlen(str), dom_ns_hash(str, strlen(str)), 1))){
+		errno=ENOMEM;
+	}
+	return str;
+}
+
+/*
+ * Converts name reported by expat in the form "uri<SEP>local<SEP>prefix"
+ * into qualified name "prefix:local". Namespace URI, local name and prefix
+ * are interned, each with a reference that is owned by the returned string.
+ * Returns NULL if there is not enough memory, the output arguments are not
+ * changed then.
+ */
+static char *dom_ns_name(const char *triplet, dom_ns_cache_t *cache, const char **ns, const char **local_name, const char **prefix){
+	const char *uri=NULL;
+	const char *local;
+	const char *pfx=NULL;
+	const char *id[3]={NULL, NULL, NULL};
+	int local_len;
+	int prefix_len=0;
+	char *name=NULL;
+
+	if((local=strchr(triplet, DOM_NS_SEP))){
+		uri=triplet;
+		local++;
+		if((pfx=strchr(local, DOM_NS_SEP))){
+			local_len=pfx-local;
+			pfx++;
+			prefix_len=strlen(pfx);
+		}else{
+			local_len=strlen(local);
+		}
+	}else{
+		local=triplet;
+		local_len=strlen(local);
+	}
+	if((uri && !(id[0]=dom_ns_cached(cache, uri, local-uri-1)))
+			|| !(id[1]=dom_ns_cached(cache, local, local_len))
+			|| (pfx && !(id[2]=dom_ns_cached(cache, pfx, prefix_len)))
+			|| !(name=malloc(prefix_len+local_len+2))){
+		dom_ns_release(id[0]);
+		dom_ns_release(id[1]);
+		dom_ns_release(id[2]);
+		return NULL;
+	}
+	if(prefix_len){
+		memcpy(name, pfx, prefix_len);
+		name[prefix_len++]=':';
+	}
+	memcpy(name+prefix_len, local, local_len);
+	name[prefix_len+local_len]=0;
+	*ns=id[0];
+	*local_name=id[1];
+	*prefix=id[2];
+	return name;
+}
+
+dom_attr_t *dom_ns_decl(dom_attr_t *decls, const char *prefix, const char *uri, dom_ns_cache_t *cache){
+	dom_attr_t *attr;
+	dom_attr_t *temp;
+	int prefix_len=prefix? strlen(prefix) : 0;
+
+	if(NULL==(attr=calloc(1, sizeof(dom_attr_t)))
+			|| NULL==(attr->var=malloc(prefix_len+7))
+			|| NULL==(attr->val=strdup(uri? uri : ""))
+			|| NULL==(attr->ns=dom_ns_cached(cache, DOM_XMLNS_URI, strlen(DOM_XMLNS_URI)))){
+		dom_attr_free(attr);
+		return NULL;
+	}
+	memcpy(attr->var, "xmlns", 5);
+	if(prefix_len){
+		attr->var[5]=':';
+		memcpy(attr->var+6, prefix, prefix_len+1);
+		if( !(attr->local_name=dom_ns_cached(cache, prefix, prefix_len))
+				|| !(attr->prefix=dom_ns_cached(cache, "xmlns", 5))){
+			dom_attr_free(attr);
+			return NULL;
+		}
+	}else{
+		attr->var[5]=0;
+		if( !(attr->local_name=dom_ns_cached(cache, "xmlns", 5))){
+			dom_attr_free(attr);
+			return NULL;
+		}
+	}
+	if(decls){
+		for(temp=decls; temp->next; temp=temp->next);
+		temp->next=attr;
+		return decls;
+	}
+	return attr;
+}
+
+dom_t *dom_node_new_ns(const char *name, const char **atts, dom_attr_t *decls, dom_ns_cache_t *cache){
+	dom_attr_t *tail;
+	dom_attr_t *temp;
+	dom_t *dom;
+
+	if(NULL==(dom=calloc(1, sizeof(dom_t)))){
+		dom_attr_free(decls);
+		return NULL;
+	}
+	if(NULL==(dom->name=dom_ns_name(name, cache, &dom->ns, &dom->local_name, &dom->prefix))){
+		dom_attr_free(decls);
+		free(dom);
+		return NULL;
+	}
+	dom->attr=decls;
+	for(tail=decls; tail && tail->next; tail=tail->next);
+	for(; atts[0]; atts+=2){
+		if(NULL==(temp=calloc(1, sizeof(dom_attr_t)))
+				|| NULL==(temp->var=dom_ns_name(atts[0], cache, &temp->ns, &temp->local_name, &temp->prefix))
+				|| NULL==(temp->val=strdup(atts[1]? atts[1] : ""))){
+			dom_attr_free(temp);
+			return dom_free(dom);
+		}
+		if(tail){
+			tail->next=temp;
+		}else{
+			dom->attr=temp;
+		}
+		tail=temp;
+	}
+	return dom;
+}
+
+char *dom_find_attr_ns(dom_attr_t *attr, const char *ns, const char *local_name){
+	const char *local_id;
+	char *ret=NULL;
+
+	if( !local_name || (ns && !(ns=dom_ns_lookup(ns)))){
+		return NULL;
+	}
+	local_id=dom_ns_lookup(local_name);
+	for(; attr; attr=attr->next){
+		//attributes parsed without DOM_PARSE_NAMESPACES have no local name
+		if(attr->ns==ns && (attr->local_name? attr->local_name==local_id : !ns && 0==strcmp(local_name, attr->var))){
+			ret=attr->val;
+			break;
+		}
+	}
+	dom_ns_release(local_id);
+	dom_ns_release(ns);
+	return ret;
+}
+
+/*
+ * Same as dom_find_node_ns() but ns and local_id are interned. local_id is
+ * NULL if local_name has never been interned.
+ */
+static dom_t *dom_find_node_id(dom_t *root, const char *ns, const char *local_id, const char *local_name){
+	dom_t *ret;
+
+	while(root){
+		if(root->ns==ns && (root->local_name? root->local_name==local_id : !ns && 0==strcmp(local_name, root->name))){
+			return root;
+		}else if(root->child){
+			if((ret=dom_find_node_id(root->child, ns, local_id, local_name))){
+				return ret;
+			}
+		}
+		root=root->next;
+	}
+	return NULL;
+}
+
+dom_t *dom_find_node_ns(dom_t *root, const char *ns, const char *local_name){
+	const char *local_id;
+	dom_t *ret;
+
+	if( !local_name || (ns && !(ns=dom_ns_lookup(ns)))){
+		return NULL;
+	}
+	local_id=dom_ns_lookup(local_name);
+	ret=dom_find_node_id(root, ns, local_id, local_name);
+	dom_ns_release(local_id);
+	dom_ns_release(ns);
+	return ret;
+}
@@ -0,0 +1,652 @@
+/*
+ * Copyright (c) 2011 Sergey Kolotsey.
+ * This file if part of expat-dom library.
+ * See the file COPYING for copying permission.
+ *
+ * expat-dom-query prints elements of XML files selected by a path. The files
+ * are memory mapped and read with the pull reader by several threads, so
+ * memory used per file does not depend on its size.
+ */
+
+#include "expat-config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#if defined HAVE_MMAP && defined HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#define QUERY_MMAP
+#endif
+#include "expat-dom.h"
+
+
+
+//steps of a path are kept in bit masks
+#define QUERY_MAX_STEPS 64
+#define QUERY_MAX_PREDICATES 64
+//output of a thread is written when it grows over this size, a longer match
+//is written in pieces
+#define QUERY_OUTPUT_LEN 65536
+
+#define QUERY_SPACE(a) ((a)==' ' || (a)=='\t' || (a)=='\r' || (a)=='\n')
+
+//step of the path, name is NULL for any element
+typedef struct{
+	char *name;
+	//preceded by // and may match at any depth below the previous step
+	int descendant;
+}query_step_t;
+
+//[@attr] or [@attr='value'] of a step
+typedef struct{
+	int step;
+	char *attr;
+	char *value;
+}query_predicate_t;
+
+typedef struct{
+	query_step_t steps[QUERY_MAX_STEPS];
+	int count;
+	query_predicate_t predicates[QUERY_MAX_PREDICATES];
+	int predicate_count;
+	//attribute selected by the trailing /@name, or NULL
+	char *select;
+	//steps that stay active below the elements they are active for
+	uint64_t descendant;
+}query_path_t;
+
+typedef struct{
+	query_path_t *path;
+	char **files;
+	int count;
+	int tsv;
+	//index of the next file to process
+	int next;
+	pthread_mutex_t lock;
+}query_shared_t;
+
+typedef struct{
+	query_shared_t *shared;
+	pthread_t thread;
+	//output not written yet
+	char *out;
+	size_t out_len;
+	size_t out_size;
+	dom_writer_t *writer;
+	//steps active for the children of every open element
+	uint64_t *active;
+	int active_size;
+	//TSV: text of the current match not written yet, and whether the file
+	//name and the beginning of the text have been written
+	char *text;
+	size_t text_len;
+	size_t text_size;
+	int text_started;
+	//the output lock is held until the current match ends
+	int locked;
+
+	int64_t bytes;
+	long matches;
+	int errors;
+}query_worker_t;
+
+
+
+static int query_reserve(char **buffer, size_t *size, size_t len){
+	char *temp;
+
+	if(len>*size){
+		if(NULL==(temp=realloc(*buffer, len*2))){
+			return ENOMEM;
+		}
+		*buffer=temp;
+		*size=len*2;
+	}
+	return 0;
+}
+
+static int query_put(query_worker_t *w, const char *data, size_t len){
+	if(query_reserve(&w->out, &w->out_size, w->out_len+len)){
+		return ENOMEM;
+	}
+	memcpy(w->out+w->out_len, data, len);
+	w->out_len+=len;
+	return 0;
+}
+
+static int query_write_cb(void *ctx, const char *buffer, size_t buffer_len){
+	return query_put((query_worker_t *)ctx, buffer, buffer_len);
+}
+
+/*
+ * Writes the output of the worker. Whole matches are written at once, so the
+ * output of threads is not mixed within a match. If in_match is set, a match
+ * too long to be kept in memory is being written in pieces, and the lock is
+ * kept until the flush after the match ends. Returns 0 or error code of
+ * write().
+ */
+static int query_flush(query_worker_t *w, int in_match){
+	size_t done;
+	ssize_t len;
+	int ret=0;
+
+	if( !w->locked){
+		pthread_mutex_lock(&w->shared->lock);
+	}
+	for(done=0; done<w->out_len; done+=len){
+		if(-1==(len=write(1, w->out+done, w->out_len-done))){
+			if(errno==EINTR){
+				len=0;
+				continue;
+			}
+			ret=errno;
+			break;
+		}
+	}
+	w->out_len=0;
+	if( !(w->locked=in_match)){
+		pthread_mutex_unlock(&w->shared->lock);
+	}
+	return ret;
+}
+
+/*
+ * Writes the string to TSV output with tabs, new lines and backslashes
+ * escaped.
+ */
+static int query_put_tsv(query_worker_t *w, const char *str, size_t len){
+	const char *end=str+len;
+	const char *p;
+	char esc[2]={'\\', 0};
+
+	for(p=str; p<end; p++){
+		if(*p=='\t' || *p=='\n' || *p=='\r' || *p=='\\'){
+			esc[1]=*p=='\t'? 't' : *p=='\n'? 'n' : *p=='\r'? 'r' : '\\';
+			if(query_put(w, str, p-str) || query_put(w, esc, 2)){
+				return ENOMEM;
+			}
+			str=p+1;
+		}
+	}
+	return query_put(w, str, end-str);
+}
+
+static int query_put_line(query_worker_t *w, const char *file, const char *value, size_t len){
+	while(len && QUERY_SPACE(*value)){
+		value++;
+		len--;
+	}
+	while(len && QUERY_SPACE(value[len-1])){
+		len--;
+	}
+	if(query_put_tsv(w, file, strlen(file)) || query_put(w, "\t", 1)
+			|| query_put_tsv(w, value, len) || query_put(w, "\n", 1)){
+		return ENOMEM;
+	}
+	return 0;
+}
+
+/*
+ * TSV: moves the text of the current match collected so far to the output,
+ * starting the line with the file name. Leading white space of the match is
+ * dropped, trailing white space is kept until more text follows it.
+ */
+static int query_put_text(query_worker_t *w, const char *file){
+	size_t start=0;
+	size_t end=w->text_len;
+
+	while( !w->text_started && start<end && QUERY_SPACE(w->text[start])){
+		start++;
+	}
+	while(end>start && QUERY_SPACE(w->text[end-1])){
+		end--;
+	}
+	if(start==end){
+		if( !w->text_started){
+			w->text_len=0;
+		}
+		return 0;
+	}
+	if( !w->text_started){
+		if(query_put_tsv(w, file, strlen(file)) || query_put(w, "\t", 1)){
+			return ENOMEM;
+		}
+		w->text_started=1;
+	}
+	if(query_put_tsv(w, w->text+start, end-start)){
+		return ENOMEM;
+	}
+	memmove(w->text, w->text+end, w->text_len-end);
+	w->text_len-=end;
+	return 0;
+}
+
+/*
+ * Returns 1 if the element of the start event matches step i of the path.
+ */
+static int query_step_match(const query_path_t *path, int i, const dom_reader_event_t *event){
+	const char *value;
+	int j;
+
+	if(path->steps[i].name && strcasecmp(path->steps[i].name, event->name)){
+		return 0;
+	}
+	for(j=0; j<path->predicate_count; j++){
+		if(path->predicates[j].step==i){
+			value=dom_reader_attr(event, path->predicates[j].attr);
+			if( !value || (path->predicates[j].value && strcmp(value, path->predicates[j].value))){
+				return 0;
+			}
+		}
+	}
+	return 1;
+}
+
+static int query_writer_start(dom_writer_t *writer, const dom_reader_event_t *event){
+	int ret;
+	int i;
+
+	if((ret=dom_writer_start_element(writer, event->name))){
+		return ret;
+	}
+	for(i=0; event->attrs[i]; i+=2){
+		if((ret=dom_writer_attr(writer, event->attrs[i], event->attrs[i+1]))){
+			return ret;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Reads all events of the file and writes the matches. Returns 0 or error
+ * code.
+ */
+static int query_read(query_worker_t *w, dom_reader_t *reader, const char *file){
+	query_path_t *path=w->shared->path;
+	uint64_t last=(uint64_t)1<<(path->count-1);
+	dom_reader_event_t event;
+	uint64_t *temp;
+	uint64_t parent;
+	uint64_t matched;
+	const char *value;
+	int match_depth=-1;
+	size_t mark=0;
+	int type=0;
+	int ret=0;
+	int i;
+
+	w->active[0]=1;
+	while(0==ret && (type=dom_reader_next(reader, &event))>0){
+		if(type==DOM_READER_START){
+			if(event.depth+2>w->active_size){
+				if(NULL==(temp=realloc(w->active, 2*w->active_size*sizeof(uint64_t)))){
+					ret=ENOMEM;
+					break;
+				}
+				w->active=temp;
+				w->active_size*=2;
+			}
+			parent=w->active[event.depth];
+			for(matched=0, i=0; i<path->count; i++){
+				if((parent & ((uint64_t)1<<i)) && query_step_match(path, i, &event)){
+					matched|=(uint64_t)1<<i;
+				}
+			}
+			w->active[event.depth+1]=((matched<<1) | (parent & path->descendant)) & ~(last<<1);
+			if(match_depth>=0){
+				if( !w->shared->tsv){
+					ret=query_writer_start(w->writer, &event);
+				}
+			}else if(matched & last){
+				w->matches++;
+				if(path->select){
+					if((value=dom_reader_attr(&event, path->select))){
+						if(w->shared->tsv){
+							ret=query_put_line(w, file, value, strlen(value));
+						}else if( !(ret=dom_writer_start_element(w->writer, "match"))
+								&& !(ret=dom_writer_attr(w->writer, "file", file))
+								&& !(ret=dom_writer_text(w->writer, value, strlen(value)))
+								&& !(ret=dom_writer_end_element(w->writer))
+								&& !(ret=dom_writer_flush(w->writer))){
+							ret=query_put(w, "\n", 1);
+						}
+					}else{
+						w->matches--;
+					}
+				}else{
+					match_depth=event.depth;
+					mark=w->out_len;
+					if(w->shared->tsv){
+						w->text_len=0;
+						w->text_started=0;
+					}else if( !(ret=dom_writer_start_element(w->writer, "match"))
+							&& !(ret=dom_writer_attr(w->writer, "file", file))){
+						ret=query_writer_start(w->writer, &event);
+					}
+				}
+			}
+		}else if(type==DOM_READER_TEXT && match_depth>=0){
+			if( !w->shared->tsv){
+				ret=dom_writer_text(w->writer, event.text, event.text_len);
+			}else if( !(ret=query_reserve(&w->text, &w->text_size, w->text_len+event.text_len))){
+				memcpy(w->text+w->text_len, event.text, event.text_len);
+				w->text_len+=event.text_len;
+			}
+		}else if(type==DOM_READER_END && match_depth>=0){
+			if( !w->shared->tsv){
+				ret=dom_writer_end_element(w->writer);
+			}
+			if(event.depth==match_depth){
+				match_depth=-1;
+				if(w->shared->tsv && w->text_started){
+					if( !(ret=query_put_text(w, file))){
+						ret=query_put(w, "\n", 1);
+					}
+				}else if(w->shared->tsv){
+					ret=query_put_line(w, file, w->text, w->text_len);
+				}else if( !ret && !(ret=dom_writer_end_element(w->writer)) && !(ret=dom_writer_flush(w->writer))){
+					ret=query_put(w, "\n", 1);
+				}
+			}
+		}
+		if(ret){
+			break;
+		}
+		if(match_depth<0 && w->out_len>=QUERY_OUTPUT_LEN){
+			ret=query_flush(w, 0);
+		}else if(match_depth>=0 && w->out_len+w->text_len>=QUERY_OUTPUT_LEN){
+			//the match is too long to be kept, it can not be dropped any more
+			if( !w->shared->tsv || !(ret=query_put_text(w, file))){
+				ret=query_flush(w, 1);
+			}
+			mark=0;
+		}
+	}
+	if( !ret && type<0){
+		ret=errno;
+	}
+	if(ret && match_depth>=0){
+		//the unfinished match is dropped together with the state of the writer
+		if( !w->shared->tsv){
+			dom_writer_free(w->writer);
+			w->writer=dom_writer_new(query_write_cb, w, 0);
+		}
+		w->out_len=mark;
+		w->matches--;
+	}
+	return ret;
+}
+
+static int query_file(query_worker_t *w, const char *file){
+	dom_parse_options_t options;
+	dom_reader_t *reader=NULL;
+	struct stat st;
+	void *map=NULL;
+	int ret;
+	int fd;
+
+	memset(&options, 0, sizeof(options));
+	options.flags=DOM_PARSE_NO_EXTERNAL_ENTITIES;
+	if(-1==(fd=open(file, O_RDONLY))){
+		return errno;
+	}
+	if(fstat(fd, &st)){
+		ret=errno;
+		close(fd);
+		return ret;
+	}
+#ifdef QUERY_MMAP
+	if(S_ISREG(st.st_mode) && st.st_size>0
+			&& MAP_FAILED !=(map=mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0))){
+		madvise(map, st.st_size, MADV_SEQUENTIAL);
+		reader=dom_reader_new_buffer(map, st.st_size, &options);
+	}else{
+		map=NULL;
+	}
+#endif
+	if( !map){
+		reader=dom_reader_new_fd(fd, &options);
+	}
+	if( !reader){
+		ret=errno;
+	}else{
+		ret=query_read(w, reader, file);
+		dom_reader_free(reader);
+	}
+	if(S_ISREG(st.st_mode)){
+		w->bytes+=st.st_size;
+	}
+#ifdef QUERY_MMAP
+	if(map){
+		munmap(map, st.st_size);
+	}
+#endif
+	close(fd);
+	return ret;
+}
+
+static void *query_worker(void *arg){
+	query_worker_t *w=(query_worker_t *)arg;
+	query_shared_t *shared=w->shared;
+	int ret;
+	int i;
+
+	while((i=__atomic_fetch_add(&shared->next, 1, __ATOMIC_RELAXED))<shared->count){
+		if((ret=query_file(w, shared->files[i]))){
+			fprintf(stderr, "%s: %s\n", shared->files[i], strerror(ret));
+			w->errors++;
+		}
+		if((ret=query_flush(w, 0))){
+			fprintf(stderr, "write: %s\n", strerror(ret));
+			w->errors++;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Parses the path: steps separated by / or //, * for any element, predicates
+ * [@attr] and [@attr='value'] and the last step @attr. A path that does not
+ * start with / matches at any depth. Returns 0, EINVAL or ENOMEM.
+ */
+static int query_parse_path(query_path_t *path, const char *str){
+	query_predicate_t *p;
+	size_t len;
+	char quote;
+
+	memset(path, 0, sizeof(query_path_t));
+	while(*str){
+		if(path->count==QUERY_MAX_STEPS){
+			return EINVAL;
+		}
+		if(*str=='/'){
+			if(*++str=='/'){
+				path->steps[path->count].descendant=1;
+				str++;
+			}
+		}else if(path->count){
+			return EINVAL;
+		}else{
+			path->steps[0].descendant=1;
+		}
+		if(*str=='@'){
+			str++;
+			if( !path->count || !*str || strpbrk(str, "/[]=")){
+				return EINVAL;
+			}
+			return NULL==(path->select=strdup(str))? ENOMEM : 0;
+		}
+		if(0==(len=strcspn(str, "/["))){
+			return EINVAL;
+		}
+		if((len !=1 || *str !='*') && NULL==(path->steps[path->count].name=strndup(str, len))){
+			return ENOMEM;
+		}
+		for(str+=len; *str=='['; str++){
+			if(*++str !='@' || path->predicate_count==QUERY_MAX_PREDICATES){
+				return EINVAL;
+			}
+			p=&path->predicates[path->predicate_count++];
+			p->step=path->count;
+			if(0==(len=strcspn(++str, "=]")) || NULL==(p->attr=strndup(str, len))){
+				return len? ENOMEM : EINVAL;
+			}
+			str+=len;
+			if(*str=='='){
+				quote=*++str;
+				if((quote !='\'' && quote !='"') || NULL==strchr(str+1, quote)){
+					return EINVAL;
+				}
+				len=strchr(str+1, quote)-(str+1);
+				if(NULL==(p->value=strndup(str+1, len))){
+					return ENOMEM;
+				}
+				str+=len+2;
+			}
+			if(*str !=']'){
+				return EINVAL;
+			}
+		}
+		if(path->steps[path->count].descendant){
+			path->descendant|=(uint64_t)1<<path->count;
+		}
+		path->count++;
+	}
+	return path->count? 0 : EINVAL;
+}
+
+static void query_free_path(query_path_t *path){
+	int i;
+
+	for(i=0; i<QUERY_MAX_STEPS; i++){
+		free(path->steps[i].name);
+	}
+	for(i=0; i<QUERY_MAX_PREDICATES; i++){
+		free(path->predicates[i].attr);
+		free(path->predicates[i].value);
+	}
+	free(path->select);
+}
+
+static void usage(const char *name){
+	fprintf(stderr, "Usage: %s [-t] [-s] [-j jobs] path file...\n"
+			"  -t       print matches as TSV: file name and text or attribute value\n"
+			"  -s       print statistics to stderr\n"
+			"  -j jobs  number of threads, default is the number of processors\n"
+			"Path: steps separated by / or //, * for any element, predicates\n"
+			"[@attr] and [@attr='value'], and the last step @attr to print an\n"
+			"attribute, for example //item[@currency='EUR']/name or /feed/item/@id\n", name);
+}
+
+int main(int argc, char *argv[]){
+	query_worker_t *workers;
+	query_shared_t shared;
+	query_path_t path;
+	struct timespec start;
+	struct timespec end;
+	int64_t bytes=0;
+	long matches=0;
+	double seconds;
+	int errors=0;
+	int stats=0;
+	int jobs=0;
+	int ret;
+	int opt;
+	int i;
+
+	memset(&shared, 0, sizeof(shared));
+	while(-1 !=(opt=getopt(argc, argv, "tsj:h"))){
+		switch(opt){
+		case 't':
+			shared.tsv=1;
+			break;
+		case 's':
+			stats=1;
+			break;
+		case 'j':
+			jobs=atoi(optarg);
+			break;
+		default:
+			usage(argv[0]);
+			return 2;
+		}
+	}
+	if(argc-optind<2){
+		usage(argv[0]);
+		return 2;
+	}
+	if(query_parse_path(&path, argv[optind])){
+		fprintf(stderr, "Invalid path: %s\n", argv[optind]);
+		query_free_path(&path);
+		return 2;
+	}
+	shared.path=&path;
+	shared.files=argv+optind+1;
+	shared.count=argc-optind-1;
+	pthread_mutex_init(&shared.lock, NULL);
+	if(jobs<=0 && (jobs=sysconf(_SC_NPROCESSORS_ONLN))<=0){
+		jobs=1;
+	}
+	if(jobs>shared.count){
+		jobs=shared.count;
+	}
+	if(NULL==(workers=calloc(jobs, sizeof(query_worker_t)))){
+		fprintf(stderr, "%s\n", strerror(errno));
+		pthread_mutex_destroy(&shared.lock);
+		query_free_path(&path);
+		return 2;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for(i=0; i<jobs; i++){
+		workers[i].shared=&shared;
+		workers[i].active_size=64;
+		ret=ENOMEM;
+		if(NULL==(workers[i].active=malloc(workers[i].active_size*sizeof(uint64_t)))
+				|| NULL==(workers[i].writer=dom_writer_new(query_write_cb, &workers[i], 0))
+				|| (ret=pthread_create(&workers[i].thread, NULL, query_worker, &workers[i]))){
+			//pthread_create() returns the error instead of setting errno
+			fprintf(stderr, "Could not start thread: %s\n", strerror(ret));
+			//the threads started so far process all the files
+			free(workers[i].active);
+			dom_writer_free(workers[i].writer);
+			if( !i){
+				free(workers);
+				pthread_mutex_destroy(&shared.lock);
+				query_free_path(&path);
+				return 2;
+			}
+			jobs=i;
+			break;
+		}
+	}
+	for(i=0; i<jobs; i++){
+		pthread_join(workers[i].thread, NULL);
+		bytes+=workers[i].bytes;
+		matches+=workers[i].matches;
+		errors+=workers[i].errors;
+		dom_writer_free(workers[i].writer);
+		free(workers[i].active);
+		free(workers[i].text);
+		free(workers[i].out);
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	free(workers);
+	pthread_mutex_destroy(&shared.lock);
+	query_free_path(&path);
+
+	if(stats){
+		seconds=(end.tv_sec-start.tv_sec)+(end.tv_nsec-start.tv_nsec)/1e9;
+		fprintf(stderr, "%d files, %.2f MB, %ld matches, %d errors, %d threads, %.3f s, %.2f MB/s\n",
+				shared.count, bytes/(1024.0*1024.0), matches, errors, jobs, seconds,
+				bytes/(1024.0*1024.0)/seconds);
+	}
+	return errors? 2 : matches? 0 : 1;
+}
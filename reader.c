@@ -0,0 +1,501 @@
+/*
+ * Copyright (c) 2011 Sergey Kolotsey.
+ * This file if part of expat-dom library.
+ * See the file COPYING for copying permission.
+ *
+ * This file defines the pull reader. Expat is suspended by XML_StopParser()
+ * after every element it reports and resumed when the reader is asked for
+ * the next event, so no tree is built. Names, attributes and text are copied
+ * into buffers of the reader that are reused for all events.
+ */
+
+#include "expat-config.h"
+
+#ifdef STDC_HEADERS
+# include <stdlib.h>
+# include <stddef.h>
+#else
+# ifdef HAVE_STDLIB_H
+#  include <stdlib.h>
+# endif
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_STRING_H
+# if !defined STDC_HEADERS && defined HAVE_MEMORY_H
+#  include <memory.h>
+# endif
+# include <string.h>
+#endif
+#ifdef HAVE_STRINGS_H
+# include <strings.h>
+#endif
+#include <limits.h>
+#include <errno.h>
+#include <expat.h>
+#include "expat-dom-private.h"
+
+
+
+//bytes of input passed to expat at a time
+#define DOM_READER_CHUNK 65536
+
+/*
+ * Number of events expat may report before it is suspended. A suspended
+ * parser still reports the end of an empty element after its start, and
+ * the text before the next element comes with the element, so expat is
+ * suspended while there is room for three events.
+ */
+#define DOM_READER_QUEUE 64
+
+/*
+ * Queued event. Names, attributes and text are offsets into the strings of
+ * the reader, attrs indexes the offsets of attribute names and values.
+ */
+typedef struct{
+	int type;
+	int depth;
+	size_t str;
+	size_t len;
+	int attrs;
+}dom_reader_queued_t;
+
+struct dom_reader_s{
+	XML_Parser parser;
+	dom_parse_options_t options;
+
+	//input not passed to expat yet, a file, or pushed chunks
+	const char *buffer;
+	size_t buffer_len;
+	int fd;
+	//no input follows the buffer
+	int end;
+	//the last input passed to expat was final
+	int last;
+	int suspended;
+	int done;
+	//error code the parser was stopped with
+	int status;
+
+	int64_t input_bytes;
+	int depth;
+	int nodes;
+
+	dom_reader_queued_t queue[DOM_READER_QUEUE];
+	int head;
+	int count;
+
+	//names, attribute values and text of the queued events, followed by the
+	//current run of text that starts at text
+	char *strings;
+	size_t strings_len;
+	size_t strings_size;
+	size_t text;
+	//offsets of attribute names and values, -1 terminates an element
+	size_t *offsets;
+	int offsets_len;
+	size_t offsets_size;
+	//pointers of the attributes of the returned event
+	const char **attrs;
+	size_t attrs_size;
+};
+
+
+
+static void dom_reader_stop(dom_reader_t *r, int status){
+	if( !r->status){
+		r->status=status;
+		XML_StopParser(r->parser, XML_FALSE);
+	}
+}
+
+/*
+ * Makes the buffer at least size bytes long, buffer_size is its current
+ * size in bytes. Returns 0 or stops the parser and returns ENOMEM.
+ */
+static int dom_reader_grow(dom_reader_t *r, void **buffer, size_t *buffer_size, size_t size){
+	void *temp;
+
+	if(size<=*buffer_size){
+		return 0;
+	}
+	if(size<2*(*buffer_size)){
+		size=2*(*buffer_size);
+	}
+	if(NULL==(temp=realloc(*buffer, size))){
+		dom_reader_stop(r, ENOMEM);
+		return ENOMEM;
+	}
+	*buffer=temp;
+	*buffer_size=size;
+	return 0;
+}
+
+static dom_reader_queued_t *dom_reader_queue(dom_reader_t *r, int type, int depth){
+	dom_reader_queued_t *e=&r->queue[r->head+r->count++];
+
+	e->type=type;
+	e->depth=depth;
+	return e;
+}
+
+/*
+ * Suspends expat when the queue is about to become full.
+ */
+static void dom_reader_suspend(dom_reader_t *r){
+	XML_ParsingStatus status;
+
+	if(r->head+r->count+3>DOM_READER_QUEUE){
+		XML_GetParsingStatus(r->parser, &status);
+		if(status.parsing !=XML_SUSPENDED){
+			XML_StopParser(r->parser, XML_TRUE);
+		}
+	}
+}
+
+/*
+ * Queues the run of text before an element. With DOM_PARSE_SKIP_BLANK white
+ * space only runs are dropped.
+ */
+static void dom_reader_end_text(dom_reader_t *r){
+	dom_reader_queued_t *e;
+	size_t i;
+
+	if(r->text==r->strings_len){
+		return;
+	}
+	if(r->options.flags & DOM_PARSE_SKIP_BLANK){
+		for(i=r->text; i<r->strings_len && DOM_SPACE(r->strings[i]); i++);
+		if(i==r->strings_len){
+			r->strings_len=r->text;
+			return;
+		}
+	}
+	e=dom_reader_queue(r, DOM_READER_TEXT, r->depth);
+	e->str=r->text;
+	e->len=r->strings_len-r->text;
+	r->text=r->strings_len;
+}
+
+/*
+ * Copies len bytes into the strings. Returns the offset or stops the parser
+ * and returns -1.
+ */
+static long dom_reader_string(dom_reader_t *r, const char *str, size_t len){
+	size_t offset=r->strings_len;
+
+	if(dom_reader_grow(r, (void **)&r->strings, &r->strings_size, offset+len)){
+		return -1;
+	}
+	memcpy(r->strings+offset, str, len);
+	r->strings_len+=len;
+	return offset;
+}
+
+static int dom_reader_offset(dom_reader_t *r, size_t offset){
+	if(dom_reader_grow(r, (void **)&r->offsets, &r->offsets_size, (r->offsets_len+1)*sizeof(size_t))){
+		return ENOMEM;
+	}
+	r->offsets[r->offsets_len++]=offset;
+	return 0;
+}
+
+static void XMLCALL dom_reader_start(void *user_data, const char *name, const char **atts){
+	dom_reader_t *r=(dom_reader_t *)user_data;
+	dom_reader_queued_t *e;
+	long offset;
+	long value;
+	int attrs;
+	int i;
+
+	if(r->status){
+		return;
+	}
+	for(i=0; atts[i]; i+=2);
+	if((r->options.max_depth && r->depth>=r->options.max_depth)
+			|| (r->options.max_nodes && r->nodes>=r->options.max_nodes)
+			|| (r->options.max_attrs && i/2>r->options.max_attrs)){
+		dom_reader_stop(r, E2BIG);
+		return;
+	}
+	dom_reader_end_text(r);
+	attrs=r->offsets_len;
+	if(-1==(offset=dom_reader_string(r, name, strlen(name)+1))){
+		return;
+	}
+	for(i=0; atts[i]; i++){
+		if(-1==(value=dom_reader_string(r, atts[i], strlen(atts[i])+1)) || dom_reader_offset(r, value)){
+			return;
+		}
+	}
+	if(dom_reader_offset(r, (size_t)-1)){
+		return;
+	}
+	r->text=r->strings_len;
+	e=dom_reader_queue(r, DOM_READER_START, r->depth);
+	e->str=offset;
+	e->attrs=attrs;
+	r->depth++;
+	r->nodes++;
+	dom_reader_suspend(r);
+}
+
+static void XMLCALL dom_reader_end(void *user_data, const char *name){
+	dom_reader_t *r=(dom_reader_t *)user_data;
+	dom_reader_queued_t *e;
+	long offset;
+
+	if(r->status){
+		return;
+	}
+	dom_reader_end_text(r);
+	if(-1==(offset=dom_reader_string(r, name, strlen(name)+1))){
+		return;
+	}
+	r->text=r->strings_len;
+	r->depth--;
+	e=dom_reader_queue(r, DOM_READER_END, r->depth);
+	e->str=offset;
+	dom_reader_suspend(r);
+}
+
+static void XMLCALL dom_reader_data(void *user_data, const char *s, int len){
+	dom_reader_t *r=(dom_reader_t *)user_data;
+
+	if( !r->status){
+		dom_reader_string(r, s, len);
+	}
+}
+
+static void XMLCALL dom_reader_doctype(void *user_data, const char *name, const char *sysid, const char *pubid,
+		int has_internal_subset){
+	dom_reader_stop((dom_reader_t *)user_data, EPERM);
+}
+
+static void XMLCALL dom_reader_entity(void *user_data, const char *name, int is_parameter_entity,
+		const char *value, int value_length, const char *base, const char *sysid, const char *pubid,
+		const char *notation){
+	if(sysid){
+		dom_reader_stop((dom_reader_t *)user_data, EPERM);
+	}
+}
+
+static int XMLCALL dom_reader_external_entity(XML_Parser parser, const char *context, const char *base,
+		const char *sysid, const char *pubid){
+	dom_reader_stop((dom_reader_t *)XML_GetUserData(parser), EPERM);
+	return XML_STATUS_ERROR;
+}
+
+dom_reader_t *dom_reader_new(const dom_parse_options_t *options){
+	dom_reader_t *r;
+
+	if(NULL==(r=calloc(1, sizeof(dom_reader_t)))){
+		return NULL;
+	}
+	if(options){
+		r->options=*options;
+	}
+	r->fd=-1;
+	if(NULL==(r->parser=XML_ParserCreate(NULL))){
+		free(r);
+		errno=ENOMEM;
+		return NULL;
+	}
+	XML_SetUserData(r->parser, r);
+	XML_SetElementHandler(r->parser, dom_reader_start, dom_reader_end);
+	XML_SetCharacterDataHandler(r->parser, dom_reader_data);
+	if(r->options.flags & DOM_PARSE_NO_DTD){
+		XML_SetStartDoctypeDeclHandler(r->parser, dom_reader_doctype);
+	}
+	if(r->options.flags & DOM_PARSE_NO_EXTERNAL_ENTITIES){
+		XML_SetEntityDeclHandler(r->parser, dom_reader_entity);
+		XML_SetExternalEntityRefHandler(r->parser, dom_reader_external_entity);
+	}
+	return r;
+}
+
+dom_reader_t *dom_reader_new_fd(int fd, const dom_parse_options_t *options){
+	dom_reader_t *r;
+
+	if(fd<0){
+		errno=EINVAL;
+		return NULL;
+	}
+	if((r=dom_reader_new(options))){
+		r->fd=fd;
+	}
+	return r;
+}
+
+dom_reader_t *dom_reader_new_buffer(const char *buffer, size_t buffer_len, const dom_parse_options_t *options){
+	dom_reader_t *r;
+
+	if( !buffer && buffer_len){
+		errno=EINVAL;
+		return NULL;
+	}
+	if((r=dom_reader_new(options))){
+		r->buffer=buffer;
+		r->buffer_len=buffer_len;
+		r->end=1;
+	}
+	return r;
+}
+
+dom_reader_t *dom_reader_free(dom_reader_t *r){
+	if(r){
+		XML_ParserFree(r->parser);
+		free(r->strings);
+		free(r->offsets);
+		free(r->attrs);
+		free(r);
+	}
+	return NULL;
+}
+
+int dom_reader_push(dom_reader_t *r, const char *buffer, size_t buffer_len, int is_final){
+	if( !r || r->fd>=0 || r->end || ( !buffer && buffer_len)){
+		return EINVAL;
+	}
+	if(r->buffer_len || r->suspended || r->count){
+		return EBUSY;
+	}
+	r->buffer=buffer;
+	r->buffer_len=buffer_len;
+	r->end=is_final;
+	return 0;
+}
+
+/*
+ * Passes the next piece of input to expat or resumes it. Returns 0, or
+ * EAGAIN if a push reader has no input.
+ */
+static int dom_reader_parse(dom_reader_t *r){
+	enum XML_Status ret;
+	ssize_t size_read;
+	size_t len;
+	void *buffer;
+
+	if(r->suspended){
+		ret=XML_ResumeParser(r->parser);
+	}else if(r->buffer_len || r->end){
+		len=r->buffer_len>DOM_READER_CHUNK? DOM_READER_CHUNK : r->buffer_len;
+		r->last=r->end && len==r->buffer_len;
+		r->input_bytes+=len;
+		if(r->options.max_input_bytes && r->input_bytes>r->options.max_input_bytes){
+			r->status=E2BIG;
+			return 0;
+		}
+		ret=XML_Parse(r->parser, r->buffer, (int)len, r->last);
+		r->buffer+=len;
+		r->buffer_len-=len;
+	}else if(r->fd>=0){
+		if(NULL==(buffer=XML_GetBuffer(r->parser, DOM_READER_CHUNK))){
+			r->status=ENOMEM;
+			return 0;
+		}
+		while(-1==(size_read=read(r->fd, buffer, DOM_READER_CHUNK))){
+			if(errno !=EINTR){
+				r->status=errno;
+				return 0;
+			}
+		}
+		r->last= !size_read;
+		r->input_bytes+=size_read;
+		if(r->options.max_input_bytes && r->input_bytes>r->options.max_input_bytes){
+			r->status=E2BIG;
+			return 0;
+		}
+		ret=XML_ParseBuffer(r->parser, (int)size_read, r->last);
+	}else{
+		return EAGAIN;
+	}
+
+	r->suspended=(ret==XML_STATUS_SUSPENDED);
+	if(ret==XML_STATUS_ERROR){
+		if( !r->status){
+			r->status=EINVAL;
+		}
+	}else if(ret==XML_STATUS_OK && r->last){
+		r->done=1;
+	}
+	return 0;
+}
+
+/*
+ * Fills the event with the first queued event.
+ */
+static int dom_reader_pop(dom_reader_t *r, dom_reader_event_t *event){
+	dom_reader_queued_t *e=&r->queue[r->head++];
+	int count;
+	int i;
+
+	r->count--;
+	memset(event, 0, sizeof(dom_reader_event_t));
+	event->type=e->type;
+	event->depth=e->depth;
+	if(e->type==DOM_READER_TEXT){
+		event->text=r->strings+e->str;
+		event->text_len=e->len;
+		return e->type;
+	}
+	event->name=r->strings+e->str;
+	if(e->type==DOM_READER_START){
+		for(count=0; r->offsets[e->attrs+count] !=(size_t)-1; count++);
+		if(dom_reader_grow(r, (void **)&r->attrs, &r->attrs_size, (count+1)*sizeof(char *))){
+			errno=ENOMEM;
+			return -1;
+		}
+		for(i=0; i<count; i++){
+			r->attrs[i]=r->strings+r->offsets[e->attrs+i];
+		}
+		r->attrs[count]=NULL;
+		event->attrs=r->attrs;
+	}
+	return e->type;
+}
+
+int dom_reader_next(dom_reader_t *r, dom_reader_event_t *event){
+	if( !r || !event){
+		errno=EINVAL;
+		return -1;
+	}
+	for(;;){
+		if(r->count){
+			return dom_reader_pop(r, event);
+		}
+		if(r->status){
+			errno=r->status;
+			return -1;
+		}
+		if(r->done){
+			memset(event, 0, sizeof(dom_reader_event_t));
+			return DOM_READER_EOF;
+		}
+		//the events returned before are not used any more, the current run
+		//of text is kept
+		if(r->text){
+			memmove(r->strings, r->strings+r->text, r->strings_len-r->text);
+			r->strings_len-=r->text;
+		}
+		r->text=0;
+		r->offsets_len=0;
+		r->head=0;
+		if(dom_reader_parse(r)){
+			errno=EAGAIN;
+			return -1;
+		}
+	}
+}
+
+const char *dom_reader_attr(const dom_reader_event_t *event, const char *var){
+	const char **attr;
+
+	for(attr=event->attrs; attr && attr[0]; attr+=2){
+		if(0==strcasecmp(attr[0], var)){
+			return attr[1];
+		}
+	}
+	return NULL;
+}
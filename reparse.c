@@ -0,0 +1,347 @@
+/*
+ * Copyright (c) 2011 Sergey Kolotsey.
+ * This file if part of expat-dom library.
+ * See the file COPYING for copying permission.
+ *
+ * This file defines dom_reparse() that parses a new version of a document and
+ * moves subtrees that did not change from the old tree into the new one.
+ */
+
+#include "expat-config.h"
+
+#ifdef STDC_HEADERS
+# include <stdlib.h>
+# include <stddef.h>
+#else
+# ifdef HAVE_STDLIB_H
+#  include <stdlib.h>
+# endif
+#endif
+#ifdef HAVE_STRING_H
+# if !defined STDC_HEADERS && defined HAVE_MEMORY_H
+#  include <memory.h>
+# endif
+# include <string.h>
+#endif
+#include <errno.h>
+#include "expat-dom-private.h"
+
+
+
+//old child of a node being compared
+typedef struct{
+	uint64_t hash;
+	dom_t *node;
+	//position among the children
+	int index;
+	//in the first entry of a run of equal hashes: number of entries at the
+	//start of the run that have been reused
+	int taken;
+}dom_reparse_child_t;
+
+
+
+static void dom_change_add(dom_changes_t *changes, int type, dom_t *node, dom_t *old){
+	dom_change_t *temp;
+	int size;
+
+	if(changes->count==changes->size){
+		size=changes->size? changes->size*2 : 16;
+		if(NULL==(temp=realloc(changes->list, size*sizeof(dom_change_t)))){
+			changes->incomplete=1;
+			return;
+		}
+		changes->list=temp;
+		changes->size=size;
+	}
+	changes->list[changes->count].type=type;
+	changes->list[changes->count].node=node;
+	changes->list[changes->count].old=old;
+	changes->count++;
+}
+
+/*
+ * Returns 1 if the texts are equal after leading and trailing white space is
+ * removed.
+ */
+static int dom_reparse_text(const char *a, size_t len_a, const char *b, size_t len_b){
+	while(len_a && DOM_SPACE(*a)){
+		a++;
+		len_a--;
+	}
+	while(len_a && DOM_SPACE(a[len_a-1])){
+		len_a--;
+	}
+	while(len_b && DOM_SPACE(*b)){
+		b++;
+		len_b--;
+	}
+	while(len_b && DOM_SPACE(b[len_b-1])){
+		len_b--;
+	}
+	return len_a==len_b && ( !len_a || 0==memcmp(a, b, len_a));
+}
+
+/*
+ * Returns 1 if attributes and text of the nodes are equal in the sense of
+ * dom_hash(), children are not compared.
+ */
+static int dom_reparse_same(const dom_t *a, const dom_t *b){
+	const dom_attr_t *attr;
+	const dom_attr_t *temp;
+	int count;
+
+	if( !dom_reparse_text(a->data, a->data_len, b->data, b->data_len)
+			|| !dom_reparse_text(a->user_data, a->user_data_len, b->user_data, b->user_data_len)){
+		return 0;
+	}
+	for(count=0, attr=a->attr; attr; attr=attr->next){
+		count++;
+	}
+	for(attr=b->attr; attr; attr=attr->next, count--){
+		for(temp=a->attr; temp && strcmp(temp->var, attr->var); temp=temp->next);
+		if( !temp || strcmp(temp->val, attr->val)){
+			return 0;
+		}
+	}
+	return count==0;
+}
+
+/*
+ * Returns 1 if the subtrees are equal in the sense of dom_hash(). Equal
+ * hashes are checked with this function before a subtree is reused, since
+ * different subtrees may have the same hash.
+ */
+static int dom_reparse_equal(const dom_t *a, const dom_t *b){
+	if(strcmp(a->name, b->name) || !dom_reparse_same(a, b)){
+		return 0;
+	}
+	for(a=a->child, b=b->child; a && b; a=a->next, b=b->next){
+		if( !dom_reparse_equal(a, b)){
+			return 0;
+		}
+	}
+	return !a && !b;
+}
+
+static int dom_reparse_cmp(const void *a, const void *b){
+	const dom_reparse_child_t *x=a;
+	const dom_reparse_child_t *y=b;
+
+	if(x->hash !=y->hash){
+		return x->hash<y->hash? -1 : 1;
+	}
+	return x->index-y->index;
+}
+
+/*
+ * Finds the first old child equal to node that has not been reused yet and
+ * takes it out of the array. Entries reused from the start of a run are
+ * skipped at once, so a run of equal siblings is matched in linear time.
+ */
+static dom_t *dom_reparse_find(dom_reparse_child_t *sorted, int count, const dom_t *node){
+	uint64_t hash=dom_hash((dom_t *)node, 0);
+	dom_t *ret;
+	int lo=0;
+	int hi=count;
+	int mid;
+	int i;
+
+	while(lo<hi){
+		mid=lo+(hi-lo)/2;
+		if(sorted[mid].hash<hash){
+			lo=mid+1;
+		}else{
+			hi=mid;
+		}
+	}
+	for(i=lo+(lo<count? sorted[lo].taken : 0); i<count && sorted[i].hash==hash; i++){
+		if(sorted[i].node && dom_reparse_equal(sorted[i].node, node)){
+			ret=sorted[i].node;
+			sorted[i].node=NULL;
+			while(lo+sorted[lo].taken<count && sorted[lo+sorted[lo].taken].hash==hash
+					&& !sorted[lo+sorted[lo].taken].node){
+				sorted[lo].taken++;
+			}
+			return ret;
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Compares node old of the old tree with node of the new tree, which are not
+ * equal. Children of node that are equal to a child of old are replaced by
+ * that child. Remaining children are paired by name in document order and
+ * compared recursively.
+ */
+static void dom_reparse_node(dom_changes_t *changes, dom_t *old, dom_t *node){
+	dom_reparse_child_t *sorted=NULL;
+	dom_t *found;
+	dom_t **old_children=NULL;
+	dom_t **fresh=NULL;
+	dom_t *child;
+	dom_t *prev;
+	dom_t *next;
+	int old_count;
+	int fresh_count;
+	int count;
+	int i;
+	int j;
+	int k;
+
+	if( !dom_reparse_same(old, node)){
+		dom_change_add(changes, DOM_CHANGE_MODIFIED, node, old);
+	}
+	for(old_count=0, child=old->child; child; child=child->next){
+		old_count++;
+	}
+	for(count=0, child=node->child; child; child=child->next){
+		count++;
+	}
+	if( !old_count || !count){
+		for(child=node->child; child; child=child->next){
+			dom_change_add(changes, DOM_CHANGE_ADDED, child, NULL);
+		}
+		for(child=old->child; child; child=child->next){
+			dom_change_add(changes, DOM_CHANGE_REMOVED, NULL, child);
+		}
+		return;
+	}
+	sorted=malloc(old_count*sizeof(dom_reparse_child_t));
+	old_children=malloc(old_count*sizeof(dom_t *));
+	fresh=malloc(count*sizeof(dom_t *));
+	if( !sorted || !old_children || !fresh){
+		//the children are left as they are and reported with the node
+		if(dom_reparse_same(old, node)){
+			dom_change_add(changes, DOM_CHANGE_MODIFIED, node, old);
+		}
+		free(sorted);
+		free(old_children);
+		free(fresh);
+		return;
+	}
+	for(i=0, child=old->child; child; child=child->next, i++){
+		sorted[i].hash=dom_hash(child, 0);
+		sorted[i].node=child;
+		sorted[i].index=i;
+		sorted[i].taken=0;
+	}
+	qsort(sorted, old_count, sizeof(dom_reparse_child_t), dom_reparse_cmp);
+
+	//unchanged children are taken from the old tree
+	fresh_count=0;
+	for(prev=NULL, child=node->child; child; prev=child, child=next){
+		next=child->next;
+		if(NULL==(found=dom_reparse_find(sorted, old_count, child))){
+			fresh[fresh_count++]=child;
+			continue;
+		}
+		//numbers of the moved subtrees do not fit either tree
+		dom_index_invalidate(node);
+		dom_index_invalidate(old);
+		if(prev){
+			prev->next=found;
+		}else{
+			node->child=found;
+		}
+		if(node->last==child){
+			node->last=found;
+		}
+		found->parent=node;
+		found->next=next;
+		child->parent=NULL;
+		child->next=NULL;
+		dom_free(child);
+		child=found;
+	}
+
+	//the old node keeps the children that were not taken
+	for(i=0; i<old_count; i++){
+		old_children[sorted[i].index]=sorted[i].node;
+	}
+	old->child=old->last=NULL;
+	old->child_count=0;
+	for(i=0, j=0; i<old_count; i++){
+		if(old_children[i]){
+			old_children[j++]=old_children[i];
+			if(old->last){
+				old->last->next=old_children[i];
+			}else{
+				old->child=old_children[i];
+			}
+			old->last=old_children[i];
+			old->last->next=NULL;
+			old->child_count++;
+		}
+	}
+	old_count=j;
+	dom_hash_invalidate(old);
+
+	//the rest is paired by name in document order
+	for(i=0, j=0; i<fresh_count; i++){
+		for(k=j; k<old_count && strcmp(old_children[k]->name, fresh[i]->name); k++);
+		if(k==old_count){
+			dom_change_add(changes, DOM_CHANGE_ADDED, fresh[i], NULL);
+			continue;
+		}
+		for(; j<k; j++){
+			dom_change_add(changes, DOM_CHANGE_REMOVED, NULL, old_children[j]);
+		}
+		dom_reparse_node(changes, old_children[k], fresh[i]);
+		j=k+1;
+	}
+	for(; j<old_count; j++){
+		dom_change_add(changes, DOM_CHANGE_REMOVED, NULL, old_children[j]);
+	}
+	free(sorted);
+	free(old_children);
+	free(fresh);
+}
+
+dom_t *dom_reparse(dom_t *old, const char *buffer, size_t buffer_len, const dom_parse_options_t *options,
+		dom_changes_t *changes){
+	dom_parse_options_t temp;
+	dom_t *dom;
+
+	if( !old || old->parent || !changes || (options && (options->flags & DOM_PARSE_DEDUP))){
+		errno=EINVAL;
+		return NULL;
+	}
+	memset(changes, 0, sizeof(dom_changes_t));
+	if(options){
+		temp=*options;
+	}else{
+		memset(&temp, 0, sizeof(temp));
+	}
+	temp.flags|=DOM_PARSE_HASH;
+	//nodes of the new tree may be freed, the index gets the final tree
+	temp.key_index=NULL;
+	if(NULL==(dom=dom_parse_buffer_ex(buffer, buffer_len, &temp))){
+		return NULL;
+	}
+	if(dom_hash(old, 0)==dom_hash(dom, 0) && dom_reparse_equal(old, dom)){
+		dom_free(dom);
+		dom=old;
+	}else{
+		changes->old=old;
+		if(strcmp(old->name, dom->name)){
+			dom_change_add(changes, DOM_CHANGE_REMOVED, NULL, old);
+			dom_change_add(changes, DOM_CHANGE_ADDED, dom, NULL);
+		}else{
+			dom_reparse_node(changes, old, dom);
+		}
+	}
+	if(options && options->key_index && dom_key_index_add(options->key_index, dom)){
+		changes->incomplete=1;
+	}
+	return dom;
+}
+
+void dom_changes_free(dom_changes_t *changes){
+	if(changes){
+		free(changes->list);
+		dom_free(changes->old);
+		memset(changes, 0, sizeof(dom_changes_t));
+	}
+}
@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2011 Sergey Kolotsey.
+ * This file if part of expat-dom library.
+ * See the file COPYING for copying permission.
+ *
+ * This file defines snapshots: read-only trees that are replaced while other
+ * threads read them. Trees are reclaimed with hazard pointers.
+ */
+
+#include "expat-config.h"
+
+#ifdef STDC_HEADERS
+# include <stdlib.h>
+# include <stddef.h>
+#else
+# ifdef HAVE_STDLIB_H
+#  include <stdlib.h>
+# endif
+#endif
+#ifdef HAVE_STRING_H
+# if !defined STDC_HEADERS && defined HAVE_MEMORY_H
+#  include <memory.h>
+# endif
+# include <string.h>
+#endif
+#include <errno.h>
+#include "expat-dom.h"
+
+
+
+//size of a cache line, readers do not share cache lines
+#define DOM_CACHE_LINE 64
+
+/*
+ * Hazard pointer of a reader. Slots are never freed while the snapshot
+ * exists, released slots are reused by new readers.
+ */
+struct dom_snapshot_reader_s{
+	dom_t *hazard;
+	int in_use;
+	dom_snapshot_t *snapshot;
+	dom_snapshot_reader_t *next;
+} __attribute__((aligned(DOM_CACHE_LINE)));
+
+struct dom_snapshot_s{
+	dom_t *current;
+	dom_snapshot_reader_t *readers;
+
+	//trees replaced by dom_snapshot_publish() that may still be read
+	dom_t **retired;
+	int retired_len;
+	int retired_size;
+	//serializes publishers
+	int lock;
+};
+
+
+
+dom_snapshot_t *dom_snapshot_new(dom_t *dom){
+	dom_snapshot_t *s;
+
+	if(NULL==(s=calloc(1, sizeof(dom_snapshot_t)))){
+		errno=ENOMEM;
+		return NULL;
+	}
+	s->current=dom;
+	return s;
+}
+
+dom_snapshot_t *dom_snapshot_free(dom_snapshot_t *s){
+	dom_snapshot_reader_t *r;
+	int i;
+
+	if(s){
+		while((r=s->readers)){
+			s->readers=r->next;
+			free(r);
+		}
+		for(i=0; i<s->retired_len; i++){
+			dom_free(s->retired[i]);
+		}
+		free(s->retired);
+		dom_free(s->current);
+		free(s);
+	}
+	return NULL;
+}
+
+dom_snapshot_reader_t *dom_snapshot_reader(dom_snapshot_t *s){
+	dom_snapshot_reader_t *r;
+	int in_use;
+
+	if( !s){
+		errno=EINVAL;
+		return NULL;
+	}
+	for(r=__atomic_load_n(&s->readers, __ATOMIC_ACQUIRE); r; r=r->next){
+		in_use=0;
+		if( !__atomic_load_n(&r->in_use, __ATOMIC_RELAXED)
+				&& __atomic_compare_exchange_n(&r->in_use, &in_use, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)){
+			return r;
+		}
+	}
+	if(0 !=posix_memalign((void **)&r, DOM_CACHE_LINE, sizeof(dom_snapshot_reader_t))){
+		errno=ENOMEM;
+		return NULL;
+	}
+	memset(r, 0, sizeof(dom_snapshot_reader_t));
+	r->in_use=1;
+	r->snapshot=s;
+	r->next=__atomic_load_n(&s->readers, __ATOMIC_RELAXED);
+	while( !__atomic_compare_exchange_n(&s->readers, &r->next, r, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+	return r;
+}
+
+void dom_snapshot_reader_free(dom_snapshot_reader_t *r){
+	if(r){
+		__atomic_store_n(&r->hazard, NULL, __ATOMIC_RELEASE);
+		__atomic_store_n(&r->in_use, 0, __ATOMIC_RELEASE);
+	}
+}
+
+dom_t *dom_snapshot_acquire(dom_snapshot_reader_t *r){
+	dom_t *dom;
+	dom_t *temp;
+
+	dom=__atomic_load_n(&r->snapshot->current, __ATOMIC_SEQ_CST);
+	while(1){
+		__atomic_store_n(&r->hazard, dom, __ATOMIC_SEQ_CST);
+		//the tree is protected only if it is still current after the hazard is visible
+		temp=__atomic_load_n(&r->snapshot->current, __ATOMIC_SEQ_CST);
+		if(temp==dom){
+			return dom;
+		}
+		dom=temp;
+	}
+}
+
+void dom_snapshot_release(dom_snapshot_reader_t *r){
+	__atomic_store_n(&r->hazard, NULL, __ATOMIC_RELEASE);
+}
+
+/*
+ * Frees retired trees that are not protected by any reader. Must be called
+ * with the lock taken. Returns the number of trees that are still retired.
+ */
+static int dom_snapshot_scan(dom_snapshot_t *s){
+	dom_snapshot_reader_t *r;
+	int i;
+	int j;
+
+	for(i=0, j=0; i<s->retired_len; i++){
+		for(r=__atomic_load_n(&s->readers, __ATOMIC_ACQUIRE); r; r=r->next){
+			if(__atomic_load_n(&r->hazard, __ATOMIC_SEQ_CST)==s->retired[i]){
+				break;
+			}
+		}
+		if(r){
+			s->retired[j++]=s->retired[i];
+		}else{
+			dom_free(s->retired[i]);
+		}
+	}
+	s->retired_len=j;
+	return j;
+}
+
+int dom_snapshot_publish(dom_snapshot_t *s, dom_t *dom){
+	dom_t **temp;
+	dom_t *old;
+	int size;
+
+	if( !s){
+		return EINVAL;
+	}
+	while(__atomic_exchange_n(&s->lock, 1, __ATOMIC_ACQUIRE));
+	if(s->retired_len==s->retired_size){
+		size=s->retired_size? s->retired_size*2 : 8;
+		if(NULL==(temp=realloc(s->retired, size*sizeof(dom_t *)))){
+			__atomic_store_n(&s->lock, 0, __ATOMIC_RELEASE);
+			return ENOMEM;
+		}
+		s->retired=temp;
+		s->retired_size=size;
+	}
+	old=__atomic_exchange_n(&s->current, dom, __ATOMIC_SEQ_CST);
+	if(old && old !=dom){
+		s->retired[s->retired_len++]=old;
+	}
+	dom_snapshot_scan(s);
+	__atomic_store_n(&s->lock, 0, __ATOMIC_RELEASE);
+	return 0;
+}
+
+int dom_snapshot_reclaim(dom_snapshot_t *s){
+	int ret;
+
+	if( !s){
+		return 0;
+	}
+	while(__atomic_exchange_n(&s->lock, 1, __ATOMIC_ACQUIRE));
+	ret=dom_snapshot_scan(s);
+	__atomic_store_n(&s->lock, 0, __ATOMIC_RELEASE);
+	return ret;
+}
@@ -0,0 +1,196 @@
+/*
+ * Copyright (c) 2011 Sergey Kolotsey.
+ * This file if part of expat-dom library.
+ * See the file COPYING for copying permission.
+ *
+ * This file defines the structural index: preorder and postorder numbers,
+ * depth, subtree size and skip pointer of every node, which answer questions
+ * about relative position of nodes in constant time.
+ */
+
+#include "expat-config.h"
+
+#ifdef STDC_HEADERS
+# include <stdlib.h>
+# include <stddef.h>
+#else
+# ifdef HAVE_STDLIB_H
+#  include <stdlib.h>
+# endif
+#endif
+#include <errno.h>
+#include "expat-dom-private.h"
+
+
+
+dom_index_t *dom_index_new(void){
+	dom_index_t *index;
+
+	if((index=malloc(sizeof(dom_index_t)))){
+		index->refs=1;
+		index->valid=1;
+	}
+	return index;
+}
+
+void dom_index_release(dom_index_t *index){
+	if(index && 0==__atomic_sub_fetch(&index->refs, 1, __ATOMIC_ACQ_REL)){
+		free(index);
+	}
+}
+
+void dom_index_set(dom_t *node, dom_index_t *index){
+	if(node->index !=index){
+		dom_index_release(node->index);
+		__atomic_add_fetch(&index->refs, 1, __ATOMIC_RELAXED);
+		node->index=index;
+	}
+}
+
+void dom_index_invalidate(dom_t *node){
+	if(node && node->index){
+		__atomic_store_n(&node->index->valid, 0, __ATOMIC_RELAXED);
+	}
+}
+
+void dom_index_resolve(dom_t *pending, dom_t *node){
+	dom_t *next;
+
+	for(; pending; pending=next){
+		next=pending->skip;
+		pending->skip=node;
+	}
+}
+
+/*
+ * Returns 1 if both nodes are numbered by the same index that is still valid.
+ */
+static int dom_indexed(const dom_t *a, const dom_t *b){
+	return a->index && a->index==b->index && __atomic_load_n(&a->index->valid, __ATOMIC_RELAXED);
+}
+
+int dom_build_structure_index(dom_t *root){
+	dom_index_t *index;
+	dom_t *pending=NULL;
+	dom_t *node;
+	int pre=0;
+	int post=0;
+	int depth=0;
+
+	if( !root || root->parent){
+		return EINVAL;
+	}
+	if(NULL==(index=dom_index_new())){
+		return ENOMEM;
+	}
+	node=root;
+	while(node){
+		dom_index_set(node, index);
+		node->pre=++pre;
+		node->depth=depth;
+		//the nodes whose subtrees ended right before this one skip to it
+		dom_index_resolve(pending, node);
+		pending=NULL;
+		if(node->alias){
+			//children of an alias are numbered under the node they belong to
+			index->valid=0;
+			dom_index_release(index);
+			return EINVAL;
+		}
+		if(node->child){
+			node=node->child;
+			depth++;
+			continue;
+		}
+		while(node){
+			node->post=++post;
+			node->size=pre-node->pre;
+			node->skip=pending;
+			pending=node;
+			if(node==root){
+				node=NULL;
+			}else if(node->next){
+				node=node->next;
+				break;
+			}else{
+				node=node->parent;
+				depth--;
+			}
+		}
+	}
+	dom_index_resolve(pending, NULL);
+	dom_index_release(index);
+	return 0;
+}
+
+int dom_is_ancestor(const dom_t *ancestor, const dom_t *node){
+	if( !ancestor || !node){
+		return 0;
+	}
+	if(dom_indexed(ancestor, node)){
+		return ancestor->pre<node->pre && node->pre<=ancestor->pre+ancestor->size;
+	}
+	for(node=node->parent; node; node=node->parent){
+		if(node==ancestor){
+			return 1;
+		}
+	}
+	return 0;
+}
+
+int dom_compare_order(const dom_t *a, const dom_t *b){
+	const dom_t *temp;
+	int depth_a;
+	int depth_b;
+
+	if( !a || !b || a==b){
+		return 0;
+	}
+	if(dom_indexed(a, b)){
+		return a->pre<b->pre? -1 : 1;
+	}
+	for(depth_a=0, temp=a; temp->parent; temp=temp->parent, depth_a++);
+	for(depth_b=0, temp=b; temp->parent; temp=temp->parent, depth_b++);
+
+	//an ancestor comes before its descendants
+	for(; depth_a>depth_b; depth_a--){
+		if((a=a->parent)==b){
+			return 1;
+		}
+	}
+	for(; depth_b>depth_a; depth_b--){
+		if((b=b->parent)==a){
+			return -1;
+		}
+	}
+	while(a->parent !=b->parent){
+		a=a->parent;
+		b=b->parent;
+	}
+	if( !a->parent){
+		//different trees
+		return 0;
+	}
+	for(temp=a->next; temp; temp=temp->next){
+		if(temp==b){
+			return -1;
+		}
+	}
+	return 1;
+}
+
+int dom_descendant_count(const dom_t *node){
+	const dom_t *child;
+	int count=0;
+
+	if( !node){
+		return 0;
+	}
+	if(dom_indexed(node, node)){
+		return node->size;
+	}
+	for(child=node->child; child; child=child->next){
+		count+=1+dom_descendant_count(child);
+	}
+	return count;
+}
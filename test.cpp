@@ -16,11 +16,20 @@
 #include <pthread.h>
 #include <stddef.h>
 #include <stdarg.h>
+#include <sys/wait.h>
+#include <locale.h>
 #include <errno.h>
+#include <string>
 #include <CppUTest/CommandLineTestRunner.h>
 extern "C" {
+#include "expat-config.h"
 #include "expat-dom.h"
 }
+#include "expat-dom.hpp"
+#include "expat-dom-bind.hpp"
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
 
 #ifndef MAX
 	#define MAX(a,b) ((a)>(b)? (a):(b))
@@ -266,6 +275,1773 @@ TEST( g_dom, t_dom){
 	dom=dom_free( dom);
 }
 
+TEST_GROUP(g_dom_clone)
+{
+};
+TEST( g_dom_clone, t_dom_clone){
+	dom_t *dom;
+	dom_t *clone;
+	dom_t *clone2;
+	dom_t *node;
+
+	dom=dom_parse_buffer( XML, strlen(XML));
+	CHECK_TRUE(dom);
+	clone=dom_clone( dom);
+	CHECK_TRUE(clone);
+	CHECK_TRUE(clone !=dom);
+	CHECK_FALSE(clone->parent);
+	POINTERS_EQUAL(dom->name, clone->name);
+
+	node=dom_find_node( clone, "movie");
+	CHECK_TRUE(node);
+	POINTERS_EQUAL(clone, node->parent);
+	STRCMP_EQUAL("1994", dom_find_attr( node->attr, "year"));
+
+	//the clone must survive the template
+	dom_free( dom);
+	clone2=dom_clone( clone);
+	CHECK_TRUE(clone2);
+	node=dom_find_node( clone, "actor");
+	CHECK_TRUE(node);
+	LONGS_EQUAL( strlen( "Tim Robbins"), node->user_data_len);
+	CHECK_TRUE(0==strncmp( "Tim Robbins", node->user_data, node->user_data_len));
+
+	//new value assigned to a clone does not affect other trees
+	node->name=strdup( "player");
+	dom_free( clone);
+	node=dom_find_node( clone2, "actor");
+	CHECK_TRUE(node);
+	STRCMP_EQUAL("actor", node->name);
+	dom_free( clone2);
+
+	CHECK_FALSE(dom_clone( NULL));
+	LONGS_EQUAL( EINVAL, errno);
+}
+
+TEST_GROUP(g_dom_edit)
+{
+};
+TEST( g_dom_edit, t_dom_edit){
+	dom_t *root;
+	dom_t *node;
+	dom_t *first;
+	dom_t *clone;
+	char name[16];
+	int i;
+
+	root=dom_new_element( "items");
+	CHECK_TRUE(root);
+	for( i=0; i<1000; i++){
+		snprintf( name, sizeof( name), "item%d", i);
+		node=dom_new_element( name);
+		CHECK_TRUE(node);
+		LONGS_EQUAL( 0, dom_append_child( root, node));
+	}
+	LONGS_EQUAL( 1000, root->child_count);
+	STRCMP_EQUAL( "item999", root->last->name);
+	POINTERS_EQUAL( root, root->last->parent);
+	LONGS_EQUAL( EINVAL, dom_append_child( root, root->child));
+	LONGS_EQUAL( EINVAL, dom_append_child( root->child, root));
+
+	first=dom_new_element( "first");
+	LONGS_EQUAL( 0, dom_insert_before( root, first, root->child));
+	POINTERS_EQUAL( first, root->child);
+	LONGS_EQUAL( 1001, root->child_count);
+	node=dom_remove( root->last);
+	STRCMP_EQUAL( "item999", node->name);
+	CHECK_FALSE(node->parent);
+	STRCMP_EQUAL( "item998", root->last->name);
+	LONGS_EQUAL( 1000, root->child_count);
+	LONGS_EQUAL( 0, dom_insert_before( root, node, root->last));
+	STRCMP_EQUAL( "item998", root->last->name);
+	LONGS_EQUAL( 1001, root->child_count);
+	node=dom_remove( root->last);
+	STRCMP_EQUAL( "item999", root->last->name);
+	LONGS_EQUAL( 1000, root->child_count);
+	dom_free( node);
+	//a node that claims a parent it is not a child of
+	node=dom_new_element( "stray");
+	node->parent=root;
+	POINTERS_EQUAL( NULL, dom_remove( node));
+	LONGS_EQUAL( EINVAL, errno);
+	LONGS_EQUAL( 1000, root->child_count);
+	node->parent=NULL;
+	dom_free( node);
+
+	LONGS_EQUAL( 0, dom_set_attr( first, "id", "1"));
+	LONGS_EQUAL( 0, dom_set_attr( first, "name", "one"));
+	LONGS_EQUAL( 0, dom_set_attr( first, "ID", "2"));
+	STRCMP_EQUAL( "2", dom_find_attr( first->attr, "id"));
+	LONGS_EQUAL( 0, dom_set_attr( first, "id", NULL));
+	CHECK_FALSE(dom_find_attr( first->attr, "id"));
+	STRCMP_EQUAL( "one", dom_find_attr( first->attr, "name"));
+	LONGS_EQUAL( 0, dom_set_text( first, "Hello", 5));
+	LONGS_EQUAL( 5, first->user_data_len);
+	CHECK_TRUE(0==memcmp( "Hello", first->user_data, 5));
+
+	//changes of a clone are not visible in the template
+	clone=dom_clone( root);
+	CHECK_TRUE(clone);
+	LONGS_EQUAL( 1000, clone->child_count);
+	STRCMP_EQUAL( "item999", clone->last->name);
+	POINTERS_EQUAL( clone, clone->last->parent);
+	LONGS_EQUAL( 0, dom_set_attr( clone->child, "name", "uno"));
+	LONGS_EQUAL( 0, dom_set_text( clone->child, "Hola", 4));
+	STRCMP_EQUAL( "one", dom_find_attr( first->attr, "name"));
+	CHECK_TRUE(0==memcmp( "Hello", first->user_data, 5));
+	dom_free( root);
+	STRCMP_EQUAL( "uno", dom_find_attr( clone->child->attr, "name"));
+	dom_free( clone);
+}
+
+TEST_GROUP(g_dom_writer)
+{
+	static int append( void *ctx, const char *buffer, size_t buffer_len){
+		((std::string *)ctx)->append( buffer, buffer_len);
+		return 0;
+	}
+	static int fail( void *ctx, const char *buffer, size_t buffer_len){
+		return EIO;
+	}
+};
+TEST( g_dom_writer, t_dom_writer){
+	std::string out;
+	dom_writer_t *w;
+	dom_t *dom;
+	dom_t *node;
+	int i;
+
+	w=dom_writer_new( append, &out, 64);
+	CHECK_TRUE(w);
+	LONGS_EQUAL( EINVAL, dom_writer_text( w, "a", 1));
+	LONGS_EQUAL( 0, dom_writer_start_element( w, "movies"));
+	LONGS_EQUAL( 0, dom_writer_start_element( w, "movie"));
+	LONGS_EQUAL( 0, dom_writer_attr( w, "title", "Tom & \"Jerry\""));
+	LONGS_EQUAL( 0, dom_writer_start_element( w, "plot"));
+	for( i=0; i<100; i++){
+		LONGS_EQUAL( 0, dom_writer_text( w, "<cat>&", 6));
+	}
+	LONGS_EQUAL( 0, dom_writer_end_element( w));
+	LONGS_EQUAL( 0, dom_writer_start_element( w, "quote"));
+	LONGS_EQUAL( 0, dom_writer_cdata( w, "a]]>b", 5));
+	LONGS_EQUAL( 0, dom_writer_end_element( w));
+	LONGS_EQUAL( 0, dom_writer_start_element( w, "empty"));
+	LONGS_EQUAL( EINVAL, dom_writer_attr( w, "x", NULL));
+	LONGS_EQUAL( 0, dom_writer_end_element( w));
+	LONGS_EQUAL( 0, dom_writer_end_element( w));
+	LONGS_EQUAL( 0, dom_writer_end_element( w));
+	LONGS_EQUAL( EINVAL, dom_writer_end_element( w));
+	LONGS_EQUAL( 0, dom_writer_flush( w));
+	dom_writer_free( w);
+
+	const char *head="<movies><movie title=\"Tom &amp; &quot;Jerry&quot;\"><plot>&lt;cat&gt;&amp;&lt;";
+	const char *tail="]]]]><![CDATA[>b]]></quote><empty/></movie></movies>";
+	CHECK_TRUE(0==out.compare( 0, strlen( head), head));
+	CHECK_TRUE(0==out.compare( out.size()-strlen( tail), strlen( tail), tail));
+	dom=dom_parse_buffer( out.data(), out.size());
+	CHECK_TRUE(dom);
+	STRCMP_EQUAL( "Tom & \"Jerry\"", dom_find_attr( dom_find_node( dom, "movie")->attr, "title"));
+	LONGS_EQUAL( 600, dom_find_node( dom, "plot")->user_data_len);
+	node=dom_find_node( dom, "quote");
+	LONGS_EQUAL( 5, node->user_data_len);
+	CHECK_TRUE(0==memcmp( "a]]>b", node->user_data, 5));
+	dom_free( dom);
+
+	w=dom_writer_new( fail, NULL, 0);
+	CHECK_TRUE(w);
+	LONGS_EQUAL( 0, dom_writer_start_element( w, "a"));
+	LONGS_EQUAL( EIO, dom_writer_flush( w));
+	LONGS_EQUAL( EIO, dom_writer_end_element( w));
+	dom_writer_free( w);
+}
+
+TEST_GROUP(g_dom_options)
+{
+};
+TEST( g_dom_options, t_dom_options){
+	const char *xml="<a>\n  <b> x </b>\n  <c>  </c>\n  <d><![CDATA[ y ]]>\n</d> tail \n</a>";
+	dom_parse_options_t options;
+	dom_t *dom;
+	dom_t *node;
+
+	//without options the data is kept as is, text after a child belongs to the parent
+	dom=dom_parse_buffer_ex( xml, strlen(xml), NULL);
+	CHECK_TRUE(dom);
+	LONGS_EQUAL( 16, dom->data_len);
+	LONGS_EQUAL( 4, dom->user_data_len);
+	CHECK_TRUE(0==memcmp( "tail", dom->user_data, 4));
+	node=dom_find_node( dom, "d");
+	LONGS_EQUAL( 4, node->data_len);
+	LONGS_EQUAL( 3, node->user_data_len);
+	dom_free( dom);
+
+	memset( &options, 0, sizeof( options));
+	options.flags=DOM_PARSE_SKIP_BLANK;
+	dom=dom_parse_buffer_ex( xml, strlen(xml), &options);
+	CHECK_TRUE(dom);
+	LONGS_EQUAL( 7, dom->data_len);
+	CHECK_TRUE(0==memcmp( " tail \n", dom->data, 7));
+	node=dom_find_node( dom, "c");
+	CHECK_FALSE(node->data);
+	CHECK_FALSE(node->user_data);
+	node=dom_find_node( dom, "d");
+	LONGS_EQUAL( 3, node->data_len);
+	CHECK_TRUE(0==memcmp( " y ", node->user_data, 3));
+	dom_free( dom);
+
+	options.flags=DOM_PARSE_SKIP_BLANK | DOM_PARSE_TRIM;
+	dom=dom_parse_buffer_ex( xml, strlen(xml), &options);
+	CHECK_TRUE(dom);
+	LONGS_EQUAL( 4, dom->data_len);
+	CHECK_TRUE(0==memcmp( "tail", dom->data, 4));
+	node=dom_find_node( dom, "b");
+	LONGS_EQUAL( 1, node->data_len);
+	POINTERS_EQUAL( node->data, node->user_data);
+	node=dom_find_node( dom, "d");
+	LONGS_EQUAL( 3, node->data_len);
+	dom_free( dom);
+
+	options.flags=DOM_PARSE_USER_DATA_ONLY;
+	dom=dom_parse_buffer_ex( "<a>\n<![CDATA[x]]><![CDATA[y]]>\n</a>", 35, &options);
+	CHECK_TRUE(dom);
+	LONGS_EQUAL( 2, dom->data_len);
+	LONGS_EQUAL( 2, dom->user_data_len);
+	POINTERS_EQUAL( dom->data, dom->user_data);
+	CHECK_TRUE(0==memcmp( "xy", dom->data, 2));
+	dom_free( dom);
+
+	void *parser=NULL;
+	dom=NULL;
+	options.flags=DOM_PARSE_SKIP_BLANK;
+	LONGS_EQUAL( 0, dom_parse_chunked_data_ex( &parser, &dom, xml, 10, 0, &options));
+	LONGS_EQUAL( 0, dom_parse_chunked_data_ex( &parser, &dom, xml+10, strlen(xml)-10, 1, NULL));
+	CHECK_FALSE(parser);
+	CHECK_TRUE(dom);
+	CHECK_FALSE(dom_find_node( dom, "c")->data);
+	dom_free( dom);
+}
+
+TEST_GROUP(g_dom_limits)
+{
+};
+TEST( g_dom_limits, t_dom_limits){
+	const char *xml="<a x=\"1\" y=\"2\"><b><c>text</c></b><b/><b/></a>";
+	const char *dtd="<!DOCTYPE a [<!ENTITY e \"lol\">]><a>&e;&e;</a>";
+	const char *ext="<!DOCTYPE a [<!ENTITY e SYSTEM \"file:///etc/passwd\">]><a>&e;</a>";
+	dom_parse_options_t options;
+	dom_t *dom;
+
+	memset( &options, 0, sizeof( options));
+	options.max_input_bytes=strlen(xml);
+	options.max_depth=3;
+	options.max_nodes=5;
+	options.max_attrs=2;
+	options.max_tree_bytes=4096;
+	dom=dom_parse_buffer_ex( xml, strlen(xml), &options);
+	CHECK_TRUE(dom);
+	dom_free( dom);
+
+#define CHECK_LIMIT(field, value) \
+	memset( &options, 0, sizeof( options));\
+	options.field=value;\
+	errno=0;\
+	CHECK_FALSE(dom_parse_buffer_ex( xml, strlen(xml), &options));\
+	LONGS_EQUAL( E2BIG, errno);
+
+	CHECK_LIMIT( max_input_bytes, 10);
+	CHECK_LIMIT( max_depth, 2);
+	CHECK_LIMIT( max_nodes, 4);
+	CHECK_LIMIT( max_attrs, 1);
+	CHECK_LIMIT( max_tree_bytes, 100);
+#undef CHECK_LIMIT
+
+	void *parser=NULL;
+	dom=NULL;
+	memset( &options, 0, sizeof( options));
+	options.max_input_bytes=20;
+	LONGS_EQUAL( 0, dom_parse_chunked_data_ex( &parser, &dom, xml, 10, 0, &options));
+	LONGS_EQUAL( E2BIG, dom_parse_chunked_data_ex( &parser, &dom, xml+10, 11, 0, NULL));
+	CHECK_FALSE(parser);
+	CHECK_FALSE(dom);
+
+	dom=dom_parse_buffer_ex( dtd, strlen(dtd), NULL);
+	CHECK_TRUE(dom);
+	LONGS_EQUAL( 6, dom->data_len);
+	dom_free( dom);
+	options.max_input_bytes=0;
+	options.flags=DOM_PARSE_NO_DTD;
+	errno=0;
+	CHECK_FALSE(dom_parse_buffer_ex( dtd, strlen(dtd), &options));
+	LONGS_EQUAL( EPERM, errno);
+
+	options.flags=DOM_PARSE_NO_EXTERNAL_ENTITIES;
+	dom=dom_parse_buffer_ex( dtd, strlen(dtd), &options);
+	CHECK_TRUE(dom);
+	dom_free( dom);
+	errno=0;
+	CHECK_FALSE(dom_parse_buffer_ex( ext, strlen(ext), &options));
+	LONGS_EQUAL( EPERM, errno);
+	dom=dom_parse_buffer_ex( ext, strlen(ext), NULL);
+	CHECK_TRUE(dom);
+	dom_free( dom);
+}
+
+TEST_GROUP(g_dom_ns)
+{
+};
+TEST( g_dom_ns, t_dom_ns){
+	const char *xml="<s:Envelope xmlns:s=\"urn:soap\" xmlns=\"urn:app\">"
+		"<s:Body><Item a:id=\"7\" id=\"8\" xmlns:a=\"urn:attr\"/></s:Body></s:Envelope>";
+	const char *other="<env:Envelope xmlns:env=\"urn:soap\"><env:Body/></env:Envelope>";
+	dom_parse_options_t options;
+	dom_t *dom;
+	dom_t *dom2;
+	dom_t *node;
+	const char *soap;
+
+	memset( &options, 0, sizeof( options));
+	options.flags=DOM_PARSE_NAMESPACES;
+	dom=dom_parse_buffer_ex( xml, strlen(xml), &options);
+	CHECK_TRUE(dom);
+	soap=dom_ns_intern( "urn:soap");
+	POINTERS_EQUAL( soap, dom->ns);
+	STRCMP_EQUAL( "s:Envelope", dom->name);
+	STRCMP_EQUAL( "Envelope", dom->local_name);
+	STRCMP_EQUAL( "s", dom->prefix);
+	STRCMP_EQUAL( "urn:soap", dom_find_attr( dom->attr, "xmlns:s"));
+	STRCMP_EQUAL( "urn:app", dom_find_attr( dom->attr, "xmlns"));
+
+	node=dom_find_node_ns( dom, "urn:app", "Item");
+	CHECK_TRUE(node);
+	STRCMP_EQUAL( "Item", node->name);
+	CHECK_FALSE(node->prefix);
+	STRCMP_EQUAL( "7", dom_find_attr_ns( node->attr, "urn:attr", "id"));
+	STRCMP_EQUAL( "8", dom_find_attr_ns( node->attr, NULL, "id"));
+	CHECK_FALSE(dom_find_attr_ns( node->attr, "urn:none", "id"));
+	CHECK_FALSE(dom_find_node_ns( dom, NULL, "Item"));
+	CHECK_FALSE(dom_find_node_ns( dom, "urn:unknown", "Item"));
+
+	//the same namespace with another prefix
+	dom2=dom_parse_buffer_ex( other, strlen(other), &options);
+	CHECK_TRUE(dom2);
+	node=dom_find_node_ns( dom2, "urn:soap", "Body");
+	CHECK_TRUE(node);
+	POINTERS_EQUAL( dom_find_node_ns( dom, "urn:soap", "Body")->ns, node->ns);
+	POINTERS_EQUAL( dom_find_node_ns( dom, "urn:soap", "Body")->local_name, node->local_name);
+	dom_free( dom2);
+
+	//interned strings move with the names into clones and compacted trees
+	dom2=dom_clone( dom);
+	CHECK_TRUE(dom2);
+	dom_free( dom);
+	dom=dom_compact( dom2, NULL, NULL);
+	CHECK_TRUE(dom);
+	node=dom_find_node_ns( dom, "urn:app", "Item");
+	CHECK_TRUE(node);
+	STRCMP_EQUAL( "7", dom_find_attr_ns( node->attr, "urn:attr", "id"));
+	LONGS_EQUAL( 0, dom_set_attr( node, "extra", "1"));
+	STRCMP_EQUAL( "8", dom_find_attr_ns( node->attr, NULL, "id"));
+	dom_free( dom);
+
+	//aliases made by DOM_PARSE_DEDUP release the strings of their names
+	options.flags=DOM_PARSE_NAMESPACES | DOM_PARSE_DEDUP;
+	std::string twice="<r xmlns:p=\"urn:p\"><p:i p:a=\"1\"/><p:i p:a=\"1\"/></r>";
+	dom=dom_parse_buffer_ex( twice.c_str(), twice.size(), &options);
+	CHECK_TRUE(dom);
+	CHECK_TRUE(dom->last->alias);
+	STRCMP_EQUAL( "1", dom_find_attr_ns( dom->last->attr, "urn:p", "a"));
+	dom_free( dom);
+	options.flags=DOM_PARSE_NAMESPACES;
+
+	//namespace declarations and interned strings count toward the limit
+	std::string uri( 1000, 'u');
+	std::string big="<r xmlns:a=\"urn:"+uri+"\"><a:x/></r>";
+	options.max_tree_bytes=512;
+	CHECK_FALSE(dom_parse_buffer_ex( big.c_str(), big.size(), &options));
+	LONGS_EQUAL( E2BIG, errno);
+	options.max_tree_bytes=0;
+
+	//without the flag names are kept as is
+	dom=dom_parse_buffer( xml, strlen(xml));
+	CHECK_TRUE(dom);
+	CHECK_FALSE(dom->ns);
+	CHECK_TRUE(dom_find_node( dom, "s:Body"));
+	dom_free( dom);
+}
+
+TEST_GROUP(g_dom_convert)
+{
+};
+TEST( g_dom_convert, t_dom_convert){
+	const char *xml="<a i=\" -42 \" big=\"9223372036854775808\" min=\"-9223372036854775808\" bad=\"4x\" d=\"1.5e3\">"
+		"<p> 19.99 </p><q>0.1</q><r>12345678901234567890123e-3</r><s>1e400</s><t>true</t><u>yes</u><v/></a>";
+	dom_t *dom;
+	int64_t i;
+	double d;
+	int b;
+
+	dom=dom_parse_buffer( xml, strlen(xml));
+	CHECK_TRUE(dom);
+	LONGS_EQUAL( 0, dom_attr_int64( dom->attr, "i", &i));
+	CHECK_TRUE(i==-42);
+	LONGS_EQUAL( ERANGE, dom_attr_int64( dom->attr, "big", &i));
+	LONGS_EQUAL( 0, dom_attr_int64( dom->attr, "min", &i));
+	CHECK_TRUE(i==INT64_MIN);
+	LONGS_EQUAL( EINVAL, dom_attr_int64( dom->attr, "bad", &i));
+	LONGS_EQUAL( ENOENT, dom_attr_int64( dom->attr, "none", &i));
+	LONGS_EQUAL( 0, dom_attr_double( dom->attr, "d", &d));
+	DOUBLES_EQUAL( 1500, d, 0);
+
+	LONGS_EQUAL( 0, dom_text_double( dom_find_node( dom, "p"), &d));
+	CHECK_TRUE(d==19.99);
+	LONGS_EQUAL( 0, dom_text_double( dom_find_node( dom, "q"), &d));
+	CHECK_TRUE(d==0.1);
+	LONGS_EQUAL( 0, dom_text_double( dom_find_node( dom, "r"), &d));
+	CHECK_TRUE(d==12345678901234567890123e-3);
+	LONGS_EQUAL( ERANGE, dom_text_double( dom_find_node( dom, "s"), &d));
+	LONGS_EQUAL( EINVAL, dom_text_int64( dom_find_node( dom, "p"), &i));
+	LONGS_EQUAL( 0, dom_text_bool( dom_find_node( dom, "t"), &b));
+	LONGS_EQUAL( 1, b);
+	LONGS_EQUAL( EINVAL, dom_text_bool( dom_find_node( dom, "u"), &b));
+	LONGS_EQUAL( ENOENT, dom_text_bool( dom_find_node( dom, "v"), &b));
+
+	//the decimal point of XML numbers does not depend on the locale
+	if( setlocale( LC_NUMERIC, "de_DE.UTF-8") || setlocale( LC_NUMERIC, "fr_FR.UTF-8")){
+		LONGS_EQUAL( 0, dom_text_double( dom_find_node( dom, "r"), &d));
+		CHECK_TRUE(d==12345678901234567890123e-3);
+		setlocale( LC_NUMERIC, "C");
+	}
+	dom_free( dom);
+}
+
+TEST_GROUP(g_dom_columns)
+{
+};
+TEST( g_dom_columns, t_dom_columns){
+	std::string xml="<t><rows>";
+	dom_column_spec_t specs[]={
+		{ "id", NULL, DOM_COLUMN_INT64},
+		{ NULL, "price", DOM_COLUMN_DOUBLE},
+		{ NULL, "name", DOM_COLUMN_STRING},
+	};
+	dom_column_t columns[3];
+	dom_t *dom;
+	char buffer[128];
+	int i;
+
+	for( i=0; i<100; i++){
+		if( i%10==3){
+			snprintf( buffer, sizeof( buffer), "<row><price>x</price></row><other/>");
+		}else{
+			snprintf( buffer, sizeof( buffer), "<row id=\"%d\"><price>%d.5</price><name>n%d</name></row>", i, i, i);
+		}
+		xml+=buffer;
+	}
+	xml+="</rows></t>";
+	dom=dom_parse_buffer( xml.data(), xml.size());
+	CHECK_TRUE(dom);
+
+	LONGS_EQUAL( EINVAL, dom_extract_columns( dom, "", specs, 3, columns));
+	LONGS_EQUAL( 0, dom_extract_columns( dom, "rows/row", specs, 3, columns));
+	for( i=0; i<3; i++){
+		LONGS_EQUAL( 100, columns[i].length);
+		LONGS_EQUAL( 10, columns[i].null_count);
+	}
+	CHECK_TRUE(((int64_t *)columns[0].values)[42]==42);
+	DOUBLES_EQUAL( 99.5, ((double *)columns[1].values)[99], 0);
+	CHECK_FALSE(columns[1].validity[3/8] & (1<<3));
+	CHECK_TRUE(columns[1].validity[4/8] & (1<<4));
+	LONGS_EQUAL( 0, columns[2].offsets[0]);
+	LONGS_EQUAL( 2, columns[2].offsets[1]);
+	LONGS_EQUAL( columns[2].offsets[3], columns[2].offsets[4]);
+	CHECK_TRUE(0==memcmp( "n99", columns[2].data+columns[2].offsets[99], 3));
+	dom_columns_free( columns, 3);
+
+	LONGS_EQUAL( 0, dom_extract_columns( dom, "rows/none", specs, 3, columns));
+	LONGS_EQUAL( 0, columns[0].length);
+	dom_columns_free( columns, 3);
+	dom_free( dom);
+}
+
+TEST_GROUP(g_dom_compact)
+{
+};
+TEST( g_dom_compact, t_dom_compact){
+	const char *xml="<a x=\"1\">\n  <b y=\"2\" z=\"3\">  text  </b>\n  <c><![CDATA[ keep ]]></c>\n</a>";
+	dom_t *dom;
+	dom_t *clone;
+	dom_t *node;
+	long before;
+	long after;
+
+	dom=dom_parse_buffer( xml, strlen(xml));
+	CHECK_TRUE(dom);
+	dom=dom_compact( dom, &before, &after);
+	CHECK_TRUE(dom);
+	CHECK_TRUE(after<before);
+	//the nodes are stored in preorder right after the root
+	node=dom_find_node( dom, "b");
+	POINTERS_EQUAL( dom+1, node);
+	POINTERS_EQUAL( dom, node->parent);
+	POINTERS_EQUAL( node->user_data, node->data);
+	LONGS_EQUAL( 4, node->data_len);
+	STRCMP_EQUAL( "3", dom_find_attr( node->attr, "z"));
+	node=dom_find_node( dom, "c");
+	LONGS_EQUAL( 6, node->data_len);
+	POINTERS_EQUAL( node, dom->last);
+	LONGS_EQUAL( 2, dom->child_count);
+
+	//the tree can be cloned and changed, nodes are freed in any order
+	clone=dom_clone( dom);
+	CHECK_TRUE(clone);
+	LONGS_EQUAL( 0, dom_set_attr( node, "new", "value"));
+	LONGS_EQUAL( 0, dom_set_text( node, "x", 1));
+	LONGS_EQUAL( 0, dom_append_child( node, dom_new_element( "d")));
+	node=dom_remove( node);
+	dom_free( dom);
+	STRCMP_EQUAL( "value", dom_find_attr( node->attr, "new"));
+	dom_free( node);
+	STRCMP_EQUAL( "2", dom_find_attr( dom_find_node( clone, "b")->attr, "y"));
+	dom_free( clone);
+
+	CHECK_FALSE(dom_compact( NULL, NULL, NULL));
+	LONGS_EQUAL( EINVAL, errno);
+}
+
+TEST_GROUP(g_dom_snapshot)
+{
+	typedef struct{
+		dom_snapshot_t *snapshot;
+		int stop;
+		long reads;
+		int errors;
+	}reader_s;
+
+	static void *reader_thread( void *arg){
+		reader_s *shared=(reader_s *)arg;
+		dom_snapshot_reader_t *reader;
+		dom_t *dom;
+		dom_t *node;
+
+		reader=dom_snapshot_reader( shared->snapshot);
+		while( !__atomic_load_n( &shared->stop, __ATOMIC_RELAXED)){
+			dom=dom_snapshot_acquire( reader);
+			node=dom_find_node( dom, "route");
+			if( !node || !dom_find_attr( node->attr, "to")){
+				__atomic_add_fetch( &shared->errors, 1, __ATOMIC_RELAXED);
+			}
+			dom_snapshot_release( reader);
+			__atomic_add_fetch( &shared->reads, 1, __ATOMIC_RELAXED);
+		}
+		dom_snapshot_reader_free( reader);
+		return NULL;
+	}
+};
+TEST( g_dom_snapshot, t_dom_snapshot){
+	const char *xml="<rules><route to=\"a\"/><route to=\"b\"/></rules>";
+	pthread_t tid[4];
+	reader_s shared;
+	dom_snapshot_reader_t *reader;
+	dom_t *dom;
+	int i;
+
+	memset( &shared, 0, sizeof( shared));
+	shared.snapshot=dom_snapshot_new( dom_parse_buffer( xml, strlen(xml)));
+	CHECK_TRUE(shared.snapshot);
+
+	//a held tree survives publishing until it is released
+	reader=dom_snapshot_reader( shared.snapshot);
+	dom=dom_snapshot_acquire( reader);
+	LONGS_EQUAL( 0, dom_snapshot_publish( shared.snapshot, dom_parse_buffer( xml, strlen(xml))));
+	LONGS_EQUAL( 1, dom_snapshot_reclaim( shared.snapshot));
+	STRCMP_EQUAL( "rules", dom->name);
+	CHECK_TRUE(dom !=dom_snapshot_acquire( reader));
+	LONGS_EQUAL( 0, dom_snapshot_reclaim( shared.snapshot));
+	dom_snapshot_reader_free( reader);
+
+	for( i=0; i<4; i++){
+		pthread_create( &tid[i], NULL, reader_thread, &shared);
+	}
+	for( i=0; i<200; i++){
+		LONGS_EQUAL( 0, dom_snapshot_publish( shared.snapshot, dom_parse_buffer( xml, strlen(xml))));
+		usleep( 100);
+	}
+	__atomic_store_n( &shared.stop, 1, __ATOMIC_RELAXED);
+	for( i=0; i<4; i++){
+		pthread_join( tid[i], NULL);
+	}
+	LONGS_EQUAL( 0, shared.errors);
+	CHECK_TRUE(shared.reads>0);
+	LONGS_EQUAL( 0, dom_snapshot_reclaim( shared.snapshot));
+	dom_snapshot_free( shared.snapshot);
+}
+
+TEST_GROUP(g_dom_hpp)
+{
+};
+TEST( g_dom_hpp, t_dom_hpp){
+	const char *xml="<feed><item id=\"1\" n=\"x\"><price>2.5</price></item><item id=\"2\"><count>7</count></item></feed>";
+	std::string names;
+	int count=0;
+
+	expat_dom::document doc=expat_dom::document::parse( xml);
+	expat_dom::node root=doc.root();
+	CHECK_TRUE(root.name()=="feed");
+	for( expat_dom::node item : root.children()){
+		for( expat_dom::attr a : item.attrs()){
+			names+=std::string( a.name())+"="+std::string( a.value())+";";
+		}
+		count++;
+	}
+	LONGS_EQUAL( 2, count);
+	STRCMP_EQUAL( "id=1;n=x;id=2;", names.c_str());
+
+	names.clear();
+	for( expat_dom::node n : root.descendants()){
+		names+=std::string( n.name())+";";
+	}
+	STRCMP_EQUAL( "item;price;item;count;", names.c_str());
+	CHECK_TRUE(root.find( "price").as_double()==2.5);
+	CHECK_TRUE(root.find( "count").as_int64()==7);
+	CHECK_TRUE(root.first_child().attr( "N")==std::string_view( "x"));
+	CHECK_FALSE(root.first_child().attr( "missing"));
+
+	char buffer[256];
+	std::pmr::monotonic_buffer_resource mr( buffer, sizeof( buffer));
+	LONGS_EQUAL( 2, root.children_named( "item", &mr).size());
+
+	//the tree is freed once, by the document it was moved to
+	expat_dom::document moved=std::move( doc);
+	CHECK_FALSE(doc);
+	CHECK_TRUE(moved.root()==root);
+	expat_dom::document copy=moved.clone();
+	CHECK_TRUE(copy.root().find( "count").text()=="7");
+
+	try{
+		expat_dom::document::parse( "<a><b></a>");
+		FAIL("parse() must throw");
+	}catch( const expat_dom::error &e){
+		CHECK_TRUE(e.code().value() !=0);
+	}
+}
+
+TEST_GROUP(g_dom_bind)
+{
+	struct order_s{
+		int64_t id;
+		std::string customer;
+		double total;
+		bool paid;
+		std::optional<int> priority;
+	};
+};
+TEST( g_dom_bind, t_dom_bind){
+	const char *xml="<orders><order ID=\"7\" skip=\"x\"><customer> Anna &amp; Co </customer>"
+		"<total>12.5</total><paid>true</paid><note><total>99</total></note></order>"
+		"<batch><order id=\"8\"><total>bad</total><priority>2</priority></order></batch></orders>";
+	namespace bind=expat_dom::bind;
+	static constexpr auto schema=bind::record<order_s>( "order",
+		bind::attr( "id", &order_s::id),
+		bind::child( "customer", &order_s::customer),
+		bind::child( "total", &order_s::total),
+		bind::child( "paid", &order_s::paid),
+		bind::child( "priority", &order_s::priority));
+
+	std::vector<order_s> orders=bind::parse_all( xml, schema);
+	LONGS_EQUAL( 2, orders.size());
+	LONGS_EQUAL( 7, orders[0].id);
+	STRCMP_EQUAL( "Anna & Co", orders[0].customer.c_str());
+	DOUBLES_EQUAL( 12.5, orders[0].total, 0);
+	CHECK_TRUE(orders[0].paid);
+	CHECK_FALSE(orders[0].priority);
+	//values that can not be converted keep the default
+	LONGS_EQUAL( 8, orders[1].id);
+	DOUBLES_EQUAL( 0, orders[1].total, 0);
+	CHECK_TRUE(orders[1].priority==2);
+
+	//exceptions of the callback stop the parsing
+	int count=0;
+	try{
+		bind::parse( xml, schema, [&count]( order_s &){
+			count++;
+			throw std::runtime_error( "stop");
+		});
+		FAIL("parse() must throw");
+	}catch( const std::runtime_error &e){
+		STRCMP_EQUAL( "stop", e.what());
+	}
+	LONGS_EQUAL( 1, count);
+
+	try{
+		bind::parse_all( "<order><total>1</order>", schema);
+		FAIL("parse_all() must throw");
+	}catch( const expat_dom::error &e){
+		LONGS_EQUAL( EINVAL, e.code().value());
+	}
+}
+
+TEST_GROUP(g_dom_dedup)
+{
+	static std::string print( dom_t *dom){
+		char *buffer;
+		size_t size;
+		FILE *f=open_memstream( &buffer, &size);
+		dom_print( f, dom, 0);
+		fclose( f);
+		std::string ret( buffer, size);
+		free( buffer);
+		return ret;
+	}
+};
+TEST( g_dom_dedup, t_dom_dedup){
+	const char *item="<item id=\"%d\"><name>n%d</name><shipping days=\"2\"><zone>EU</zone><cost>5</cost></shipping></item>";
+	std::string xml="<catalog>";
+	dom_parse_options_t options;
+	dom_t *plain;
+	dom_t *dom;
+	dom_t *clone;
+	dom_t *first;
+	dom_t *node;
+	char buffer[256];
+	int count;
+	int i;
+
+	for( i=0; i<20; i++){
+		snprintf( buffer, sizeof( buffer), item, i%10, i%10);
+		xml+=buffer;
+	}
+	xml+="</catalog>";
+	memset( &options, 0, sizeof( options));
+	options.flags=DOM_PARSE_DEDUP;
+	plain=dom_parse_buffer( xml.c_str(), xml.size());
+	dom=dom_parse_buffer_ex( xml.c_str(), xml.size(), &options);
+	CHECK_TRUE(dom);
+	CHECK_TRUE(print( plain)==print( dom));
+	LONGS_EQUAL( 20, dom->child_count);
+
+	//every shipping shares the first one, items repeat after ten
+	first=dom_find_node( dom->child, "shipping");
+	POINTERS_EQUAL( NULL, first->alias);
+	for( node=dom->child->next, i=1; node; node=node->next, i++){
+		if( i<10){
+			POINTERS_EQUAL( NULL, node->alias);
+			POINTERS_EQUAL( first, node->last->alias);
+		}else{
+			CHECK_TRUE(node->alias);
+			STRCMP_EQUAL( node->alias->attr->val, node->attr->val);
+			POINTERS_EQUAL( node->alias->child, node->child);
+		}
+	}
+
+	//walking up from shared children keeps the path
+	count=0;
+	for( expat_dom::node n : expat_dom::node( dom).descendants()){
+		count++;
+		(void)n;
+	}
+	LONGS_EQUAL( 20*5, count);
+
+	clone=dom_clone( dom);
+	CHECK_TRUE(print( clone)==print( plain));
+	dom_free( dom);
+	CHECK_TRUE(print( clone)==print( plain));
+	POINTERS_EQUAL( NULL, clone->last->alias);
+	dom_free( clone);
+	dom_free( plain);
+}
+
+TEST_GROUP(g_dom_hash)
+{
+};
+TEST( g_dom_hash, t_dom_hash){
+	const char *xml="<feed><item id=\"1\" cur=\"EUR\"><price>10</price></item><item id=\"2\"><price>20</price></item></feed>";
+	const char *other="<feed>\n  <item cur=\"EUR\" id=\"1\">\n    <price> 10 </price>\n  </item>\n"
+		"  <item id=\"2\"><price><![CDATA[20]]></price></item>\n</feed>";
+	dom_parse_options_t options;
+	dom_t *a;
+	dom_t *b;
+	dom_t *node;
+	uint64_t h;
+
+	memset( &options, 0, sizeof( options));
+	options.flags=DOM_PARSE_HASH;
+	a=dom_parse_buffer( xml, strlen(xml));
+	b=dom_parse_buffer_ex( other, strlen(other), &options);
+	CHECK_TRUE(a && b);
+	//hashes are computed while parsing
+	CHECK_TRUE(b->hash && b->child->hash);
+	POINTERS_EQUAL( 0, a->hash);
+
+	//formatting and attribute order do not matter by default
+	h=dom_hash( a, 0);
+	CHECK_TRUE(h==dom_hash( b, 0));
+	CHECK_TRUE(h==a->hash);
+	CHECK_TRUE(dom_hash( a, DOM_HASH_ATTR_ORDER) !=dom_hash( b, DOM_HASH_ATTR_ORDER));
+
+	//changes invalidate the cache up to the root
+	node=dom_find_node( b, "price");
+	LONGS_EQUAL( 0, dom_set_text( node, "11", 2));
+	POINTERS_EQUAL( 0, b->hash);
+	CHECK_TRUE(b->child->next->hash);
+	CHECK_TRUE(dom_hash( a, 0) !=dom_hash( b, 0));
+	CHECK_TRUE(dom_hash( a->child->next, 0)==dom_hash( b->child->next, 0));
+	LONGS_EQUAL( 0, dom_set_text( node, "10", 2));
+	CHECK_TRUE(h==dom_hash( b, 0));
+
+	dom_free( dom_remove( b->child));
+	CHECK_TRUE(dom_hash( a, 0) !=dom_hash( b, 0));
+	POINTERS_EQUAL( 0, dom_hash( NULL, 0));
+	dom_free( a);
+	dom_free( b);
+
+	//text outside of CDATA sections counts as well
+	std::string foo="<a>foo<![CDATA[x]]></a>";
+	std::string bar="<a>bar<![CDATA[x]]></a>";
+	a=dom_parse_buffer( foo.c_str(), foo.size());
+	b=dom_parse_buffer( bar.c_str(), bar.size());
+	CHECK_TRUE(a && b);
+	CHECK_TRUE(dom_hash( a, 0) !=dom_hash( b, 0));
+	dom_free( a);
+	dom_free( b);
+}
+
+TEST_GROUP(g_dom_reparse)
+{
+};
+TEST( g_dom_reparse, t_dom_reparse){
+	const char *xml="<config v=\"1\"><item id=\"1\"><p>10</p></item><item id=\"2\"><p>20</p></item>"
+		"<item id=\"3\"><p>30</p></item><item id=\"4\"><p>40</p></item></config>";
+	const char *edit="<config v=\"2\"><item id=\"1\"><p>10</p></item><item id=\"2\"><p>21</p></item>"
+		"<item id=\"3\"><p>30</p></item><note>x</note></config>";
+	dom_changes_t changes;
+	dom_t *old;
+	dom_t *dom;
+	dom_t *item1;
+	dom_t *item3;
+	dom_t *price2;
+	int i;
+
+	old=dom_parse_buffer( xml, strlen(xml));
+	item1=old->child;
+	price2=old->child->next->child;
+	item3=old->child->next->next;
+
+	dom=dom_reparse( old, edit, strlen(edit), NULL, &changes);
+	CHECK_TRUE(dom && dom !=old);
+	//unchanged items are moved from the old tree
+	POINTERS_EQUAL( item1, dom->child);
+	POINTERS_EQUAL( item3, dom->child->next->next);
+	POINTERS_EQUAL( dom, item3->parent);
+	POINTERS_EQUAL( dom->child->next->next->next, dom->last);
+	LONGS_EQUAL( 4, dom->child_count);
+
+	LONGS_EQUAL( 0, changes.incomplete);
+	LONGS_EQUAL( 4, changes.count);
+	for( i=0; i<changes.count; i++){
+		dom_change_t *c=&changes.list[i];
+		if( c->type==DOM_CHANGE_MODIFIED && c->old==old){
+			POINTERS_EQUAL( dom, c->node);
+		}else if( c->type==DOM_CHANGE_MODIFIED){
+			POINTERS_EQUAL( price2, c->old);
+			std::string text( c->node->user_data, c->node->user_data_len);
+			STRCMP_EQUAL( "21", text.c_str());
+		}else if( c->type==DOM_CHANGE_ADDED){
+			STRCMP_EQUAL( "note", c->node->name);
+		}else{
+			LONGS_EQUAL( DOM_CHANGE_REMOVED, c->type);
+			STRCMP_EQUAL( "4", dom_find_attr( c->old->attr, "id"));
+		}
+	}
+	dom_changes_free( &changes);
+	old=dom_parse_buffer( edit, strlen(edit));
+	CHECK_TRUE(dom_hash( old, 0)==dom_hash( dom, 0));
+	dom_free( old);
+
+	//nothing changed
+	old=dom;
+	dom=dom_reparse( old, edit, strlen(edit), NULL, &changes);
+	POINTERS_EQUAL( old, dom);
+	LONGS_EQUAL( 0, changes.count);
+	dom_changes_free( &changes);
+	dom_free( dom);
+
+	//identical siblings are reused in order
+	std::string many;
+	for( i=0; i<3000; i++){
+		many+="<i><v>1</v></i>";
+	}
+	std::string many2="<r>"+many+"<j/></r>";
+	many="<r>"+many+"</r>";
+	old=dom_parse_buffer( many.c_str(), many.size());
+	CHECK_TRUE(old);
+	item1=old->child;
+	item3=old->last;
+	dom=dom_reparse( old, many2.c_str(), many2.size(), NULL, &changes);
+	CHECK_TRUE(dom && dom !=old);
+	LONGS_EQUAL( 1, changes.count);
+	LONGS_EQUAL( DOM_CHANGE_ADDED, changes.list[0].type);
+	POINTERS_EQUAL( item1, dom->child);
+	for( price2=dom->child; price2->next !=dom->last; price2=price2->next);
+	POINTERS_EQUAL( item3, price2);
+	dom_changes_free( &changes);
+	dom_free( dom);
+
+	//text outside of CDATA sections is a change
+	std::string foo="<r><a>foo<![CDATA[x]]></a><b>1</b></r>";
+	std::string bar="<r><a>bar<![CDATA[x]]></a><b>1</b></r>";
+	old=dom_parse_buffer( foo.c_str(), foo.size());
+	CHECK_TRUE(old);
+	dom=dom_reparse( old, bar.c_str(), bar.size(), NULL, &changes);
+	CHECK_TRUE(dom && dom !=old);
+	LONGS_EQUAL( 1, changes.count);
+	LONGS_EQUAL( DOM_CHANGE_MODIFIED, changes.list[0].type);
+	STRCMP_EQUAL( "a", changes.list[0].node->name);
+	dom_changes_free( &changes);
+	dom_free( dom);
+}
+
+TEST_GROUP(g_dom_large)
+{
+	/*
+	 * Streaming generator of a document with one long text node, so the
+	 * document is never kept in memory as a whole.
+	 */
+	struct generator{
+		std::string head;
+		std::string tail;
+		size_t text_len;
+		size_t pos;
+
+		generator( const char *h, size_t len, const char *t) : head(h), tail(t), text_len(len), pos(0){}
+
+		static char text_at( size_t i){
+			static const char alphabet[]="ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+			return alphabet[( i+i/4099)%64];
+		}
+
+		size_t size(){
+			return head.size()+text_len+tail.size();
+		}
+
+		size_t next( char *buffer, size_t buffer_size){
+			size_t len=0;
+			size_t i;
+
+			for( ; len<buffer_size && pos<size(); len++, pos++){
+				if( pos<head.size()){
+					buffer[len]=head[pos];
+				}else if(( i=pos-head.size())<text_len){
+					buffer[len]=text_at( i);
+				}else{
+					buffer[len]=tail[i-text_len];
+				}
+			}
+			return len;
+		}
+	};
+
+	static dom_t *parse( generator &g, size_t chunk){
+		std::string buffer( chunk, 0);
+		void *parser=NULL;
+		dom_t *dom=NULL;
+		size_t len;
+
+		do{
+			len=g.next( &buffer[0], chunk);
+			if( dom_parse_chunked_data( &parser, &dom, buffer.data(), len, len==0)){
+				return NULL;
+			}
+		}while( len);
+		return dom;
+	}
+
+	static bool check_text( const char *text, size_t len){
+		size_t i;
+
+		for( i=0; i<len; i++){
+			if( text[i] !=generator::text_at( i)){
+				return false;
+			}
+		}
+		return true;
+	}
+
+	static bool big_tests(){
+		//multi-GB inputs take several GB of memory and are run on request
+		return getenv( "EXPAT_DOM_BIG_TESTS") !=NULL;
+	}
+};
+TEST( g_dom_large, t_dom_large_text){
+	generator g( "<doc><blob>", 3*1024*1024+17, "</blob><n>1</n></doc>");
+	generator cdata( "<doc><blob><![CDATA[", 1024*1024+3, "]]></blob></doc>");
+	dom_t *dom;
+	dom_t *node;
+
+	dom=parse( g, 4093);
+	CHECK_TRUE( dom !=NULL);
+	node=dom_find_node( dom, "blob");
+	LONGS_EQUAL( g.text_len, node->data_len);
+	CHECK_TRUE( check_text( node->data, node->data_len));
+	CHECK_TRUE( dom_find_node( dom, "n") !=NULL);
+	dom_free( dom);
+
+	//user_data follows data when the buffer is moved
+	dom=parse( cdata, 65537);
+	CHECK_TRUE( dom !=NULL);
+	node=dom_find_node( dom, "blob");
+	LONGS_EQUAL( cdata.text_len, node->user_data_len);
+	CHECK_TRUE( check_text( node->user_data, node->user_data_len));
+	dom_free( dom);
+}
+TEST( g_dom_large, t_dom_big_text){
+	generator g( "<doc><blob>", (size_t)5*512*1024*1024, "</blob><n>1</n></doc>");
+	dom_t *dom;
+	dom_t *node;
+	int64_t value;
+
+	if( !big_tests()){
+		return;
+	}
+	dom=parse( g, 1024*1024);
+	CHECK_TRUE( dom !=NULL);
+	node=dom_find_node( dom, "blob");
+	CHECK_TRUE( node->data_len==g.text_len);
+	CHECK_TRUE( check_text( node->data, node->data_len));
+	LONGS_EQUAL( 0, dom_text_int64( dom_find_node( dom, "n"), &value));
+	LONGS_EQUAL( 1, value);
+	dom_free( dom);
+}
+TEST( g_dom_large, t_dom_big_buffer){
+	const char *head="<doc><a>1</a>";
+	const char *tail="<b>2</b></doc>";
+	const size_t size=(size_t)17*128*1024*1024;
+	char comment[1024];
+	dom_parse_options_t options;
+	char *buffer;
+	size_t len;
+	dom_t *dom;
+
+	if( !big_tests()){
+		return;
+	}
+	//comments do not make nodes, so only the buffer is larger than 2 GB
+	memset( comment, 'x', sizeof(comment));
+	memcpy( comment, "<!--", 4);
+	memcpy( comment+sizeof(comment)-4, "-->\n", 4);
+	buffer=(char *)malloc( size);
+	CHECK_TRUE( buffer !=NULL);
+	len=strlen( head);
+	memcpy( buffer, head, len);
+	for( ; len+sizeof(comment)+strlen( tail)<=size; len+=sizeof(comment)){
+		memcpy( buffer+len, comment, sizeof(comment));
+	}
+	memcpy( buffer+len, tail, strlen( tail));
+	len+=strlen( tail);
+
+	memset( &options, 0, sizeof(options));
+	options.max_input_bytes=(int64_t)2*1024*1024*1024;
+	CHECK_TRUE( NULL==dom_parse_buffer_ex( buffer, len, &options));
+	LONGS_EQUAL( E2BIG, errno);
+
+	options.max_input_bytes=(int64_t)3*1024*1024*1024;
+	dom=dom_parse_buffer_ex( buffer, len, &options);
+	free( buffer);
+	CHECK_TRUE( dom !=NULL);
+	STRCMP_EQUAL( "b", dom->last->name);
+	LONGS_EQUAL( 2, dom->child_count);
+	dom_free( dom);
+}
+
+TEST_GROUP(g_dom_borrow)
+{
+	static std::string text( dom_t *node){
+		return node->user_data? std::string( node->user_data, node->user_data_len) : std::string();
+	}
+
+	static bool inside( const std::string &buffer, const char *ptr){
+		return ptr>=buffer.data() && ptr<buffer.data()+buffer.size();
+	}
+};
+TEST( g_dom_borrow, t_dom_borrow_buffer){
+	std::string xml="<doc><a>plain text</a><b>x &amp; y</b><c><![CDATA[raw <data>]]></c>"
+		"<d>line\r\nend</d><e>  padded  </e></doc>";
+	dom_parse_options_t options;
+	dom_t *dom;
+	dom_t *clone;
+	dom_t *node;
+	std::string value;
+
+	memset( &options, 0, sizeof( options));
+	options.flags=DOM_PARSE_BORROW;
+	dom=dom_parse_buffer_ex( xml.data(), xml.size(), &options);
+	CHECK_TRUE( dom !=NULL);
+
+	node=dom_find_node( dom, "a");
+	CHECK_TRUE( inside( xml, node->data));
+	value=text( node);
+	STRCMP_EQUAL( "plain text", value.c_str());
+	//decoded text is copied
+	node=dom_find_node( dom, "b");
+	CHECK_FALSE( inside( xml, node->data));
+	value=text( node);
+	STRCMP_EQUAL( "x & y", value.c_str());
+	node=dom_find_node( dom, "c");
+	CHECK_TRUE( inside( xml, node->user_data));
+	value=text( node);
+	STRCMP_EQUAL( "raw <data>", value.c_str());
+	node=dom_find_node( dom, "d");
+	CHECK_FALSE( inside( xml, node->data));
+	value=text( node);
+	STRCMP_EQUAL( "line\nend", value.c_str());
+	node=dom_find_node( dom, "e");
+	CHECK_TRUE( inside( xml, node->data));
+	value=text( node);
+	STRCMP_EQUAL( "padded", value.c_str());
+
+	//clones keep borrowing from the buffer
+	clone=dom_clone( dom);
+	dom_free( dom);
+	value=text( dom_find_node( clone, "a"));
+	STRCMP_EQUAL( "plain text", value.c_str());
+	LONGS_EQUAL( 0, dom_set_text( dom_find_node( clone, "a"), "new", 3));
+	value=text( dom_find_node( clone, "a"));
+	STRCMP_EQUAL( "new", value.c_str());
+	dom_free( clone);
+}
+TEST( g_dom_borrow, t_dom_borrow_options){
+	std::string xml="<r>\n  <i> v </i>\n  <i> v </i>\n  <j><![CDATA[ w ]]> </j>\n</r>";
+	dom_parse_options_t options;
+	dom_t *dom;
+	dom_t *node;
+	std::string value;
+
+	memset( &options, 0, sizeof( options));
+	options.flags=DOM_PARSE_BORROW | DOM_PARSE_SKIP_BLANK | DOM_PARSE_TRIM | DOM_PARSE_USER_DATA_ONLY
+		| DOM_PARSE_DEDUP;
+	dom=dom_parse_buffer_ex( xml.data(), xml.size(), &options);
+	CHECK_TRUE( dom !=NULL);
+	POINTERS_EQUAL( NULL, dom->data);
+	node=dom->child;
+	CHECK_TRUE( inside( xml, node->data));
+	value=text( node);
+	STRCMP_EQUAL( "v", value.c_str());
+	POINTERS_EQUAL( node, node->next->alias);
+	//the text after CDATA section does not continue it in the input
+	node=dom_find_node( dom, "j");
+	CHECK_FALSE( inside( xml, node->data));
+	value=text( node);
+	STRCMP_EQUAL( " w ", value.c_str());
+	LONGS_EQUAL( 3, node->data_len);
+	dom_free( dom);
+}
+TEST( g_dom_borrow, t_dom_borrow_file){
+	char name[]="/tmp/expat-dom-test-XXXXXX";
+	dom_parse_options_t options;
+	dom_t *dom;
+	dom_t *node;
+	std::string value;
+	std::string expected;
+	FILE *f;
+	int fd;
+	int i;
+
+	fd=mkstemp( name);
+	CHECK_TRUE( fd!=-1);
+	CHECK_TRUE(( f=fdopen( fd, "w")));
+	fprintf( f, "<items>");
+	for( i=0; i<1000; i++){
+		fprintf( f, "<item id=\"%d\">value %d &lt; %d</item>", i, i, i+1);
+	}
+	fprintf( f, "</items>");
+	fclose( f);
+
+	memset( &options, 0, sizeof( options));
+	options.flags=DOM_PARSE_BORROW;
+	dom=dom_parse_file_name_ex( name, &options);
+	unlink( name);
+	CHECK_TRUE( dom !=NULL);
+	for( i=0, node=dom->child; node; node=node->next, i++){
+		value=text( node);
+		expected="value "+std::to_string( i)+" < "+std::to_string( i+1);
+		STRCMP_EQUAL( expected.c_str(), value.c_str());
+	}
+	LONGS_EQUAL( 1000, i);
+	dom_free( dom);
+}
+
+TEST_GROUP(g_dom_structure)
+{
+	//nodes of the tree in document order
+	static int collect( dom_t *node, dom_t **nodes, int count){
+		for( ; node; node=node->next){
+			nodes[count++]=node;
+			count=collect( node->child, nodes, count);
+		}
+		return count;
+	}
+};
+TEST( g_dom_structure, t_dom_structure_index){
+	const char *xml="<a><b><c/><d>text</d></b><e><f/><g><h/></g></e><i/></a>";
+	dom_parse_options_t options;
+	dom_t *nodes[16];
+	dom_t *other[16];
+	dom_t *dom;
+	dom_t *clone;
+	dom_t *node;
+	int count;
+	int i;
+	int j;
+
+	dom=dom_parse_buffer( xml, strlen(xml));
+	clone=dom_clone( dom);
+	LONGS_EQUAL( 0, dom_build_structure_index( dom));
+	count=collect( dom, nodes, 0);
+	LONGS_EQUAL( 9, count);
+	collect( clone, other, 0);
+	for( i=0; i<count; i++){
+		LONGS_EQUAL( i+1, nodes[i]->pre);
+	}
+	STRCMP_EQUAL( "c", nodes[2]->name);
+	LONGS_EQUAL( 1, nodes[2]->post);
+	LONGS_EQUAL( 9, dom->post);
+	LONGS_EQUAL( 2, nodes[2]->depth);
+	LONGS_EQUAL( 8, dom->size);
+	LONGS_EQUAL( 3, dom_find_node( dom, "e")->size);
+	POINTERS_EQUAL( dom_find_node( dom, "e"), dom_find_node( dom, "b")->skip);
+	POINTERS_EQUAL( dom_find_node( dom, "i"), dom_find_node( dom, "h")->skip);
+	POINTERS_EQUAL( NULL, dom->skip);
+	POINTERS_EQUAL( NULL, dom_find_node( dom, "i")->skip);
+
+	//the index gives the same answers as walking the clone, which has none
+	for( i=0; i<count; i++){
+		LONGS_EQUAL( dom_descendant_count( other[i]), dom_descendant_count( nodes[i]));
+		for( j=0; j<count; j++){
+			LONGS_EQUAL( i<j && j<=i+nodes[i]->size, dom_is_ancestor( nodes[i], nodes[j]));
+			LONGS_EQUAL( dom_is_ancestor( other[i], other[j]), dom_is_ancestor( nodes[i], nodes[j]));
+			LONGS_EQUAL( i<j? -1 : i>j? 1 : 0, dom_compare_order( nodes[i], nodes[j]));
+			LONGS_EQUAL( dom_compare_order( other[i], other[j]), dom_compare_order( nodes[i], nodes[j]));
+		}
+	}
+	LONGS_EQUAL( 0, dom_compare_order( dom, clone));
+
+	//scan that jumps over the subtree of e
+	for( i=0, node=dom; node; i++){
+		node=strcmp( node->name, "e") && node->child? node->child : node->skip;
+	}
+	LONGS_EQUAL( 6, i);
+
+	//changes drop the index
+	node=dom_remove( dom_find_node( dom, "e"));
+	LONGS_EQUAL( 4, dom_descendant_count( dom));
+	LONGS_EQUAL( 0, dom_append_child( nodes[2], node));
+	CHECK_TRUE( dom_is_ancestor( nodes[1], nodes[6]));
+	LONGS_EQUAL( -1, dom_compare_order( nodes[7], nodes[3]));
+	LONGS_EQUAL( EINVAL, dom_append_child( nodes[6], dom));
+	dom_free( clone);
+
+	//the parser builds the same index
+	memset( &options, 0, sizeof( options));
+	options.flags=DOM_PARSE_INDEX;
+	clone=dom_parse_buffer_ex( xml, strlen(xml), &options);
+	LONGS_EQUAL( 0, dom_build_structure_index( dom));
+	count=collect( dom, nodes, 0);
+	collect( clone, other, 0);
+	dom_free( dom);
+	dom=dom_parse_buffer( xml, strlen(xml));
+	LONGS_EQUAL( 0, dom_build_structure_index( dom));
+	count=collect( dom, nodes, 0);
+	for( i=0; i<count; i++){
+		LONGS_EQUAL( nodes[i]->pre, other[i]->pre);
+		LONGS_EQUAL( nodes[i]->post, other[i]->post);
+		LONGS_EQUAL( nodes[i]->depth, other[i]->depth);
+		LONGS_EQUAL( nodes[i]->size, other[i]->size);
+		LONGS_EQUAL( nodes[i]->skip? nodes[i]->skip->pre : 0, other[i]->skip? other[i]->skip->pre : 0);
+	}
+	dom_free( clone);
+	dom_free( dom);
+}
+
+TEST_GROUP(g_dom_keys)
+{
+};
+TEST( g_dom_keys, t_dom_key_index){
+	const char *xml="<db><item id=\"1\"><ref to=\"3\"/></item><item id=\"2\"/>"
+			"<item ID=\"3\"><ref to=\"1\"/></item><group id=\"2\"/><item id=\"2\"/></db>";
+	const char *bad;
+	const char *dup;
+	dom_parse_options_t options;
+	dom_key_index_t *index;
+	dom_key_index_t *any;
+	dom_t *dom;
+	dom_t *node;
+	char value[16];
+	int i;
+
+	dom=dom_parse_buffer( xml, strlen(xml));
+	index=dom_build_key_index( dom, "item", "id");
+	CHECK( index);
+	node=dom_key_lookup( index, "3");
+	CHECK( node);
+	STRCMP_EQUAL( "1", dom_find_attr( node->child->attr, "to"));
+	POINTERS_EQUAL( node, dom_key_lookup( index, dom_find_attr( dom_key_lookup( index, "1")->child->attr, "to")));
+	POINTERS_EQUAL( NULL, dom_key_lookup( index, "4"));
+	POINTERS_EQUAL( NULL, dom_key_lookup( index, ""));
+	POINTERS_EQUAL( NULL, dom_key_lookup_next( index, node));
+
+	//duplicates in document order, elements of other names are not indexed
+	node=dom_key_lookup( index, "2");
+	POINTERS_EQUAL( dom->child->next, node);
+	node=dom_key_lookup_next( index, node);
+	POINTERS_EQUAL( dom->last, node);
+	POINTERS_EQUAL( NULL, dom_key_lookup_next( index, node));
+	POINTERS_EQUAL( NULL, dom_key_lookup_next( index, dom_find_node( dom, "group")));
+
+	any=dom_build_key_index( dom, "*", "id");
+	node=dom_key_lookup( any, "2");
+	node=dom_key_lookup_next( any, node);
+	STRCMP_EQUAL( "group", node->name);
+	dom_key_index_free( any);
+	dom_key_index_free( index);
+
+	POINTERS_EQUAL( NULL, dom_build_key_index( NULL, NULL, "id"));
+	LONGS_EQUAL( EINVAL, errno);
+	POINTERS_EQUAL( NULL, dom_key_index_new( NULL, NULL));
+	LONGS_EQUAL( EINVAL, errno);
+	dom_free( dom);
+
+	//the parser fills the index, a failed parse leaves it as it was
+	index=dom_key_index_new( NULL, "to");
+	memset( &options, 0, sizeof( options));
+	options.key_index=index;
+	dom=dom_parse_buffer_ex( xml, strlen(xml), &options);
+	POINTERS_EQUAL( dom_find_node( dom, "ref"), dom_key_lookup( index, "3"));
+	bad="<a to=\"5\"><b to=\"1\"/>";
+	POINTERS_EQUAL( NULL, dom_parse_buffer_ex( bad, strlen(bad), &options));
+	POINTERS_EQUAL( NULL, dom_key_lookup( index, "5"));
+	node=dom_key_lookup( index, "1");
+	POINTERS_EQUAL( dom->child->next->next->child, node);
+	POINTERS_EQUAL( NULL, dom_key_lookup_next( index, node));
+	dom_key_index_free( index);
+	dom_free( dom);
+
+	//with DOM_PARSE_DEDUP children of aliases are indexed once
+	index=dom_key_index_new( "c", "to");
+	options.key_index=index;
+	options.flags=DOM_PARSE_DEDUP;
+	dup="<a><b><c to=\"1\"/></b><b><c to=\"1\"/></b></a>";
+	dom=dom_parse_buffer_ex( dup, strlen(dup), &options);
+	CHECK( dom);
+	CHECK( dom->last->alias);
+	node=dom_key_lookup( index, "1");
+	POINTERS_EQUAL( dom->child->child, node);
+	POINTERS_EQUAL( NULL, dom_key_lookup_next( index, node));
+	dom_key_index_free( index);
+	dom_free( dom);
+
+	//dom_reparse() indexes the tree it returns, with the reused subtrees
+	std::string v1="<r><i id=\"1\">x</i><i id=\"2\">y</i></r>";
+	std::string v2="<r><i id=\"1\">x</i><i id=\"2\">z</i></r>";
+	dom_changes_t changes;
+	dom_t *old;
+	old=dom_parse_buffer( v1.c_str(), v1.size());
+	CHECK( old);
+	node=old->child;
+	index=dom_key_index_new( "i", "id");
+	memset( &options, 0, sizeof( options));
+	options.key_index=index;
+	dom=dom_reparse( old, v2.c_str(), v2.size(), &options, &changes);
+	CHECK( dom);
+	POINTERS_EQUAL( node, dom_key_lookup( index, "1"));
+	POINTERS_EQUAL( dom->last, dom_key_lookup( index, "2"));
+	POINTERS_EQUAL( NULL, dom_key_lookup_next( index, dom->last));
+	POINTERS_EQUAL( NULL, dom_key_lookup_next( index, node));
+	dom_changes_free( &changes);
+	dom_key_index_free( index);
+	dom_free( dom);
+
+	//the table grows
+	dom=dom_new_element( "db");
+	for( i=0; i<5000; i++){
+		node=dom_new_element( "item");
+		snprintf( value, sizeof( value), "%d", i);
+		dom_set_attr( node, "id", value);
+		dom_append_child( dom, node);
+	}
+	index=dom_build_key_index( dom, "item", "id");
+	for( i=0, node=dom->child; node; node=node->next, i++){
+		snprintf( value, sizeof( value), "%d", i);
+		POINTERS_EQUAL( node, dom_key_lookup( index, value));
+	}
+	LONGS_EQUAL( 5000, i);
+	dom_key_index_free( index);
+	dom_free( dom);
+
+	expat_dom::document doc=expat_dom::document::parse( xml);
+	expat_dom::key_index keys( doc.root(), "item", "id");
+	CHECK( keys.find( "2"));
+	CHECK( keys.find_next( keys.find( "2")));
+	CHECK_FALSE( keys.find( "5"));
+}
+
+TEST_GROUP(g_dom_reader)
+{
+	//events of the reader written one per line, or the error code
+	static std::string events( dom_reader_t *reader){
+		dom_reader_event_t event;
+		std::string ret;
+		int type;
+		int i;
+
+		while( (type=dom_reader_next( reader, &event))>0){
+			ret+=std::string( event.depth, ' ');
+			if( type==DOM_READER_START){
+				ret+="<"+std::string( event.name);
+				for( i=0; event.attrs[i]; i+=2){
+					ret+=" "+std::string( event.attrs[i])+"="+event.attrs[i+1];
+				}
+				ret+=">";
+			}else if( type==DOM_READER_TEXT){
+				ret+=std::string( event.text, event.text_len);
+			}else{
+				ret+="</"+std::string( event.name)+">";
+			}
+			ret+="\n";
+		}
+		if( type<0){
+			ret+="error "+std::to_string( errno)+"\n";
+		}
+		return ret;
+	}
+};
+TEST( g_dom_reader, t_dom_reader){
+	const char *xml="<?xml version=\"1.0\"?>\n<a x=\"1\" y=\"&amp;\">t1<b/><![CDATA[<c>]]> &lt; <d z=\"2\">t2</d></a>\n";
+	const char *expected="<a x=1 y=&>\n t1\n <b>\n </b>\n <c> < \n <d z=2>\n  t2\n </d>\n</a>\n";
+	char name[]="/tmp/expat-dom-test-XXXXXX";
+	dom_parse_options_t options;
+	dom_reader_event_t event;
+	dom_reader_t *reader;
+	std::string result;
+	std::string big;
+	const char *bad;
+	size_t i;
+	int type;
+	int fd;
+
+	reader=dom_reader_new_buffer( xml, strlen(xml), NULL);
+	result=events( reader);
+	STRCMP_EQUAL( expected, result.c_str());
+	//the end is returned again
+	LONGS_EQUAL( DOM_READER_EOF, dom_reader_next( reader, &event));
+	dom_reader_free( reader);
+
+	//a byte at a time gives the same events
+	reader=dom_reader_new( NULL);
+	result="";
+	for( i=0; i<=strlen(xml); i++){
+		LONGS_EQUAL( 0, dom_reader_push( reader, xml+i, i<strlen(xml)? 1 : 0, i==strlen(xml)));
+		if( i==0){
+			LONGS_EQUAL( EBUSY, dom_reader_push( reader, xml, 1, 0));
+		}
+		result+=events( reader);
+		if( i<strlen(xml)){
+			CHECK( result.size()>=8);
+			STRCMP_EQUAL( "error 11\n", result.c_str()+result.size()-9);
+			result.resize( result.size()-9);
+		}
+	}
+	STRCMP_EQUAL( expected, result.c_str());
+	LONGS_EQUAL( EINVAL, dom_reader_push( reader, xml, 1, 1));
+	dom_reader_free( reader);
+
+	//a file larger than one block
+	for( i=0; i<20000; i++){
+		big+="<item id=\""+std::to_string( i)+"\">value "+std::to_string( i)+"</item>";
+	}
+	big="<items>"+big+"</items>";
+	fd=mkstemp( name);
+	CHECK_TRUE( fd!=-1);
+	unlink( name);
+	LONGS_EQUAL( big.size(), write( fd, big.data(), big.size()));
+	lseek( fd, 0, SEEK_SET);
+	reader=dom_reader_new_fd( fd, NULL);
+	for( i=0; (type=dom_reader_next( reader, &event))>0; ){
+		if( type==DOM_READER_START && event.depth==1){
+			result=std::to_string( i);
+			STRCMP_EQUAL( result.c_str(), dom_reader_attr( &event, "ID"));
+		}else if( type==DOM_READER_TEXT){
+			result="value "+std::to_string( i++);
+			LONGS_EQUAL( result.size(), event.text_len);
+			CHECK( 0==memcmp( result.data(), event.text, event.text_len));
+		}
+	}
+	LONGS_EQUAL( DOM_READER_EOF, type);
+	LONGS_EQUAL( 20000, i);
+	dom_reader_free( reader);
+	close( fd);
+
+	//options
+	memset( &options, 0, sizeof( options));
+	options.flags=DOM_PARSE_SKIP_BLANK;
+	bad="<a>\n <b> x </b>\n</a>";
+	reader=dom_reader_new_buffer( bad, strlen(bad), &options);
+	result=events( reader);
+	STRCMP_EQUAL( "<a>\n <b>\n   x \n </b>\n</a>\n", result.c_str());
+	dom_reader_free( reader);
+	options.flags=0;
+	options.max_depth=2;
+	bad="<a><b><c/></b></a>";
+	reader=dom_reader_new_buffer( bad, strlen(bad), &options);
+	result=events( reader);
+	STRCMP_EQUAL( "<a>\n <b>\nerror 7\n", result.c_str());
+	LONGS_EQUAL( -1, dom_reader_next( reader, &event));
+	LONGS_EQUAL( E2BIG, errno);
+	dom_reader_free( reader);
+	options.max_depth=0;
+	options.flags=DOM_PARSE_NO_DTD;
+	bad="<!DOCTYPE a><a/>";
+	reader=dom_reader_new_buffer( bad, strlen(bad), &options);
+	result=events( reader);
+	STRCMP_EQUAL( "error 1\n", result.c_str());
+	dom_reader_free( reader);
+
+	//parse errors come after the events before them
+	bad="<a><b></a>";
+	reader=dom_reader_new_buffer( bad, strlen(bad), NULL);
+	result=events( reader);
+	STRCMP_EQUAL( "<a>\n <b>\nerror 22\n", result.c_str());
+	dom_reader_free( reader);
+
+	POINTERS_EQUAL( NULL, dom_reader_free( NULL));
+	POINTERS_EQUAL( NULL, dom_reader_new_fd( -1, NULL));
+	LONGS_EQUAL( EINVAL, errno);
+}
+
+TEST_GROUP(g_dom_json)
+{
+	static int append( void *ctx, const char *buffer, size_t buffer_len){
+		((std::string *)ctx)->append( buffer, buffer_len);
+		return 0;
+	}
+	static int fail( void *ctx, const char *buffer, size_t buffer_len){
+		return EIO;
+	}
+	//output of the conversion, or the error code
+	static std::string json( const char *xml, const dom_json_options_t *options){
+		std::string ret;
+		int status;
+
+		if( (status=dom_xml_to_json( xml, strlen(xml), append, &ret, options))){
+			ret="error "+std::to_string( status);
+		}
+		return ret;
+	}
+};
+TEST( g_dom_json, t_dom_xml_to_json){
+	const char *arrays[]={ "b", NULL};
+	dom_parse_options_t parse;
+	dom_json_options_t options;
+	std::string result;
+	std::string big;
+	std::string expected;
+	const char *xml;
+	int i;
+
+	result=json( "<a x=\"1\" y=\"&amp;\">t1<b/><c>t2</c><c/><c k=\"v\"/> t3 </a>", NULL);
+	STRCMP_EQUAL( "{\"a\":{\"@x\":\"1\",\"@y\":\"&\",\"b\":null,\"c\":[\"t2\",null,{\"@k\":\"v\"}],"
+			"\"#text\":\"t1 t3 \"}}", result.c_str());
+	//white space between elements is not text
+	result=json( "<a>\n\t<b>x</b>\n\t<c><d>1</d><d>2</d></c>\n</a>", NULL);
+	STRCMP_EQUAL( "{\"a\":{\"b\":\"x\",\"c\":{\"d\":[\"1\",\"2\"]}}}", result.c_str());
+	result=json( "<a>x <b/>\n\t<c/> y\n</a>", NULL);
+	STRCMP_EQUAL( "{\"a\":{\"b\":null,\"c\":null,\"#text\":\"x  y\\n\"}}", result.c_str());
+	//siblings with other elements between them are not an array
+	result=json( "<r><a/><a>1</a><b/><a/></r>", NULL);
+	STRCMP_EQUAL( "{\"r\":{\"a\":[null,\"1\"],\"b\":null,\"a\":null}}", result.c_str());
+	result=json( "<a><b/><c/><b/></a>", NULL);
+	STRCMP_EQUAL( "{\"a\":{\"b\":null,\"c\":null,\"b\":null}}", result.c_str());
+	result=json( "<a>\"\\\n&#9;&#13;</a>", NULL);
+	STRCMP_EQUAL( "{\"a\":\"\\\"\\\\\\n\\t\\r\"}", result.c_str());
+
+	//conventions
+	memset( &options, 0, sizeof( options));
+	options.attr_prefix="";
+	options.text_key="value";
+	options.arrays=arrays;
+	result=json( "<a x=\"1\"><b>t</b><c/>t</a>", &options);
+	STRCMP_EQUAL( "{\"a\":{\"x\":\"1\",\"b\":[\"t\"],\"c\":null,\"value\":\"t\"}}", result.c_str());
+	options.arrays=NULL;
+	options.flags=DOM_JSON_ARRAYS;
+	result=json( "<a><b/><c><d/></c></a>", &options);
+	STRCMP_EQUAL( "{\"a\":{\"b\":[null],\"c\":[{\"d\":[null]}]}}", result.c_str());
+
+	//a long run is written as it comes
+	for( i=0; i<20000; i++){
+		big+="<b id=\""+std::to_string( i)+"\">value "+std::to_string( i)+"</b>";
+		expected+=std::string( i? "," : "")+"{\"@id\":\""+std::to_string( i)+"\",\"#text\":\"value "
+				+std::to_string( i)+"\"}";
+	}
+	big="<a>"+big+"</a>";
+	expected="{\"a\":{\"b\":["+expected+"]}}";
+	result=json( big.c_str(), NULL);
+	CHECK( result==expected);
+	//the first element does not fit the lookahead
+	memset( &options, 0, sizeof( options));
+	options.lookahead=16;
+	big="<a><b>"+std::string( 100000, 'x')+"</b><c/></a>";
+	result=json( big.c_str(), &options);
+	expected="{\"a\":{\"b\":\""+std::string( 100000, 'x')+"\",\"c\":null}}";
+	CHECK( result==expected);
+	big="<a><b>"+std::string( 100000, 'x')+"</b><b/></a>";
+	result=json( big.c_str(), &options);
+	STRCMP_EQUAL( "error 7", result.c_str());
+	options.arrays=arrays;
+	result=json( big.c_str(), &options);
+	expected="{\"a\":{\"b\":[\""+std::string( 100000, 'x')+"\",null]}}";
+	CHECK( result==expected);
+
+	//parser options
+	memset( &parse, 0, sizeof( parse));
+	memset( &options, 0, sizeof( options));
+	options.parse=&parse;
+	parse.flags=DOM_PARSE_TRIM;
+	result=json( "<a> x <b> </b></a>", &options);
+	STRCMP_EQUAL( "{\"a\":{\"b\":\"\",\"#text\":\"x\"}}", result.c_str());
+	parse.flags=DOM_PARSE_NO_DTD;
+	result=json( "<!DOCTYPE a><a/>", &options);
+	STRCMP_EQUAL( "error 1", result.c_str());
+	parse.flags=0;
+	parse.max_depth=2;
+	result=json( "<a><b><c/></b></a>", &options);
+	STRCMP_EQUAL( "error 7", result.c_str());
+
+	//errors
+	result=json( "<a><b></a>", NULL);
+	STRCMP_EQUAL( "error 22", result.c_str());
+	xml="<a/>";
+	LONGS_EQUAL( EIO, dom_xml_to_json( xml, strlen(xml), fail, NULL, NULL));
+	LONGS_EQUAL( EINVAL, dom_xml_to_json( NULL, 0, append, &result, NULL));
+}
+
+TEST_GROUP(g_dom_query)
+{
+	char name[32];
+
+	void setup(){
+		strcpy( name, "/tmp/expat-dom-test-XXXXXX");
+	}
+	//writes the file to query
+	void fixture( const std::string &xml){
+		int fd=mkstemp( name);
+
+		CHECK_TRUE( fd!=-1);
+		CHECK_TRUE( write( fd, xml.data(), xml.size())==(ssize_t)xml.size());
+		close( fd);
+	}
+	//runs expat-dom-query built next to the test on the file, returns its
+	//output and exit code
+	int query( const char *args, std::string &out){
+		std::string cmd=std::string( "./expat-dom-query ")+args+" "+name+" 2>/dev/null";
+		char buffer[4096];
+		size_t len;
+		FILE *f;
+		int status;
+
+		out.clear();
+		CHECK_TRUE(( f=popen( cmd.c_str(), "r")));
+		while(( len=fread( buffer, 1, sizeof( buffer), f))>0){
+			out.append( buffer, len);
+		}
+		status=pclose( f);
+		return WIFEXITED( status)? WEXITSTATUS( status) : -1;
+	}
+	void teardown(){
+		unlink( name);
+	}
+};
+TEST( g_dom_query, t_dom_query){
+	std::string out;
+	std::string expected;
+	std::string file;
+
+	fixture( "<feed><item id=\"1\" cur=\"EUR\"><name>A</name></item>"
+			"<item id=\"2\" cur=\"USD\"><name>B</name></item>"
+			"<group><item id=\"3\" cur=\"EUR\"><name> C\t</name></item></group></feed>");
+	file=name;
+	LONGS_EQUAL( 0, query( "-t \"//item[@cur='EUR']/name\"", out));
+	expected=file+"\tA\n"+file+"\tC\n";
+	STRCMP_EQUAL( expected.c_str(), out.c_str());
+	//a path without / matches at any depth
+	LONGS_EQUAL( 0, query( "-t \"item[@id]/name\"", out));
+	expected=file+"\tA\n"+file+"\tB\n"+file+"\tC\n";
+	STRCMP_EQUAL( expected.c_str(), out.c_str());
+	LONGS_EQUAL( 0, query( "-t /feed/item/@id", out));
+	expected=file+"\t1\n"+file+"\t2\n";
+	STRCMP_EQUAL( expected.c_str(), out.c_str());
+	LONGS_EQUAL( 0, query( "-t \"/feed/*/item/@id\"", out));
+	expected=file+"\t3\n";
+	STRCMP_EQUAL( expected.c_str(), out.c_str());
+	LONGS_EQUAL( 0, query( "\"/feed/item[@id='2']\"", out));
+	expected="<match file=\""+file+"\"><item id=\"2\" cur=\"USD\"><name>B</name></item></match>\n";
+	STRCMP_EQUAL( expected.c_str(), out.c_str());
+	LONGS_EQUAL( 1, query( "\"//item[@cur='GBP']\"", out));
+	STRCMP_EQUAL( "", out.c_str());
+	LONGS_EQUAL( 2, query( "\"item[@id\"", out));
+	LONGS_EQUAL( 2, query( "item/@id/name", out));
+	unlink( name);
+
+	//a match longer than the output buffer is written in pieces
+	setup();
+	fixture( "<r><a> "+std::string( 200000, 'x')+"\n"+std::string( 100000, 'y')+" </a><a>z</a></r>");
+	file=name;
+	expected=file+"\t"+std::string( 200000, 'x')+"\\n"+std::string( 100000, 'y')+"\n"+file+"\tz\n";
+	LONGS_EQUAL( 0, query( "-t a", out));
+	CHECK( out==expected);
+	LONGS_EQUAL( 0, query( "a", out));
+	expected="<match file=\""+file+"\"><a> "+std::string( 200000, 'x')+"\n"+std::string( 100000, 'y')
+			+" </a></match>\n<match file=\""+file+"\"><a>z</a></match>\n";
+	CHECK( out==expected);
+	//failed writes are errors
+	LONGS_EQUAL( 2, query( "a >&-", out));
+}
+
+#ifdef HAVE_ZLIB
+TEST_GROUP(g_dom_gzip)
+{
+};
+TEST( g_dom_gzip, t_dom_gzip){
+	char name[]="/tmp/expat-dom-test-XXXXXX";
+	char item[64];
+	dom_t *dom;
+	dom_t *node;
+	gzFile gz;
+	int fd;
+	int i;
+
+	fd=mkstemp( name);
+	CHECK_TRUE( fd!=-1);
+	CHECK_TRUE(( gz=gzdopen( fd, "wb")));
+	gzputs( gz, "<items>");
+	for( i=0; i<20000; i++){
+		snprintf( item, sizeof( item), "<item id=\"%d\">value %d</item>", i, i);
+		gzputs( gz, item);
+	}
+	gzputs( gz, "</items>");
+	gzclose( gz);
+
+	dom=dom_parse_file_name( name);
+	unlink( name);
+	CHECK_TRUE(dom);
+	STRCMP_EQUAL( "items", dom->name);
+	node=dom->child;
+	for( i=0; node && node->next; i++){
+		node=node->next;
+	}
+	LONGS_EQUAL( 19999, i);
+	STRCMP_EQUAL( "19999", dom_find_attr( node->attr, "id"));
+	dom_free( dom);
+}
+#endif
+
 int main(int ac, char *av[]){
 	return CommandLineTestRunner::RunAllTests(ac, av);
 }
@@ -0,0 +1,319 @@
+/*
+ * Copyright (c) 2011 Sergey Kolotsey.
+ * This file if part of expat-dom library.
+ * See the file COPYING for copying permission.
+ *
+ * This file defines streaming XML writer. The writer produces XML directly
+ * into an output buffer without building DOM tree.
+ */
+
+#include "expat-config.h"
+
+#ifdef STDC_HEADERS
+# include <stdlib.h>
+# include <stddef.h>
+#else
+# ifdef HAVE_STDLIB_H
+#  include <stdlib.h>
+# endif
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_STRING_H
+# if !defined STDC_HEADERS && defined HAVE_MEMORY_H
+#  include <memory.h>
+# endif
+# include <string.h>
+#endif
+#include <errno.h>
+#include "expat-dom.h"
+
+
+
+#define DOM_WRITER_BUFFER_LEN 65536
+#define DOM_WRITER_MIN_BUFFER_LEN 64
+
+//longest entity produced by escape_xml_r()
+#define DOM_ESCAPE_MAX 6
+
+#define CDATA_OPEN "<![CDATA["
+#define CDATA_OPEN_LEN 9
+#define CDATA_CLOSE "]]>"
+#define CDATA_CLOSE_LEN 3
+
+struct dom_writer_s{
+	dom_write_cb write;
+	void *ctx;
+	int fd;
+
+	char *buffer;
+	int buffer_len;
+	int buffer_size;
+
+	//names of open elements, NULL-separated
+	char *names;
+	int names_len;
+	int names_size;
+
+	//start tag is written but not closed with '>'
+	int tag_open;
+	int error;
+};
+
+
+
+static int dom_writer_fd_write(void *ctx, const char *buffer, size_t buffer_len){
+	dom_writer_t *w=(dom_writer_t *)ctx;
+	ssize_t size_written;
+
+	while(buffer_len){
+		if(-1==(size_written=write(w->fd, buffer, buffer_len))){
+			if(errno==EINTR){
+				continue;
+			}
+			return errno;
+		}
+		buffer+=size_written;
+		buffer_len-=size_written;
+	}
+	return 0;
+}
+
+dom_writer_t *dom_writer_new(dom_write_cb write, void *ctx, int buffer_size){
+	dom_writer_t *w;
+
+	if( !write || buffer_size<0){
+		errno=EINVAL;
+		return NULL;
+	}
+	if(buffer_size==0){
+		buffer_size=DOM_WRITER_BUFFER_LEN;
+	}else if(buffer_size<DOM_WRITER_MIN_BUFFER_LEN){
+		buffer_size=DOM_WRITER_MIN_BUFFER_LEN;
+	}
+	if(NULL==(w=calloc(1, sizeof(dom_writer_t)))){
+		errno=ENOMEM;
+		return NULL;
+	}
+	if(NULL==(w->buffer=malloc(buffer_size))){
+		free(w);
+		errno=ENOMEM;
+		return NULL;
+	}
+	w->write=write;
+	w->ctx=ctx;
+	w->fd=-1;
+	w->buffer_size=buffer_size;
+	return w;
+}
+
+dom_writer_t *dom_writer_new_fd(int fd, int buffer_size){
+	dom_writer_t *w;
+
+	if(fd<0){
+		errno=EINVAL;
+		return NULL;
+	}
+	if((w=dom_writer_new(dom_writer_fd_write, NULL, buffer_size))){
+		w->ctx=w;
+		w->fd=fd;
+	}
+	return w;
+}
+
+dom_writer_t *dom_writer_free(dom_writer_t *w){
+	if(w){
+		free(w->buffer);
+		free(w->names);
+		free(w);
+	}
+	return NULL;
+}
+
+int dom_writer_flush(dom_writer_t *w){
+	if( !w){
+		return EINVAL;
+	}
+	if( !w->error && w->buffer_len){
+		w->error=w->write(w->ctx, w->buffer, w->buffer_len);
+		w->buffer_len=0;
+	}
+	return w->error;
+}
+
+/*
+ * Makes sure that at least len bytes are free in the buffer. len must not be
+ * greater than the size of the buffer.
+ */
+#define dom_writer_reserve(w, len) \
+	((w)->buffer_size-(w)->buffer_len>=(len)? (w)->error : dom_writer_flush(w))
+
+static int dom_writer_put(dom_writer_t *w, const char *data, size_t data_len){
+	size_t len;
+
+	while(data_len){
+		if(w->buffer_len==w->buffer_size && dom_writer_flush(w)){
+			return w->error;
+		}
+		len=w->buffer_size-w->buffer_len;
+		if(len>data_len){
+			len=data_len;
+		}
+		memcpy(w->buffer+w->buffer_len, data, len);
+		w->buffer_len+=len;
+		data+=len;
+		data_len-=len;
+	}
+	return w->error;
+}
+
+/*
+ * Writes escaped data. The data is split into slices short enough for the
+ * escaped slice to fit into the free space of the buffer.
+ */
+static int dom_writer_put_escaped(dom_writer_t *w, const char *data, size_t data_len){
+	size_t len;
+
+	while(data_len){
+		len=(w->buffer_size-w->buffer_len)/DOM_ESCAPE_MAX;
+		if(len==0){
+			if(dom_writer_flush(w)){
+				return w->error;
+			}
+			continue;
+		}
+		if(len>data_len){
+			len=data_len;
+		}
+		w->buffer_len+=escape_xml_r(data, len, w->buffer+w->buffer_len, w->buffer_size-w->buffer_len);
+		data+=len;
+		data_len-=len;
+	}
+	return w->error;
+}
+
+static int dom_writer_close_tag(dom_writer_t *w){
+	if(w->tag_open){
+		w->tag_open=0;
+		if( !dom_writer_reserve(w, 1)){
+			w->buffer[w->buffer_len++]='>';
+		}
+	}
+	return w->error;
+}
+
+int dom_writer_start_element(dom_writer_t *w, const char *name){
+	int name_len;
+	char *temp;
+
+	if( !w || !name || !*name){
+		return EINVAL;
+	}
+	if(w->error || dom_writer_close_tag(w)){
+		return w->error;
+	}
+	name_len=strlen(name)+1;
+	if(w->names_len+name_len>w->names_size){
+		if(NULL==(temp=realloc(w->names, (w->names_len+name_len)*2))){
+			return ENOMEM;
+		}
+		w->names=temp;
+		w->names_size=(w->names_len+name_len)*2;
+	}
+	memcpy(w->names+w->names_len, name, name_len);
+	w->names_len+=name_len;
+
+	if( !dom_writer_reserve(w, 1)){
+		w->buffer[w->buffer_len++]='<';
+		dom_writer_put(w, name, name_len-1);
+		w->tag_open=1;
+	}
+	return w->error;
+}
+
+int dom_writer_attr(dom_writer_t *w, const char *var, const char *val){
+	if( !w || !var || !*var || !val || !w->tag_open){
+		return EINVAL;
+	}
+	if( !w->error && !dom_writer_reserve(w, 1)){
+		w->buffer[w->buffer_len++]=' ';
+		dom_writer_put(w, var, strlen(var));
+		dom_writer_put(w, "=\"", 2);
+		dom_writer_put_escaped(w, val, strlen(val));
+		dom_writer_put(w, "\"", 1);
+	}
+	return w->error;
+}
+
+int dom_writer_text(dom_writer_t *w, const char *text, size_t text_len){
+	if( !w || (text_len && !text) || !w->names_len){
+		return EINVAL;
+	}
+	if( !w->error && !dom_writer_close_tag(w)){
+		dom_writer_put_escaped(w, text, text_len);
+	}
+	return w->error;
+}
+
+int dom_writer_cdata(dom_writer_t *w, const char *text, size_t text_len){
+	const char *end;
+	size_t len;
+
+	if( !w || (text_len && !text) || !w->names_len){
+		return EINVAL;
+	}
+	if(w->error || dom_writer_close_tag(w)){
+		return w->error;
+	}
+	dom_writer_put(w, CDATA_OPEN, CDATA_OPEN_LEN);
+	//"]]>" can not appear inside CDATA section, split the section after "]]"
+	while(text_len>=CDATA_CLOSE_LEN){
+		for(end=text; end+CDATA_CLOSE_LEN<=text+text_len; end++){
+			if(0==memcmp(end, CDATA_CLOSE, CDATA_CLOSE_LEN)){
+				break;
+			}
+		}
+		if(end+CDATA_CLOSE_LEN>text+text_len){
+			break;
+		}
+		len=end-text+2;
+		dom_writer_put(w, text, len);
+		dom_writer_put(w, CDATA_CLOSE CDATA_OPEN, CDATA_CLOSE_LEN+CDATA_OPEN_LEN);
+		text+=len;
+		text_len-=len;
+	}
+	dom_writer_put(w, text, text_len);
+	dom_writer_put(w, CDATA_CLOSE, CDATA_CLOSE_LEN);
+	return w->error;
+}
+
+int dom_writer_end_element(dom_writer_t *w){
+	char *name;
+	int name_len;
+
+	if( !w || !w->names_len){
+		return EINVAL;
+	}
+	//find the name of the innermost element
+	name_len=w->names_len-1;
+	name=w->names+name_len;
+	while(name>w->names && name[-1]){
+		name--;
+	}
+	name_len=w->names+name_len-name;
+	w->names_len=name-w->names;
+
+	if(w->error){
+		return w->error;
+	}
+	if(w->tag_open){
+		w->tag_open=0;
+		dom_writer_put(w, "/>", 2);
+	}else{
+		dom_writer_put(w, "</", 2);
+		dom_writer_put(w, name, name_len);
+		dom_writer_put(w, ">", 1);
+	}
+	return w->error;
+}